@@ -30,10 +30,14 @@ endif
 COMPONENT_VARS += USB_DEBUG_LEVEL
 USB_DEBUG_LEVEL ?= 0
 
+COMPONENT_VARS += USB_MSC_STATS
+USB_MSC_STATS ?= 0
+
 GLOBAL_CFLAGS += \
 	-DCFG_TUSB_MCU=$(CFG_TUSB_MCU) \
 	-DCFG_TUSB_DEBUG=$(USB_DEBUG_LEVEL) \
-	-DCFG_TUSB_DEBUG_PRINTF=m_printf
+	-DCFG_TUSB_DEBUG_PRINTF=m_printf \
+	-DUSB_MSC_STATS=$(USB_MSC_STATS)
 
 COMPONENT_VARS += USB_CONFIG
 ifdef USB_CONFIG
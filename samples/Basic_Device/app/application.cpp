@@ -1,5 +1,6 @@
 #include <SmingCore.h>
 #include <USB.h>
+#include <USB/HID/Typist.h>
 #include <Storage/SpiFlash.h>
 #include <FlashString/Vector.hpp>
 
@@ -21,39 +22,16 @@ SimpleTimer timer;
 
 #if CFG_TUD_HID
 
-// Use provided TinyUSB table to convert ASCII codes to HID codes.
-// Note that this conversion table does not account for all keyboard layout differences.
-const uint8_t conv_table[128][2] = {HID_ASCII_TO_KEYCODE};
-
 // String of text to 'type out' on the HID keyboard
 const char* testText = "\x1b echo This should be harmless enough... Rrrrepeatinggggg.\n";
 
-// State variables
-char lastChar;
-unsigned charIndex;
-
-void sendChar()
-{
-	hid_keyboard_report_t report{};
-	char c = testText[charIndex];
-	if(c == lastChar) {
-		lastChar = '\0';
-	} else {
-		++charIndex;
-		lastChar = c;
-		auto& entry = conv_table[unsigned(c)];
-		report.modifier = entry[0] ? KEYBOARD_MODIFIER_LEFTSHIFT : 0;
-		report.keycode[0] = entry[1];
-	}
-
-	USB::hid0.sendReport(REPORT_ID_KEYBOARD, &report, sizeof(report), c ? sendChar : nullptr);
-}
+USB::HID::Typist typist(USB::hid0, REPORT_ID_KEYBOARD);
 
 void sendText()
 {
-	charIndex = 0;
-	lastChar = '\0';
-	sendChar();
+	typist.type(testText, [](USB::HID::Typist& typist) {
+		debug_i("Typed text in %u reports", typist.getReportCount());
+	});
 }
 
 #endif // CFG_TUD_HID
@@ -71,24 +49,26 @@ const char* midiCodes[] = {
 
 #if CFG_TUD_DFU
 
+#include <USB/DFU/PartitionWriter.h>
+
 DEFINE_FSTR(image1, "Hello world from TinyUSB DFU! - Partition 0")
 DEFINE_FSTR(image2, "Hello world from TinyUSB DFU! - Partition 1")
 DEFINE_FSTR(image3, "Hello world from TinyUSB DFU! - Partition 2")
 DEFINE_FSTR_VECTOR(upload_images, FlashString, &image1, &image2, &image3)
 
-class DfuCallbacks : public USB::DFU::Callbacks
+// FLASH alternate is written by PartitionWriter, others are handled here
+class DfuCallbacks : public USB::DFU::PartitionWriter
 {
 public:
 	uint32_t getTimeout(Alternate alt, dfu_state_t state) override
 	{
-		if(state == DFU_DNBUSY) {
-			// For this example, EEPROM is slow (100ms), FLASH and RAM are fast (1ms)
-			return (alt == DFU_ALTERNATE_EEPROM) ? 100 : 1;
+		if(alt == DFU_ALTERNATE_FLASH) {
+			return PartitionWriter::getTimeout(alt, state);
 		}
 
-		if(state == DFU_MANIFEST) {
-			// since we don't buffer entire image and do any flashing in manifest stage
-			return 0;
+		if(state == DFU_DNBUSY) {
+			// For this example, EEPROM is slow (100ms), RAM is fast (1ms)
+			return (alt == DFU_ALTERNATE_EEPROM) ? 100 : 1;
 		}
 
 		return 0;
@@ -98,39 +78,25 @@ public:
 	{
 		debug_i("[DFU] Download alt %u, offset %u, length %u", alt, offset, length);
 
-		auto status = DFU_STATUS_OK;
-
-		switch(alt) {
-		case DFU_ALTERNATE_FLASH: {
-			auto part = Storage::findPartition("flash0");
-			if(!part) {
-				status = DFU_STATUS_ERR_TARGET;
-				break;
-			}
-			auto blockSize = part.getBlockSize();
-			if(offset % blockSize == 0) {
-				if(!part.erase_range(offset, blockSize)) {
-					status = DFU_STATUS_ERR_ERASE;
-					break;
-				}
-			}
-			if(!part.write(offset, data, length)) {
-				status = DFU_STATUS_ERR_WRITE;
-			}
-			break;
+		if(alt == DFU_ALTERNATE_FLASH) {
+			PartitionWriter::download(alt, offset, data, length);
+			return;
 		}
 
-		default:
-			debug_hex(INFO, "DFU", data, length);
-		}
-
-		USB::dfu0.complete(status);
+		debug_hex(INFO, "DFU", data, length);
+		USB::dfu0.complete(DFU_STATUS_OK);
 	}
 
 	void manifest(Alternate alt) override
 	{
 		debug_i("[DFU] Alt %u download complete, enter manifestation", alt);
 
+		if(alt == DFU_ALTERNATE_FLASH) {
+			// Completes when all data has been written
+			PartitionWriter::manifest(alt);
+			return;
+		}
+
 		// flashing op for manifest is complete without error
 		// Application can perform checksum, should it fail, use appropriate status such as errVERIFY.
 		USB::dfu0.complete(DFU_STATUS_OK);
@@ -140,11 +106,9 @@ public:
 	{
 		uint16_t res{0};
 		switch(alt) {
-		case DFU_ALTERNATE_FLASH: {
-			auto part = Storage::findPartition("flash0");
-			res = part.read(offset, data, length) ? length : 0;
+		case DFU_ALTERNATE_FLASH:
+			res = PartitionWriter::upload(alt, offset, data, length);
 			break;
-		}
 		default:
 			res = upload_images[alt].read(offset, reinterpret_cast<char*>(data), length);
 		}
@@ -155,6 +119,7 @@ public:
 	void abort(Alternate alt) override
 	{
 		debug_w("[DFU] Host aborted transfer, alt %u", alt);
+		PartitionWriter::abort(alt);
 	}
 
 	void detach() override
@@ -225,6 +190,7 @@ void init()
 #endif
 
 #if CFG_TUD_DFU
+	dfuCallbacks.setPartition(DFU_ALTERNATE_FLASH, Storage::findPartition("flash0"));
 	USB::dfu0.begin(dfuCallbacks);
 #endif
 
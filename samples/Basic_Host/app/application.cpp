@@ -82,7 +82,13 @@ void init()
 		if(protocol != HID_ITF_PROTOCOL_KEYBOARD) {
 			return nullptr;
 		}
-		hid0.begin(inst);
+		// Called if descriptor was too large for the enumeration buffer and had to be fetched
+		hid0.onReportMap([](auto& dev, bool success) {
+			Serial << "HID report map: " << (success ? "OK" : "failed") << ", " << dev.getReportMap().getFieldCount()
+				   << " fields" << endl;
+		});
+		hid0.begin(inst, report);
+		hid0.onField([](auto& field, auto index, auto value) { Serial << "  " << field << " = " << value << endl; });
 		hid0.onReport([](auto& rpt) {
 			debug_i("Report received, %u bytes", rpt.length);
 			hid0.requestReport();
@@ -145,7 +151,7 @@ void init()
 		for(unsigned i = 0; i < unsigned(Input::MAX); ++i) {
 			auto input = Input(i);
 			if(changed[input]) {
-				Serial << xbox.getInputName(input) << ": " << xbox.inputs()[input] << endl;
+				Serial << xbox.getInputName(input) << ": " << xbox.getInput(input) << endl;
 			}
 		}
 	});
@@ -8,7 +8,6 @@
  */
 
 #include "xbox.h"
-#include <host/usbh_pvt.h>
 
 namespace USB::VENDOR
 {
@@ -25,7 +24,22 @@ bool Xbox::begin(const Instance& inst, const Config& cfg)
 	}
 
 	HostInterface::begin(inst);
-	state = 0;
+
+	// Input data follows 2-byte packet header
+	InputState::Input inputs[unsigned(Input::MAX)];
+	unsigned i{0};
+	unsigned offset{16};
+#define XX(tag, type, bits, threshold)                                                                                 \
+	inputs[i++] = {uint16_t(offset), bits, std::is_signed<type>::value, 0, threshold};                                 \
+	offset += bits;
+	XBOX360_INPUT_MAP(XX)
+#undef XX
+	inputState.begin(inputs, i);
+	inputState.onChange([this](InputState::Mask changed) {
+		if(inputChangeCallback) {
+			inputChangeCallback(InputMask(uint32_t(changed)));
+		}
+	});
 
 	debug_i("[XBOX] Found controller");
 
@@ -51,7 +65,8 @@ bool Xbox::parseInterface(DescriptorList list)
 	}
 
 	debug_i("ep-in 0x%02x, ep-out 0x%02x", ep_in, ep_out);
-	return ep_in && ep_out;
+	// Reports may be sent before the previous one has completed
+	return ep_in && ep_out && startSend(ep_out, 4, outputSize);
 }
 
 bool Xbox::setConfig(uint8_t itf_num)
@@ -61,12 +76,23 @@ bool Xbox::setConfig(uint8_t itf_num)
 		return false;
 	}
 
-	return control(TUSB_REQ_RCPT_INTERFACE, 0x100, 20);
+#ifdef USB_HOST_ASYNC
+	initialise();
+	return true;
+#else
+	// Requests are queued and issued in turn
+	return control(TUSB_REQ_RCPT_INTERFACE, 0x100, 20) && control(TUSB_REQ_RCPT_INTERFACE, 0, 8) &&
+		   control(TUSB_REQ_RCPT_DEVICE, 0, 4, [this](const tuh_xfer_t&) {
+			   setled(LedCommand::rotate2);
+			   // Double-buffer input so a transfer is always pending
+			   startReceive(ep_in, 2, bufSize);
+		   });
+#endif
 }
 
-bool Xbox::control(tusb_request_recipient_t recipient, uint16_t value, uint16_t length)
+tusb_control_request_t Xbox::controlRequest(tusb_request_recipient_t recipient, uint16_t value, uint16_t length)
 {
-	const tusb_control_request_t request = {
+	return {
 		.bmRequestType_bit =
 			{
 				.recipient = recipient,
@@ -78,52 +104,35 @@ bool Xbox::control(tusb_request_recipient_t recipient, uint16_t value, uint16_t
 		.wIndex = tu_htole16(0),
 		.wLength = tu_htole16(length),
 	};
-
-	tuh_xfer_t xfer = {
-		.daddr = inst.dev_addr,
-		.ep_addr = 0,
-		.setup = &request,
-		.buffer = controlBuffer,
-		.complete_cb = static_control_cb,
-		.user_data = uintptr_t(this),
-	};
-
-	return tuh_control_xfer(&xfer);
 }
 
-void Xbox::control_cb(tuh_xfer_t& xfer)
+#ifdef USB_HOST_ASYNC
+Async::Task Xbox::initialise()
 {
-	debug_i("%s(%u)", __FUNCTION__, xfer.user_data);
-	switch(state++) {
-	case 0:
-		control(TUSB_REQ_RCPT_INTERFACE, 0, 8);
-		break;
-	case 1:
-		control(TUSB_REQ_RCPT_DEVICE, 0, 4);
-		break;
-	case 2:
-		setled(LedCommand::rotate2);
-		read();
-	}
+	// As with the callback version, results are not checked
+	co_await Async::control(*this, controlRequest(TUSB_REQ_RCPT_INTERFACE, 0x100, 20), controlBuffer);
+	co_await Async::control(*this, controlRequest(TUSB_REQ_RCPT_INTERFACE, 0, 8), controlBuffer);
+	co_await Async::control(*this, controlRequest(TUSB_REQ_RCPT_DEVICE, 0, 4), controlBuffer);
+	setled(LedCommand::rotate2);
+	// Double-buffer input so a transfer is always pending
+	startReceive(ep_in, 2, bufSize);
 }
-
-bool Xbox::transferComplete(const Transfer& txfr)
+#else
+bool Xbox::control(tusb_request_recipient_t recipient, uint16_t value, uint16_t length, ControlCallback callback)
 {
-	debug_hex(DBG, "RX", dataBuffer, txfr.xferred_bytes);
-	process_packet();
-	read();
-	return true;
+	return controlTransfer(controlRequest(recipient, value, length), controlBuffer, callback);
 }
+#endif
 
-bool Xbox::read()
+bool Xbox::dataReceived(const Transfer& txfr, uint8_t* data)
 {
-	TU_VERIFY(usbh_edpt_claim(inst.dev_addr, ep_in));
-
-	if(!usbh_edpt_xfer(inst.dev_addr, ep_in, dataBuffer, bufSize)) {
-		usbh_edpt_release(inst.dev_addr, ep_in);
-		return false;
+	if(txfr.result != XFER_RESULT_SUCCESS) {
+		// Queue is stopped. Resuming without clearing the condition (e.g. a STALL) would just fail again.
+		debug_e("[XBOX] Input transfer failed (%u), stopped", txfr.result);
+		return true;
 	}
-
+	debug_hex(DBG, "RX", data, txfr.xferred_bytes);
+	inputState.update(data, txfr.xferred_bytes);
 	return true;
 }
 
@@ -140,54 +149,16 @@ const char* Xbox::getInputName(Xbox::Input input)
 	}
 }
 
-void Xbox::process_packet()
-{
-	InputData data;
-	memcpy(&data, &dataBuffer[2], sizeof(data));
-
-	auto b = reinterpret_cast<const uint8_t*>(&data);
-	uint16_t btn1 = b[0] | (b[1] << 8);
-	b = reinterpret_cast<const uint8_t*>(&inputData);
-	uint16_t btn2 = b[0] | (b[1] << 8);
-	InputMask changed = btn1 ^ btn2;
-	changed[Input::trig_left] = (data.trig_left != inputData.trig_left);
-	changed[Input::trig_right] = (data.trig_right != inputData.trig_right);
-	auto stickChanged = [](int16_t a, int16_t b) -> bool { return abs(a - b) >= 256; };
-	changed[Input::stick_left_x] = stickChanged(data.stick_left_x, inputData.stick_left_x);
-	changed[Input::stick_left_y] = stickChanged(data.stick_left_y, inputData.stick_left_y);
-	changed[Input::stick_right_x] = stickChanged(data.stick_right_x, inputData.stick_right_x);
-	changed[Input::stick_right_y] = stickChanged(data.stick_right_y, inputData.stick_right_y);
-
-	inputData = data;
-
-	if(inputChangeCallback) {
-		inputChangeCallback(changed);
-	}
-}
-
-bool Xbox::output(const void* data, uint8_t length)
-{
-	TU_VERIFY(usbh_edpt_claim(inst.dev_addr, ep_out));
-
-	memcpy(outputBuffer, data, length);
-	if(!usbh_edpt_xfer(inst.dev_addr, ep_out, outputBuffer, length)) {
-		usbh_edpt_release(inst.dev_addr, ep_out);
-		return false;
-	}
-
-	return true;
-}
-
 bool Xbox::setled(LedCommand cmd)
 {
 	const uint8_t data[]{0x01, 0x03, uint8_t(cmd)};
-	return output(data, ARRAY_SIZE(data));
+	return write(ep_out, data, ARRAY_SIZE(data));
 }
 
 bool Xbox::rumble(uint8_t strong, uint8_t weak)
 {
 	const uint8_t data[]{0x00, 0x08, 0x00, strong, weak, 0x00, 0x00, 0x00};
-	return output(data, ARRAY_SIZE(data));
+	return write(ep_out, data, ARRAY_SIZE(data));
 }
 
 } // namespace USB::VENDOR
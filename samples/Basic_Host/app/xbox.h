@@ -1,32 +1,34 @@
 #pragma once
 
 #include <USB.h>
+#include <USB/HostAsync.h>
+#include <USB/InputState.h>
 #include <Data/BitSet.h>
 
-// tag, type, bits, compare mask
+// tag, type, bits, threshold
 #define XBOX360_INPUT_MAP(XX)                                                                                          \
-	XX(dpad_up, bool, 1, 0x01)                                                                                         \
-	XX(dpad_down, bool, 1, 0x01)                                                                                       \
-	XX(dpad_left, bool, 1, 0x01)                                                                                       \
-	XX(dpad_right, bool, 1, 0x01)                                                                                      \
-	XX(btn_start, bool, 1, 0x01)                                                                                       \
-	XX(btn_back, bool, 1, 0x01)                                                                                        \
-	XX(btn_stick_left, bool, 1, 0x01)                                                                                  \
-	XX(btn_stick_right, bool, 1, 0x01)                                                                                 \
-	XX(btn_trig_left, bool, 1, 0x01)                                                                                   \
-	XX(btn_trig_right, bool, 1, 0x01)                                                                                  \
-	XX(btn_mode, bool, 1, 0x01)                                                                                        \
-	XX(btn_unk1, bool, 1, 0x01)                                                                                        \
-	XX(btn_a, bool, 1, 0x01)                                                                                           \
-	XX(btn_b, bool, 1, 0x01)                                                                                           \
-	XX(btn_x, bool, 1, 0x01)                                                                                           \
-	XX(btn_y, bool, 1, 0x01)                                                                                           \
-	XX(trig_left, uint8_t, 8, 0xff)                                                                                    \
-	XX(trig_right, uint8_t, 8, 0xff)                                                                                   \
-	XX(stick_left_x, int16_t, 16, 0xff00)                                                                              \
-	XX(stick_left_y, int16_t, 16, 0xff00)                                                                              \
-	XX(stick_right_x, int16_t, 16, 0xff00)                                                                             \
-	XX(stick_right_y, int16_t, 16, 0xff00)
+	XX(dpad_up, bool, 1, 0)                                                                                            \
+	XX(dpad_down, bool, 1, 0)                                                                                          \
+	XX(dpad_left, bool, 1, 0)                                                                                          \
+	XX(dpad_right, bool, 1, 0)                                                                                         \
+	XX(btn_start, bool, 1, 0)                                                                                          \
+	XX(btn_back, bool, 1, 0)                                                                                           \
+	XX(btn_stick_left, bool, 1, 0)                                                                                     \
+	XX(btn_stick_right, bool, 1, 0)                                                                                    \
+	XX(btn_trig_left, bool, 1, 0)                                                                                      \
+	XX(btn_trig_right, bool, 1, 0)                                                                                     \
+	XX(btn_mode, bool, 1, 0)                                                                                           \
+	XX(btn_unk1, bool, 1, 0)                                                                                           \
+	XX(btn_a, bool, 1, 0)                                                                                              \
+	XX(btn_b, bool, 1, 0)                                                                                              \
+	XX(btn_x, bool, 1, 0)                                                                                              \
+	XX(btn_y, bool, 1, 0)                                                                                              \
+	XX(trig_left, uint8_t, 8, 0)                                                                                       \
+	XX(trig_right, uint8_t, 8, 0)                                                                                      \
+	XX(stick_left_x, int16_t, 16, 256)                                                                                 \
+	XX(stick_left_y, int16_t, 16, 256)                                                                                 \
+	XX(stick_right_x, int16_t, 16, 256)                                                                                \
+	XX(stick_right_y, int16_t, 16, 256)
 
 namespace USB::VENDOR
 {
@@ -43,25 +45,6 @@ public:
 	using InputMask = BitSet<uint32_t, Input>;
 	using InputChange = Delegate<void(InputMask changed)>;
 
-	struct InputData {
-#define XX(tag, type, size, ...) type tag : size;
-		XBOX360_INPUT_MAP(XX)
-#undef XX
-
-		int16_t operator[](Input input) const
-		{
-			switch(input) {
-#define XX(tag, ...)                                                                                                   \
-	case Input::tag:                                                                                                   \
-		return tag;
-				XBOX360_INPUT_MAP(XX)
-#undef XX
-			default:
-				return 0;
-			}
-		}
-	};
-
 	enum class LedCommand {
 		off,				   //   0: off
 		all_blink_once,		   //   1: all blink, then previous setting
@@ -82,7 +65,6 @@ public:
 	};
 
 	bool begin(const Instance& inst, const Config& cfg);
-	bool read();
 	bool setled(LedCommand cmd);
 	bool rumble(uint8_t strong, uint8_t weak);
 
@@ -91,38 +73,35 @@ public:
 		inputChangeCallback = callback;
 	}
 
-	const InputData& inputs() const
+	int32_t getInput(Input input) const
 	{
-		return inputData;
+		return inputState[unsigned(input)];
 	}
 
 	static const char* getInputName(Xbox::Input input);
 
 	bool setConfig(uint8_t itf_num) override;
-	bool transferComplete(const Transfer& txfr) override;
+
+protected:
+	bool dataReceived(const Transfer& txfr, uint8_t* data) override;
 
 private:
 	bool parseInterface(DescriptorList list);
-	bool control(tusb_request_recipient_t recipient, uint16_t value, uint16_t length);
-	void control_cb(tuh_xfer_t& xfer);
-	void process_packet();
-	bool output(const void* data, uint8_t length);
-
-	static void static_control_cb(tuh_xfer_t* xfer)
-	{
-		auto self = reinterpret_cast<Xbox*>(xfer->user_data);
-		self->control_cb(*xfer);
-	}
+	static tusb_control_request_t controlRequest(tusb_request_recipient_t recipient, uint16_t value, uint16_t length);
+#ifdef USB_HOST_ASYNC
+	Async::Task initialise();
+#else
+	bool control(tusb_request_recipient_t recipient, uint16_t value, uint16_t length,
+				 ControlCallback callback = nullptr);
+#endif
 
 	static constexpr size_t bufSize{64};
-	InputData inputData{};
+	static constexpr size_t outputSize{8};
+	InputState inputState;
 	InputChange inputChangeCallback;
 	uint8_t controlBuffer[20]{};
-	uint8_t dataBuffer[bufSize];
-	uint8_t outputBuffer[8];
 	uint8_t ep_in{0};
 	uint8_t ep_out{0};
-	uint8_t state{0};
 };
 
 } // namespace USB::VENDOR
@@ -5,3 +5,6 @@ COMPONENT_DEPENDS := USB
 DISABLE_NETWORK := 1
 
 USB_CONFIG := basic_host.usbcfg
+
+# Xbox driver uses coroutines (USB/HostAsync.h) when available
+CXXFLAGS += -std=c++20
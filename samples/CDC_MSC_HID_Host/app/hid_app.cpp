@@ -25,6 +25,7 @@
 
 #include <SmingCore.h>
 #include <USB.h>
+#include <USB/HID/KeyState.h>
 
 // If your host terminal support ansi escape code such as TeraTerm
 // it can be use to simulate mouse cursor movement within terminal
@@ -43,44 +44,30 @@ struct HidInfo {
 };
 HidInfo hid_info[CFG_TUH_HID];
 
-// look up new key in previous keys
-bool find_key_in_report(hid_keyboard_report_t const* report, uint8_t keycode)
+USB::HID::KeyState keyState;
+
+void key_changed(uint8_t key, bool pressed)
 {
-	for(auto c : report->keycode) {
-		if(c == keycode)
-			return true;
+	// Example code ignore control (non-printable) key affects
+	if(!pressed || key >= ARRAY_SIZE(keycode2ascii)) {
+		return;
 	}
 
-	return false;
+	const bool is_shift = keyState.getModifiers() & (KEYBOARD_MODIFIER_LEFTSHIFT | KEYBOARD_MODIFIER_RIGHTSHIFT);
+	auto ch = keycode2ascii[key][is_shift ? 1 : 0];
+	if(ch == 0) {
+		return;
+	}
+	m_putc(ch);
+	if(ch == '\r') {
+		m_putc('\n');
+	}
 }
 
 void process_kbd_report(hid_keyboard_report_t const* report)
 {
-	// previous report to check key released
-	static hid_keyboard_report_t prev_report{};
-
-	// Example code ignore control (non-printable) key affects
-
-	for(auto c : report->keycode) {
-		if(c == 0) {
-			// TODO example skips key released
-			continue;
-		}
-
-		if(find_key_in_report(&prev_report, c)) {
-			// exist in previous report means the current key is holding
-			continue;
-		}
-		// not existed in previous report means the current key is pressed
-		const bool is_shift = report->modifier & (KEYBOARD_MODIFIER_LEFTSHIFT | KEYBOARD_MODIFIER_RIGHTSHIFT);
-		auto ch = keycode2ascii[c][is_shift ? 1 : 0];
-		m_putc(ch);
-		if(ch == '\r') {
-			m_putc('\n');
-		}
-	}
-
-	prev_report = *report;
+	// Generates key_changed() calls for keys pressed or released since previous report
+	keyState.update(*report);
 }
 
 void cursor_movement(int8_t x, int8_t y, int8_t wheel)
@@ -210,6 +197,8 @@ void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance, const uint8_t* desc_re
 
 	m_printf("HID Interface Protocol = %s\r\n", protocol_str[itf_protocol]);
 
+	keyState.onKey(key_changed);
+
 	// By default host stack will use activate boot protocol on supported interface.
 	// Therefore for this simple example, we only need to parse generic report descriptor (with built-in parser)
 	if(itf_protocol == HID_ITF_PROTOCOL_NONE) {
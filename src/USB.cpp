@@ -22,6 +22,12 @@
 #include "USB.h"
 #include <Platform/System.h>
 
+#if defined(ENABLE_USB_CLASSES) && CFG_TUD_ENABLED &&                                                                 \
+	((CFG_TUD_MSC && CFG_TUD_MSC_UAS_QUEUE_DEPTH) || CFG_TUD_VENDOR)
+#define USB_APP_DRIVERS
+#include <device/usbd_pvt.h>
+#endif
+
 namespace
 {
 void poll()
@@ -65,3 +71,38 @@ bool begin()
 }
 
 } // namespace USB
+
+#ifdef USB_APP_DRIVERS
+
+namespace USB
+{
+namespace MSC
+{
+const usbd_class_driver_t* getUasDriver();
+}
+
+namespace VENDOR
+{
+const usbd_class_driver_t* getBulkDriver();
+}
+} // namespace USB
+
+/*
+ * Application class drivers are offered each interface before the standard TinyUSB drivers
+ */
+const usbd_class_driver_t* usbd_app_driver_get_cb(uint8_t* driver_count)
+{
+	static const usbd_class_driver_t drivers[]{
+#if CFG_TUD_MSC && CFG_TUD_MSC_UAS_QUEUE_DEPTH
+		*USB::MSC::getUasDriver(),
+#endif
+#if CFG_TUD_VENDOR
+		*USB::VENDOR::getBulkDriver(),
+#endif
+	};
+
+	*driver_count = ARRAY_SIZE(drivers);
+	return drivers;
+}
+
+#endif
@@ -0,0 +1,104 @@
+/****
+ * BosDescriptor.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Descriptor macros for WebUSB and Microsoft OS 2.0 platform capabilities.
+ * This header is included by generated C code so must remain C-compatible.
+ *
+ ****/
+
+#pragma once
+
+#include <tusb.h>
+
+// Vendor request codes advertised in BOS platform capabilities
+#define BOS_VENDOR_REQUEST_WEBUSB 0x01
+#define BOS_VENDOR_REQUEST_MICROSOFT 0x02
+
+// wIndex values for vendor requests
+#define WEBUSB_REQUEST_GET_URL 0x02
+#define MS_OS_20_DESCRIPTOR_INDEX 0x07
+
+// WebUSB URL descriptor type
+#define WEBUSB_DESC_URL 0x03
+
+// Minimum Windows version supported by descriptor set (Windows 8.1)
+#define MS_OS_20_WINDOWS_VERSION 0x06030000
+
+#define MS_OS_20_SET_HEADER_LEN 10
+#define MS_OS_20_CONFIG_SUBSET_LEN 8
+#define MS_OS_20_FUNCTION_SUBSET_LEN 8
+#define MS_OS_20_COMPATIBLE_ID_LEN 20
+#define MS_OS_20_DEVICE_INTERFACE_GUIDS_LEN 132
+
+/*
+ * Total length of descriptor set
+ */
+#define MS_OS_20_SET_HEADER(_total_len)                                                                                \
+	U16_TO_U8S_LE(MS_OS_20_SET_HEADER_LEN), U16_TO_U8S_LE(MS_OS_20_SET_HEADER_DESCRIPTOR),                             \
+		U32_TO_U8S_LE(MS_OS_20_WINDOWS_VERSION), U16_TO_U8S_LE(_total_len)
+
+/*
+ * Configuration index (from 0), total length of subset including this header
+ */
+#define MS_OS_20_CONFIG_SUBSET(_cfg_index, _subset_len)                                                                \
+	U16_TO_U8S_LE(MS_OS_20_CONFIG_SUBSET_LEN), U16_TO_U8S_LE(MS_OS_20_SUBSET_HEADER_CONFIGURATION), _cfg_index, 0,     \
+		U16_TO_U8S_LE(_subset_len)
+
+/*
+ * First interface of function, total length of subset including this header
+ */
+#define MS_OS_20_FUNCTION_SUBSET(_itfnum, _subset_len)                                                                 \
+	U16_TO_U8S_LE(MS_OS_20_FUNCTION_SUBSET_LEN), U16_TO_U8S_LE(MS_OS_20_SUBSET_HEADER_FUNCTION), _itfnum, 0,           \
+		U16_TO_U8S_LE(_subset_len)
+
+/*
+ * Compatible ID so Windows binds WinUSB driver
+ */
+#define MS_OS_20_COMPATIBLE_ID_WINUSB                                                                                  \
+	U16_TO_U8S_LE(MS_OS_20_COMPATIBLE_ID_LEN), U16_TO_U8S_LE(MS_OS_20_FEATURE_COMPATBLE_ID), 'W', 'I', 'N', 'U', 'S',  \
+		'B', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+
+/*
+ * Registry property giving interface GUID, used by applications to locate the device.
+ * Pass GUID string "{xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx}" as 38 UTF-16LE characters.
+ * The value is REG_MULTI_SZ so is terminated by two NULs.
+ */
+#define MS_OS_20_DEVICE_INTERFACE_GUIDS(...)                                                                           \
+	U16_TO_U8S_LE(MS_OS_20_DEVICE_INTERFACE_GUIDS_LEN), U16_TO_U8S_LE(MS_OS_20_FEATURE_REG_PROPERTY),                  \
+		U16_TO_U8S_LE(0x0007), U16_TO_U8S_LE(0x002a), 'D', 0, 'e', 0, 'v', 0, 'i', 0, 'c', 0, 'e', 0, 'I', 0, 'n', 0,  \
+		't', 0, 'e', 0, 'r', 0, 'f', 0, 'a', 0, 'c', 0, 'e', 0, 'G', 0, 'U', 0, 'I', 0, 'D', 0, 's', 0, 0, 0,          \
+		U16_TO_U8S_LE(0x0050), __VA_ARGS__, 0, 0, 0, 0
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Get WebUSB landing page URL descriptor
+ * @retval const uint8_t* nullptr if not configured
+ */
+const uint8_t* tud_get_webusb_url(void);
+
+/**
+ * @brief Get Microsoft OS 2.0 descriptor set
+ * @retval const uint8_t* nullptr if not configured
+ */
+const uint8_t* tud_get_ms_os_20_descriptor(void);
+
+#ifdef __cplusplus
+}
+#endif
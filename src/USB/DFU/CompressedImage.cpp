@@ -0,0 +1,187 @@
+/****
+ * DFU/CompressedImage.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if defined(ENABLE_USB_CLASSES) && CFG_TUD_DFU
+
+#include "CompressedImage.h"
+#include <debug_progmem.h>
+
+namespace USB::DFU
+{
+bool HeatshrinkDecoder::begin(uint8_t windowBits, uint8_t lookaheadBits)
+{
+	if(windowBits < minWindowBits || windowBits > maxWindowBits || lookaheadBits < 3 ||
+	   lookaheadBits >= windowBits) {
+		return false;
+	}
+
+	auto windowSize = 1U << windowBits;
+	if(!window || windowBits != this->windowBits) {
+		window.reset(new uint8_t[windowSize]);
+	}
+	memset(window.get(), 0, windowSize);
+	windowMask = windowSize - 1;
+	this->windowBits = windowBits;
+	this->lookaheadBits = lookaheadBits;
+	head = 0;
+	bitBuffer = 0;
+	bitCount = 0;
+	state = State::tag;
+	return true;
+}
+
+bool HeatshrinkDecoder::getBits(uint8_t count, uint16_t& value)
+{
+	while(bitCount < count) {
+		if(inputAvailable == 0) {
+			return false;
+		}
+		bitBuffer = (bitBuffer << 8) | *inputPtr++;
+		--inputAvailable;
+		bitCount += 8;
+	}
+	bitCount -= count;
+	value = (bitBuffer >> bitCount) & ((1U << count) - 1);
+	return true;
+}
+
+size_t HeatshrinkDecoder::decode(const uint8_t*& input, size_t& inputLength, uint8_t* output, size_t outputSize)
+{
+	if(!window) {
+		return 0;
+	}
+
+	inputPtr = input;
+	inputAvailable = inputLength;
+	size_t outputLength{0};
+
+	auto emit = [&](uint8_t c) {
+		output[outputLength++] = c;
+		window[head++ & windowMask] = c;
+	};
+
+	while(outputLength < outputSize) {
+		uint8_t bits{1};
+		switch(state) {
+		case State::tag:
+			break;
+		case State::literal:
+			bits = 8;
+			break;
+		case State::index:
+			bits = windowBits;
+			break;
+		case State::count:
+			bits = lookaheadBits;
+			break;
+		case State::copy:
+			emit(window[(head - backrefIndex) & windowMask]);
+			if(--copyCount == 0) {
+				state = State::tag;
+			}
+			continue;
+		}
+
+		uint16_t value;
+		if(!getBits(bits, value)) {
+			break;
+		}
+
+		switch(state) {
+		case State::tag:
+			state = value ? State::literal : State::index;
+			break;
+		case State::literal:
+			emit(value);
+			state = State::tag;
+			break;
+		case State::index:
+			backrefIndex = value + 1;
+			state = State::count;
+			break;
+		case State::count:
+			copyCount = value + 1;
+			state = State::copy;
+			break;
+		case State::copy:
+			break;
+		}
+	}
+
+	input = inputPtr;
+	inputLength = inputAvailable;
+	return outputLength;
+}
+
+void CompressedImage::reset()
+{
+	header = {};
+	headerLength = 0;
+	outputSize = 0;
+	crc = Crc32{};
+	decoder.end();
+}
+
+int CompressedImage::decode(const uint8_t*& input, size_t& inputLength, uint8_t* output, size_t outputSize)
+{
+	if(headerLength < sizeof(header)) {
+		auto n = std::min(inputLength, sizeof(header) - headerLength);
+		memcpy(reinterpret_cast<uint8_t*>(&header) + headerLength, input, n);
+		headerLength += n;
+		input += n;
+		inputLength -= n;
+		if(headerLength < sizeof(header)) {
+			return 0;
+		}
+		if(header.magic != Header::magicValue || !decoder.begin(header.windowBits, header.lookaheadBits)) {
+			debug_e("[DFU] Bad compressed image header");
+			return -1;
+		}
+		debug_d("[DFU] Compressed image, size %u, w%u l%u", header.imageSize, header.windowBits,
+				header.lookaheadBits);
+	}
+
+	// Ignore any padding bits at end of stream
+	outputSize = std::min(outputSize, size_t(header.imageSize - this->outputSize));
+	auto n = decoder.decode(input, inputLength, output, outputSize);
+	crc.update(output, n);
+	this->outputSize += n;
+	return n;
+}
+
+bool CompressedImage::verify() const
+{
+	if(headerLength < sizeof(header) || outputSize != header.imageSize) {
+		debug_e("[DFU] Image incomplete: %u of %u bytes", outputSize, header.imageSize);
+		return false;
+	}
+
+	if(crc.getValue() != header.crc) {
+		debug_e("[DFU] Image CRC mismatch");
+		return false;
+	}
+
+	return true;
+}
+
+} // namespace USB::DFU
+
+#endif
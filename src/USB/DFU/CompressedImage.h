@@ -0,0 +1,143 @@
+/****
+ * DFU/CompressedImage.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "ImageDecoder.h"
+#include "Crc32.h"
+#include <memory>
+
+namespace USB::DFU
+{
+/**
+ * @brief Streaming decoder for heatshrink (LZSS) compressed data
+ *
+ * Input and output may be supplied in chunks of any size.
+ * RAM usage is dominated by the window buffer, 2^windowBits bytes.
+ */
+class HeatshrinkDecoder
+{
+public:
+	static constexpr uint8_t minWindowBits{4};
+	static constexpr uint8_t maxWindowBits{12};
+
+	/**
+	 * @brief Prepare to decode a new stream
+	 * @param windowBits Window size, as used by encoder (-w)
+	 * @param lookaheadBits Lookahead size, as used by encoder (-l)
+	 * @retval bool false if parameters are out of range
+	 */
+	bool begin(uint8_t windowBits, uint8_t lookaheadBits);
+
+	void end()
+	{
+		window.reset();
+	}
+
+	/**
+	 * @brief Decode data
+	 * @param input Compressed data, pointer is advanced past consumed data
+	 * @param inputLength Number of bytes available, updated with number remaining
+	 * @param output Buffer for decompressed data
+	 * @param outputSize Space available in output buffer
+	 * @retval size_t Number of bytes written to output
+	 *
+	 * Decoding stops when input is exhausted or output is full.
+	 */
+	size_t decode(const uint8_t*& input, size_t& inputLength, uint8_t* output, size_t outputSize);
+
+private:
+	enum class State {
+		tag,
+		literal,
+		index,
+		count,
+		copy,
+	};
+
+	bool getBits(uint8_t count, uint16_t& value);
+
+	std::unique_ptr<uint8_t[]> window;
+	const uint8_t* inputPtr{};
+	size_t inputAvailable{};
+	uint32_t bitBuffer{};
+	uint16_t windowMask{};
+	uint16_t head{};
+	uint16_t backrefIndex{};
+	uint16_t copyCount{};
+	uint8_t bitCount{};
+	uint8_t windowBits{};
+	uint8_t lookaheadBits{};
+	State state{};
+};
+
+/**
+ * @brief Decodes a compressed DFU image as produced by `tools/dfu/dfupack.py`
+ *
+ * The image starts with a header describing the compression parameters, the
+ * size of the decompressed image and its CRC32. The remainder is heatshrink compressed.
+ */
+class CompressedImage : public ImageDecoder
+{
+public:
+	struct Header {
+		static constexpr uint32_t magicValue{0x315a4653}; // "SFZ1"
+
+		uint32_t magic;
+		uint8_t windowBits;
+		uint8_t lookaheadBits;
+		uint16_t reserved;
+		uint32_t imageSize; ///< Size of decompressed image
+		uint32_t crc;		///< CRC32 of decompressed image
+	};
+	static_assert(sizeof(Header) == 16, "Bad Header size");
+
+	void reset();
+
+	int decode(const uint8_t*& input, size_t& inputLength, uint8_t* output, size_t outputSize) override;
+
+	/**
+	 * @brief Get size of decompressed image, as declared in header
+	 */
+	uint32_t getImageSize() const
+	{
+		return (headerLength == sizeof(header)) ? header.imageSize : 0;
+	}
+
+	uint32_t getOutputSize() const override
+	{
+		return outputSize;
+	}
+
+	bool isComplete() const override
+	{
+		return headerLength == sizeof(header) && outputSize == header.imageSize;
+	}
+
+	bool verify() const override;
+
+private:
+	Header header{};
+	HeatshrinkDecoder decoder;
+	Crc32 crc;
+	uint32_t outputSize{};
+	uint8_t headerLength{};
+};
+
+} // namespace USB::DFU
@@ -0,0 +1,58 @@
+/****
+ * DFU/Crc32.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace USB::DFU
+{
+/**
+ * @brief Standard CRC32 (as used by zlib, python binascii.crc32, etc.)
+ *
+ * Uses a 16-entry table to keep flash usage small.
+ */
+class Crc32
+{
+public:
+	void update(const void* data, size_t length)
+	{
+		static constexpr uint32_t table[16]{
+			0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+			0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+		};
+		auto ptr = static_cast<const uint8_t*>(data);
+		while(length--) {
+			crc ^= *ptr++;
+			crc = (crc >> 4) ^ table[crc & 0x0f];
+			crc = (crc >> 4) ^ table[crc & 0x0f];
+		}
+	}
+
+	uint32_t getValue() const
+	{
+		return ~crc;
+	}
+
+private:
+	uint32_t crc{0xffffffff};
+};
+
+} // namespace USB::DFU
@@ -0,0 +1,192 @@
+/****
+ * DFU/DeltaImage.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if defined(ENABLE_USB_CLASSES) && CFG_TUD_DFU
+
+#include "DeltaImage.h"
+#include <debug_progmem.h>
+
+namespace USB::DFU
+{
+/*
+ * Obtain more record data, decompressing if required
+ */
+bool DeltaImage::fillPatch(const uint8_t*& input, size_t& inputLength)
+{
+	if(patchPos < patchLength) {
+		return true;
+	}
+
+	if(header.windowBits == 0) {
+		auto n = std::min(inputLength, sizeof(patchBuffer));
+		memcpy(patchBuffer, input, n);
+		input += n;
+		inputLength -= n;
+		patchLength = n;
+	} else {
+		patchLength = decoder.decode(input, inputLength, patchBuffer, sizeof(patchBuffer));
+	}
+	patchPos = 0;
+	return patchLength != 0;
+}
+
+/*
+ * Varints may be split across calls so accumulate one byte at a time
+ */
+bool DeltaImage::readVarint()
+{
+	while(patchPos < patchLength) {
+		auto c = patchBuffer[patchPos++];
+		varint |= uint32_t(c & 0x7f) << varintShift;
+		varintShift += 7;
+		if((c & 0x80) == 0) {
+			varintShift = 0;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Ensure sourceBuffer contains data at sourcePos
+ */
+bool DeltaImage::readSource(uint32_t& available)
+{
+	if(sourcePos < sourceOffset || sourcePos >= sourceOffset + sourceLength) {
+		if(sourcePos >= source.size()) {
+			debug_e("[DFU] Patch reads past end of source");
+			return false;
+		}
+		sourceOffset = sourcePos;
+		sourceLength = std::min(storage_size_t(sizeof(sourceBuffer)), source.size() - sourcePos);
+		if(!source.read(sourceOffset, sourceBuffer, sourceLength)) {
+			debug_e("[DFU] Source read failed at 0x%08x", sourceOffset);
+			sourceLength = 0;
+			return false;
+		}
+	}
+	available = sourceOffset + sourceLength - sourcePos;
+	return true;
+}
+
+int DeltaImage::decode(const uint8_t*& input, size_t& inputLength, uint8_t* output, size_t outputSize)
+{
+	if(headerLength < sizeof(header)) {
+		auto n = std::min(inputLength, sizeof(header) - headerLength);
+		memcpy(reinterpret_cast<uint8_t*>(&header) + headerLength, input, n);
+		headerLength += n;
+		input += n;
+		inputLength -= n;
+		if(headerLength < sizeof(header)) {
+			return 0;
+		}
+		if(header.magic != Header::magicValue || !source ||
+		   (header.windowBits != 0 && !decoder.begin(header.windowBits, header.lookaheadBits))) {
+			debug_e("[DFU] Bad delta image header");
+			return -1;
+		}
+		debug_d("[DFU] Delta image, size %u, w%u l%u", header.imageSize, header.windowBits, header.lookaheadBits);
+	}
+
+	outputSize = std::min(outputSize, size_t(header.imageSize - this->outputSize));
+	size_t outputLength{0};
+	while(outputLength < outputSize && fillPatch(input, inputLength)) {
+		switch(state) {
+		case State::diffLength:
+		case State::extraLength:
+			if(!readVarint()) {
+				break;
+			}
+			remaining = varint;
+			varint = 0;
+			state = (state == State::diffLength) ? State::diff : State::extra;
+			break;
+
+		case State::diff: {
+			if(remaining == 0) {
+				state = State::extraLength;
+				break;
+			}
+			uint32_t available;
+			if(!readSource(available)) {
+				return -1;
+			}
+			size_t n = std::min({size_t(remaining), size_t(available), size_t(patchLength - patchPos),
+								 outputSize - outputLength});
+			auto src = &sourceBuffer[sourcePos - sourceOffset];
+			for(unsigned i = 0; i < n; ++i) {
+				output[outputLength + i] = src[i] + patchBuffer[patchPos + i];
+			}
+			outputLength += n;
+			patchPos += n;
+			sourcePos += n;
+			remaining -= n;
+			break;
+		}
+
+		case State::extra: {
+			if(remaining == 0) {
+				state = State::adjust;
+				break;
+			}
+			size_t n = std::min({size_t(remaining), size_t(patchLength - patchPos), outputSize - outputLength});
+			memcpy(&output[outputLength], &patchBuffer[patchPos], n);
+			outputLength += n;
+			patchPos += n;
+			remaining -= n;
+			break;
+		}
+
+		case State::adjust:
+			if(!readVarint()) {
+				break;
+			}
+			// Zig-zag encoding
+			sourcePos += (varint & 1) ? -int32_t(varint >> 1) - 1 : int32_t(varint >> 1);
+			varint = 0;
+			state = State::diffLength;
+			break;
+		}
+	}
+
+	crc.update(output, outputLength);
+	this->outputSize += outputLength;
+	return outputLength;
+}
+
+bool DeltaImage::verify() const
+{
+	if(headerLength < sizeof(header) || outputSize != header.imageSize) {
+		debug_e("[DFU] Image incomplete: %u of %u bytes", outputSize, header.imageSize);
+		return false;
+	}
+
+	if(crc.getValue() != header.crc) {
+		debug_e("[DFU] Image CRC mismatch, is source image correct?");
+		return false;
+	}
+
+	return true;
+}
+
+} // namespace USB::DFU
+
+#endif
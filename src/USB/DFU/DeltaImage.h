@@ -0,0 +1,107 @@
+/****
+ * DFU/DeltaImage.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "CompressedImage.h"
+#include <Storage/Partition.h>
+
+namespace USB::DFU
+{
+/**
+ * @brief Applies a binary patch, as produced by `tools/dfu/dfupack.py --source`
+ *
+ * The patch consists of a header followed by a sequence of bsdiff-style records:
+ *
+ * - diff length, followed by that many bytes to be added to the source image
+ * - extra length, followed by that many bytes to be copied as-is
+ * - signed adjustment to the source position
+ *
+ * Lengths are encoded as LEB128 varints, the adjustment is zig-zag encoded.
+ * The record stream is normally heatshrink compressed.
+ *
+ * Output is produced sequentially so may be written directly to a partition.
+ * Source data is read from a different partition, usually the running one, in small chunks.
+ */
+class DeltaImage : public ImageDecoder
+{
+public:
+	struct Header {
+		static constexpr uint32_t magicValue{0x31444653}; // "SFD1"
+
+		uint32_t magic;
+		uint8_t windowBits;	///< 0 if record stream is uncompressed
+		uint8_t lookaheadBits;
+		uint16_t reserved;
+		uint32_t imageSize; ///< Size of patched image
+		uint32_t crc;		///< CRC32 of patched image
+	};
+	static_assert(sizeof(Header) == 16, "Bad Header size");
+
+	DeltaImage(Storage::Partition source) : source(source)
+	{
+	}
+
+	int decode(const uint8_t*& input, size_t& inputLength, uint8_t* output, size_t outputSize) override;
+
+	uint32_t getOutputSize() const override
+	{
+		return outputSize;
+	}
+
+	bool isComplete() const override
+	{
+		return headerLength == sizeof(header) && outputSize == header.imageSize;
+	}
+
+	bool verify() const override;
+
+private:
+	enum class State {
+		diffLength,
+		diff,
+		extraLength,
+		extra,
+		adjust,
+	};
+
+	bool fillPatch(const uint8_t*& input, size_t& inputLength);
+	bool readVarint();
+	bool readSource(uint32_t& available);
+
+	Storage::Partition source;
+	Header header{};
+	HeatshrinkDecoder decoder;
+	Crc32 crc;
+	uint8_t patchBuffer[128];
+	uint8_t sourceBuffer[128];
+	uint32_t sourceOffset{};   ///< Offset of data in sourceBuffer
+	uint32_t sourceLength{};   ///< Bytes in sourceBuffer
+	uint32_t sourcePos{};	  ///< Current position in source image
+	uint32_t remaining{};	  ///< Bytes remaining in current diff or extra block
+	uint32_t varint{};
+	uint32_t outputSize{};
+	uint8_t varintShift{};
+	uint8_t patchPos{};
+	uint8_t patchLength{};
+	uint8_t headerLength{};
+	State state{};
+};
+
+} // namespace USB::DFU
@@ -22,10 +22,67 @@
 #if defined(ENABLE_USB_CLASSES) && CFG_TUD_DFU
 
 #include <FlashString/Vector.hpp>
+#include <debug_progmem.h>
+#include <memory>
 
 namespace
 {
 USB::DFU::Callbacks* callbacks;
+std::unique_ptr<USB::DFU::Verifier> verifier;
+USB::DFU::Verifier::Result verifyResult;
+USB::DFU::Device::Verify verifyMode;
+USB::DFU::Verifier::Algorithm verifyAlgorithm;
+// Held-back data is being written before manifestation
+bool flushingTail;
+uint8_t flushAlt;
+uint16_t tailOffset;
+
+/*
+ * Position within a transfer. The 16-bit block number wraps so can't be used to calculate offsets.
+ */
+struct Position {
+	uint32_t offset;
+	uint16_t nextBlock;
+	bool active;
+
+	// Returns true if block starts a new transfer
+	bool update(uint16_t block)
+	{
+		bool start = !active || block != nextBlock;
+		if(start) {
+			offset = uint32_t(block) * CFG_TUD_DFU_XFER_BUFSIZE;
+			active = true;
+		}
+		nextBlock = block + 1;
+		return start;
+	}
+};
+
+Position downloadPos;
+Position uploadPos;
+
+/*
+ * Pass on next part of held-back data. Parts don't cross block boundaries.
+ * Returns false when there's nothing left.
+ */
+bool flushTail(uint8_t alt)
+{
+	using namespace USB::DFU;
+
+	const uint8_t* tail;
+	auto tailLength = verifier->getTail(tail);
+	if(tailOffset >= tailLength) {
+		return false;
+	}
+	auto offset = tailOffset;
+	auto length = std::min(tailLength - offset, Verifier::blockSize - offset % Verifier::blockSize);
+	tailOffset += length;
+	flushingTail = true;
+	flushAlt = alt;
+	callbacks->download(Callbacks::Alternate(alt), verifier->getLength() + offset, &tail[offset], length);
+	return true;
+}
+
 } // namespace
 
 namespace USB::DFU
@@ -39,6 +96,36 @@ void Device::begin(Callbacks& cb)
 	callbacks = &cb;
 }
 
+void Device::setVerify(Verify mode, Verifier::Algorithm algorithm)
+{
+	verifyMode = mode;
+	verifyAlgorithm = algorithm;
+	if(mode == Verify::none) {
+		verifier.reset();
+	} else if(!verifier) {
+		verifier = std::make_unique<Verifier>();
+	}
+}
+
+Verifier::Result Device::getVerifyResult()
+{
+	return verifyResult;
+}
+
+void Device::complete(dfu_status_t status)
+{
+	if(flushingTail) {
+		flushingTail = false;
+		if(status == DFU_STATUS_OK && callbacks) {
+			if(!flushTail(flushAlt)) {
+				callbacks->manifest(Callbacks::Alternate(flushAlt));
+			}
+			return;
+		}
+	}
+	tud_dfu_finish_flashing(status);
+}
+
 } // namespace USB::DFU
 
 using namespace USB::DFU;
@@ -51,26 +138,86 @@ uint32_t tud_dfu_get_timeout_cb(uint8_t alt, uint8_t state)
 
 void tud_dfu_download_cb(uint8_t alt, uint16_t block_num, uint8_t const* data, uint16_t length)
 {
+	bool start = downloadPos.update(block_num);
+
+	if(verifyMode == Device::Verify::none) {
+		auto offset = downloadPos.offset;
+		downloadPos.offset += length;
+		if(callbacks) {
+			callbacks->download(Alternate(alt), offset, data, length);
+		}
+		return;
+	}
+
+	if(start) {
+		verifier->begin(verifyAlgorithm);
+		flushingTail = false;
+	}
+	auto offset = verifier->getLength();
+	const uint8_t* output;
+	length = verifier->update(data, length, output);
+	if(length == 0) {
+		// Everything held back
+		tud_dfu_finish_flashing(DFU_STATUS_OK);
+		return;
+	}
+
 	if(callbacks) {
-		callbacks->download(Alternate(alt), uint32_t(block_num) * CFG_TUD_DFU_XFER_BUFSIZE, data, length);
+		callbacks->download(Alternate(alt), offset, output, length);
 	}
 }
 
 void tud_dfu_manifest_cb(uint8_t alt)
 {
-	if(callbacks) {
+	downloadPos.active = false;
+
+	if(verifyMode == Device::Verify::none) {
+		verifyResult = Verifier::Result::noTrailer;
+		if(callbacks) {
+			callbacks->manifest(Alternate(alt));
+		}
+		return;
+	}
+
+	verifyResult = verifier->end();
+	if(verifyResult == Verifier::Result::noTrailer && verifyMode == Device::Verify::required) {
+		debug_e("[DFU] Image has no verification trailer");
+		verifyResult = Verifier::Result::failed;
+	}
+	if(verifyResult == Verifier::Result::failed) {
+		if(callbacks) {
+			callbacks->abort(Alternate(alt));
+		}
+		tud_dfu_finish_flashing(DFU_STATUS_ERR_VERIFY);
+		return;
+	}
+
+	if(callbacks == nullptr) {
+		return;
+	}
+
+	// Held-back image data is written first, then manifest
+	tailOffset = 0;
+	if(!flushTail(alt)) {
 		callbacks->manifest(Alternate(alt));
 	}
 }
 
 uint16_t tud_dfu_upload_cb(uint8_t alt, uint16_t block_num, uint8_t* data, uint16_t length)
 {
-	return callbacks ? callbacks->upload(Alternate(alt), uint32_t(block_num) * CFG_TUD_DFU_XFER_BUFSIZE, data, length)
-					 : 0;
+	uploadPos.update(block_num);
+	uint16_t res = callbacks ? callbacks->upload(Alternate(alt), uploadPos.offset, data, length) : 0;
+	uploadPos.offset += res;
+	// Short block ends the upload
+	uploadPos.active = (res == length);
+	return res;
 }
 
 void tud_dfu_abort_cb(uint8_t alt)
 {
+	downloadPos.active = false;
+	uploadPos.active = false;
+	flushingTail = false;
 	if(callbacks) {
 		callbacks->abort(Alternate(alt));
 	}
@@ -20,6 +20,7 @@
 #pragma once
 
 #include "../DeviceInterface.h"
+#include "Verifier.h"
 
 namespace USB::DFU
 {
@@ -79,15 +80,42 @@ public:
 
 	static void begin(Callbacks& callbacks);
 
+	/**
+	 * @brief Handling of verification trailers
+	 */
+	enum class Verify {
+		none,	 ///< Data is passed straight through without hashing (default)
+		optional, ///< Trailer is checked if present
+		required, ///< Downloads without a trailer are rejected
+	};
+
+	/**
+	 * @brief Set how downloads are verified
+	 * @param mode
+	 * @param algorithm Digest algorithm used by images, see `tools/dfu/dfupack.py --digest`
+	 *
+	 * Downloads are hashed as they arrive. If a trailer is present it is checked before `Callbacks::manifest()`
+	 * is invoked, and on mismatch the download is aborted with DFU_STATUS_ERR_VERIFY.
+	 * The trailer itself is not passed to `Callbacks::download()`.
+	 *
+	 * Data is held back by one block so `Callbacks::download()` still receives CFG_TUD_DFU_XFER_BUFSIZE blocks
+	 * at the usual offsets, with any remainder passed on before manifestation.
+	 */
+	static void setVerify(Verify mode, Verifier::Algorithm algorithm = Verifier::Algorithm::sha256);
+
+	/**
+	 * @brief Get result of checking the last download
+	 *
+	 * Applications may call this from `Callbacks::manifest()`.
+	 */
+	static Verifier::Result getVerifyResult();
+
 	/**
 	 * @brief Applications call this method from download and manifest callbacks
 	 *
 	 * This mechanism supports use of asynchronous writes.
 	 */
-	static void complete(dfu_status_t status)
-	{
-		tud_dfu_finish_flashing(status);
-	}
+	static void complete(dfu_status_t status);
 };
 
 } // namespace USB::DFU
@@ -0,0 +1,556 @@
+/****
+ * DFU/HostDevice.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if defined(ENABLE_USB_CLASSES) && CFG_TUH_ENABLED && CFG_TUH_DFU
+
+#include <host/usbh_pvt.h>
+#include <class/dfu/dfu_host.h>
+#include <debug_progmem.h>
+
+namespace USB::DFU
+{
+namespace
+{
+constexpr uint8_t DFU_SUBCLASS{0x01};
+constexpr uint8_t maxResetAttempts{2};
+constexpr uint16_t defaultTransferSize{64};
+
+// Interfaces are claimed in open() but not reported to application until set_config()
+struct Interface {
+	uint8_t dev_addr;
+	uint8_t itf_num;
+	HostDevice::Config cfg;
+	HostDevice* dev;
+};
+
+Interface interfaces[CFG_TUH_DFU];
+MountCallback mountCallback;
+UnmountCallback unmountCallback;
+
+Interface* findInterface(uint8_t dev_addr, uint8_t itf_num)
+{
+	for(auto& itf : interfaces) {
+		if(itf.dev_addr == dev_addr && itf.itf_num == itf_num) {
+			return &itf;
+		}
+	}
+	return nullptr;
+}
+
+} // namespace
+
+void onMount(MountCallback callback)
+{
+	mountCallback = callback;
+}
+
+void onUnmount(UnmountCallback callback)
+{
+	unmountCallback = callback;
+}
+
+bool HostDevice::begin(const Instance& inst, const Config& cfg)
+{
+	if(isBusy()) {
+		return false;
+	}
+
+	HostInterface::begin(inst);
+	config = cfg;
+	transferSize = tu_le16toh(cfg.functional.wTransferSize);
+	if(transferSize == 0) {
+		transferSize = defaultTransferSize;
+	}
+
+	debug_i("[DFU] Device %u, %s mode, %u alternates, transfer size %u", inst.dev_addr,
+			isRuntime() ? "runtime" : "DFU", cfg.altCount, transferSize);
+	return true;
+}
+
+void HostDevice::end()
+{
+	timer.stop();
+	callback = nullptr;
+	stream.reset();
+	buffer.reset();
+	partition = {};
+	phase = Phase::idle;
+	inFlight = false;
+	HostInterface::end();
+}
+
+bool HostDevice::canDownload() const
+{
+	if(inst.dev_addr == 255 || isBusy()) {
+		return false;
+	}
+	if(isRuntime() || !config.functional.bmAttributes.bitCanDnload) {
+		debug_e("[DFU] Device %u doesn't support download", inst.dev_addr);
+		return false;
+	}
+	return true;
+}
+
+bool HostDevice::download(IDataSourceStream* source, Callback callback, uint8_t alt)
+{
+	std::unique_ptr<IDataSourceStream> src(source);
+	if(!src || !canDownload()) {
+		return false;
+	}
+
+	stream = std::move(src);
+	partition = {};
+	return start(callback, alt);
+}
+
+bool HostDevice::download(Storage::Partition partition, uint32_t size, Callback callback, uint8_t alt)
+{
+	if(!partition || size > partition.size() || !canDownload()) {
+		return false;
+	}
+
+	stream.reset();
+	this->partition = partition;
+	sourceSize = size;
+	sourceOffset = 0;
+	return start(callback, alt);
+}
+
+bool HostDevice::detach(Callback callback)
+{
+	if(inst.dev_addr == 255 || isBusy() || !isRuntime()) {
+		return false;
+	}
+
+	this->callback = callback;
+	phase = Phase::detaching;
+	send(Request::detach);
+	return true;
+}
+
+void HostDevice::abort()
+{
+	if(!isBusy() || phase == Phase::failing) {
+		return;
+	}
+
+	// Return device to idle state but don't report
+	callback = nullptr;
+	failStatus = DFU_STATUS_OK;
+	phase = Phase::failing;
+	if(!inFlight) {
+		timer.stop();
+		send(Request::abort);
+	}
+}
+
+bool HostDevice::start(Callback callback, uint8_t alt)
+{
+	buffer.reset(new uint8_t[transferSize]);
+	this->callback = callback;
+	alternate = alt;
+	position = 0;
+	blockNum = 0;
+	blockReady = false;
+	resetCount = 0;
+	phase = Phase::starting;
+	send((alt == 0) ? Request::getStatus : Request::setInterface);
+	return true;
+}
+
+void HostDevice::send(Request request)
+{
+	current = request;
+	if(submit(request)) {
+		inFlight = true;
+		return;
+	}
+
+	// Interface is no longer mounted
+	debug_e("[DFU] Device %u request failed", inst.dev_addr);
+	finish(DFU_STATUS_ERR_TARGET);
+}
+
+void HostDevice::sendAfter(Request request, uint32_t delayMs)
+{
+	current = request;
+	timer.initializeMs(
+		delayMs,
+		[](void* param) {
+			auto self = static_cast<HostDevice*>(param);
+			self->send(self->current);
+		},
+		this);
+	timer.startOnce();
+}
+
+bool HostDevice::submit(Request request)
+{
+	uint8_t bRequest{};
+	uint16_t value{0};
+	void* data{nullptr};
+	uint16_t length{0};
+	switch(request) {
+	case Request::getStatus:
+		bRequest = DFU_REQUEST_GETSTATUS;
+		data = &response;
+		length = sizeof(response);
+		break;
+	case Request::clearStatus:
+		bRequest = DFU_REQUEST_CLRSTATUS;
+		break;
+	case Request::abort:
+		bRequest = DFU_REQUEST_ABORT;
+		break;
+	case Request::download:
+		bRequest = DFU_REQUEST_DNLOAD;
+		value = blockNum;
+		data = buffer.get();
+		length = blockLength;
+		break;
+	case Request::detach:
+		bRequest = DFU_REQUEST_DETACH;
+		value = tu_le16toh(config.functional.wDetachTimeOut);
+		break;
+	case Request::setInterface:
+		bRequest = TUSB_REQ_SET_INTERFACE;
+		value = alternate;
+		break;
+	}
+
+	tusb_control_request_t setup{};
+	setup.bmRequestType_bit.recipient = TUSB_REQ_RCPT_INTERFACE;
+	setup.bmRequestType_bit.type = (request == Request::setInterface) ? TUSB_REQ_TYPE_STANDARD : TUSB_REQ_TYPE_CLASS;
+	setup.bmRequestType_bit.direction = (request == Request::getStatus) ? TUSB_DIR_IN : TUSB_DIR_OUT;
+	setup.bRequest = bRequest;
+	setup.wValue = tu_htole16(value);
+	setup.wIndex = tu_htole16(inst.idx);
+	setup.wLength = tu_htole16(length);
+
+	return controlTransfer(setup, data,
+						   [this](const tuh_xfer_t& xfer) { requestComplete(xfer.result == XFER_RESULT_SUCCESS); });
+}
+
+void HostDevice::requestComplete(bool success)
+{
+	inFlight = false;
+
+	if(phase == Phase::idle) {
+		return;
+	}
+
+	if(phase == Phase::failing && current != Request::clearStatus && current != Request::abort) {
+		// abort() was called whilst this request was in progress
+		send(Request::abort);
+		return;
+	}
+
+	switch(current) {
+	case Request::setInterface:
+		if(!success) {
+			debug_e("[DFU] Failed to select alternate %u", alternate);
+			finish(DFU_STATUS_ERR_TARGET);
+			return;
+		}
+		send(Request::getStatus);
+		return;
+
+	case Request::getStatus:
+		if(success) {
+			statusReceived();
+		} else if(phase == Phase::manifesting && !config.functional.bmAttributes.bitManifestationTolerant) {
+			// Device may stop responding once manifestation is underway
+			finish(DFU_STATUS_OK);
+		} else {
+			finish(DFU_STATUS_ERR_STALLEDPKT);
+		}
+		return;
+
+	case Request::clearStatus:
+	case Request::abort:
+		if(phase == Phase::failing) {
+			finish(failStatus);
+		} else if(success) {
+			send(Request::getStatus);
+		} else {
+			finish(DFU_STATUS_ERR_STALLEDPKT);
+		}
+		return;
+
+	case Request::download:
+		if(!success) {
+			// Device stalls request on error, status indicates why
+			failStatus = DFU_STATUS_ERR_STALLEDPKT;
+			send(Request::getStatus);
+			return;
+		}
+		position += blockLength;
+		++blockNum;
+		if(blockLength == 0) {
+			phase = Phase::manifesting;
+		}
+		blockReady = false;
+		send(Request::getStatus);
+		// Get next block ready whilst device is busy
+		if(phase == Phase::downloading) {
+			readBlock();
+		}
+		return;
+
+	case Request::detach:
+		// Device may disconnect without completing request
+		finish((success || config.functional.bmAttributes.bitWillDetach) ? DFU_STATUS_OK : DFU_STATUS_ERR_STALLEDPKT);
+		return;
+	}
+}
+
+void HostDevice::statusReceived()
+{
+	auto status = dfu_status_t(response.bStatus);
+	deviceState = dfu_state_t(response.bState);
+	uint32_t pollTimeout =
+		response.bwPollTimeout[0] | (response.bwPollTimeout[1] << 8) | (response.bwPollTimeout[2] << 16);
+
+	if(phase == Phase::starting) {
+		switch(deviceState) {
+		case DFU_IDLE:
+			phase = Phase::downloading;
+			sendBlock();
+			return;
+		case DFU_ERROR:
+			if(resetCount++ < maxResetAttempts) {
+				send(Request::clearStatus);
+				return;
+			}
+			break;
+		default:
+			if(resetCount++ < maxResetAttempts) {
+				send(Request::abort);
+				return;
+			}
+		}
+		debug_e("[DFU] Device %u not ready, state %u", inst.dev_addr, deviceState);
+		finish(DFU_STATUS_ERR_TARGET);
+		return;
+	}
+
+	if(status != DFU_STATUS_OK) {
+		debug_e("[DFU] Device %u reports status %u, state %u", inst.dev_addr, status, deviceState);
+		fail(status);
+		return;
+	}
+
+	if(failStatus != DFU_STATUS_OK) {
+		fail(failStatus);
+		return;
+	}
+
+	switch(deviceState) {
+	case DFU_DNLOAD_SYNC:
+	case DFU_DNBUSY:
+	case DFU_MANIFEST_SYNC:
+	case DFU_MANIFEST:
+		if(pollTimeout == 0) {
+			send(Request::getStatus);
+		} else {
+			sendAfter(Request::getStatus, pollTimeout);
+		}
+		return;
+
+	case DFU_DNLOAD_IDLE:
+		if(phase == Phase::downloading) {
+			sendBlock();
+			return;
+		}
+		break;
+
+	case DFU_IDLE:
+		if(phase == Phase::manifesting) {
+			finish(DFU_STATUS_OK);
+			return;
+		}
+		break;
+
+	case DFU_MANIFEST_WAIT_RESET:
+		if(phase == Phase::manifesting) {
+			debug_i("[DFU] Device %u requires reset to complete update", inst.dev_addr);
+			finish(DFU_STATUS_OK);
+			return;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	debug_e("[DFU] Device %u in unexpected state %u", inst.dev_addr, deviceState);
+	fail(DFU_STATUS_ERR_UNKNOWN);
+}
+
+bool HostDevice::readBlock()
+{
+	size_t length{0};
+	auto buf = buffer.get();
+	if(stream) {
+		while(length < transferSize && !stream->isFinished()) {
+			auto n = stream->readBytes(reinterpret_cast<char*>(&buf[length]), transferSize - length);
+			if(n == 0) {
+				break;
+			}
+			length += n;
+		}
+	} else {
+		length = std::min(uint32_t(transferSize), sourceSize - sourceOffset);
+		if(length != 0 && !partition.read(sourceOffset, buf, length)) {
+			debug_e("[DFU] Partition read failed at 0x%08x", sourceOffset);
+			return false;
+		}
+		sourceOffset += length;
+	}
+
+	blockLength = length;
+	blockReady = true;
+	return true;
+}
+
+void HostDevice::sendBlock()
+{
+	if(!blockReady && !readBlock()) {
+		fail(DFU_STATUS_ERR_FILE);
+		return;
+	}
+	send(Request::download);
+}
+
+void HostDevice::fail(dfu_status_t status)
+{
+	failStatus = status;
+	phase = Phase::failing;
+	send(Request::clearStatus);
+}
+
+void HostDevice::finish(dfu_status_t status)
+{
+	timer.stop();
+	phase = Phase::idle;
+	failStatus = DFU_STATUS_OK;
+	stream.reset();
+	buffer.reset();
+	partition = {};
+
+	if(status == DFU_STATUS_OK) {
+		debug_i("[DFU] Device %u complete, %u bytes", inst.dev_addr, position);
+	} else {
+		debug_e("[DFU] Device %u failed with status %u after %u bytes", inst.dev_addr, status, position);
+	}
+
+	auto cb = callback;
+	callback = nullptr;
+	if(cb) {
+		cb(*this, status);
+	}
+}
+
+} // namespace USB::DFU
+
+using namespace USB::DFU;
+
+void dfuh_init(void)
+{
+	memset(interfaces, 0, sizeof(interfaces));
+}
+
+bool dfuh_open(uint8_t rhport, uint8_t dev_addr, const tusb_desc_interface_t* itf_desc, uint16_t max_len)
+{
+	if(itf_desc->bInterfaceClass != TUSB_CLASS_APPLICATION_SPECIFIC || itf_desc->bInterfaceSubClass != DFU_SUBCLASS) {
+		return false;
+	}
+
+	auto itf = findInterface(0, 0);
+	if(!itf) {
+		debug_e("[DFU] No free instances");
+		return false;
+	}
+
+	HostDevice::Config cfg{};
+	cfg.protocol = itf_desc->bInterfaceProtocol;
+	bool haveFunctional{false};
+	USB::DescriptorList list{reinterpret_cast<const USB::Descriptor*>(itf_desc), max_len};
+	for(auto desc : list) {
+		if(desc->type == TUSB_DESC_INTERFACE) {
+			auto alt = desc->as<tusb_desc_interface_t>();
+			if(alt->bInterfaceNumber == itf_desc->bInterfaceNumber) {
+				++cfg.altCount;
+			}
+		} else if(desc->type == DFU_DESC_FUNCTIONAL && desc->length >= sizeof(cfg.functional)) {
+			memcpy(&cfg.functional, desc, sizeof(cfg.functional));
+			haveFunctional = true;
+		}
+	}
+
+	if(!haveFunctional) {
+		debug_w("[DFU] Interface %u has no functional descriptor", itf_desc->bInterfaceNumber);
+		return false;
+	}
+
+	itf->dev_addr = dev_addr;
+	itf->itf_num = itf_desc->bInterfaceNumber;
+	itf->cfg = cfg;
+	itf->dev = nullptr;
+	return true;
+}
+
+bool dfuh_set_config(uint8_t dev_addr, uint8_t itf_num)
+{
+	auto itf = findInterface(dev_addr, itf_num);
+	if(itf && mountCallback) {
+		tuh_vid_pid_get(dev_addr, &itf->cfg.vid, &itf->cfg.pid);
+		HostDevice::Instance inst{dev_addr, itf_num, "dfu"};
+		itf->dev = mountCallback(inst, itf->cfg);
+	}
+
+	usbh_driver_set_config_complete(dev_addr, itf_num);
+	return true;
+}
+
+bool dfuh_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+	// Control transfers only
+	return false;
+}
+
+void dfuh_close(uint8_t dev_addr)
+{
+	for(auto& itf : interfaces) {
+		if(itf.dev_addr != dev_addr) {
+			continue;
+		}
+		if(itf.dev) {
+			itf.dev->end();
+			if(unmountCallback) {
+				unmountCallback(*itf.dev);
+			}
+		}
+		itf = {};
+	}
+}
+
+#endif
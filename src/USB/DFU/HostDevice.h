@@ -0,0 +1,227 @@
+/****
+ * DFU/HostDevice.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "../HostInterface.h"
+#include <class/dfu/dfu.h>
+#include <Data/Stream/DataSourceStream.h>
+#include <Storage/Partition.h>
+#include <SimpleTimer.h>
+#include <Delegate.h>
+#include <memory>
+
+namespace USB::DFU
+{
+/**
+ * @brief Updates firmware on an attached device with a DFU interface
+ *
+ * Blocks are sent using the largest transfer size the device supports.
+ * The device is polled again as soon as the bwPollTimeout it reports has expired,
+ * and the next block is read from the source whilst the device is busy.
+ *
+ * Requests are issued using `HostInterface::controlTransfer()`, which shares the control pipe
+ * with other drivers. This allows several devices to be updated concurrently.
+ */
+class HostDevice : public HostInterface
+{
+public:
+	/**
+	 * @brief Device configuration received during mount procedure
+	 */
+	struct Config {
+		uint16_t vid;						   ///< Vendor ID
+		uint16_t pid;						   ///< Product ID
+		uint8_t protocol;					   ///< DFU_PROTOCOL_RT (runtime) or DFU_PROTOCOL_DFU (DFU mode)
+		uint8_t altCount;					   ///< Number of alternate settings
+		tusb_desc_dfu_functional_t functional; ///< Capabilities, timeouts and transfer size
+	};
+
+	/**
+	 * @brief Called when a request has completed
+	 * @param dev
+	 * @param status DFU_STATUS_OK on success, otherwise reason for failure
+	 */
+	using Callback = Delegate<void(HostDevice& dev, dfu_status_t status)>;
+
+	/**
+	 * @brief Applications call this from the mount callback
+	 */
+	bool begin(const Instance& inst, const Config& cfg);
+
+	void end() override;
+
+	/**
+	 * @brief Download an image from a stream
+	 * @param source Stream to read, will be deleted on completion
+	 * @param callback Invoked on completion, after manifestation
+	 * @param alt Alternate setting to select before starting
+	 * @retval bool false if device is busy or doesn't support download
+	 */
+	bool download(IDataSourceStream* source, Callback callback, uint8_t alt = 0);
+
+	/**
+	 * @brief Download an image from a partition
+	 * @param partition
+	 * @param size Number of bytes to send from start of partition
+	 * @param callback Invoked on completion, after manifestation
+	 * @param alt Alternate setting to select before starting
+	 * @retval bool false if device is busy or doesn't support download
+	 */
+	bool download(Storage::Partition partition, uint32_t size, Callback callback, uint8_t alt = 0);
+
+	/**
+	 * @brief Request a device in runtime mode switch to DFU mode
+	 *
+	 * If the device doesn't set bitWillDetach then it must be reset to complete the switch.
+	 * On re-enumeration a new mount callback is invoked.
+	 */
+	bool detach(Callback callback);
+
+	/**
+	 * @brief Stop any operation in progress
+	 *
+	 * No callback is invoked.
+	 */
+	void abort();
+
+	const Config& getConfig() const
+	{
+		return config;
+	}
+
+	bool isRuntime() const
+	{
+		return config.protocol == DFU_PROTOCOL_RT;
+	}
+
+	bool isBusy() const
+	{
+		return phase != Phase::idle;
+	}
+
+	uint16_t getTransferSize() const
+	{
+		return transferSize;
+	}
+
+	/**
+	 * @brief Get number of bytes sent so far
+	 */
+	uint32_t getPosition() const
+	{
+		return position;
+	}
+
+	/**
+	 * @brief Get device state from last status request
+	 */
+	dfu_state_t getDeviceState() const
+	{
+		return deviceState;
+	}
+
+private:
+	enum class Phase {
+		idle,
+		starting,
+		downloading,
+		manifesting,
+		failing,
+		detaching,
+	};
+
+	enum class Request {
+		setInterface,
+		getStatus,
+		clearStatus,
+		abort,
+		download,
+		detach,
+	};
+
+	struct TU_ATTR_PACKED StatusResponse {
+		uint8_t bStatus;
+		uint8_t bwPollTimeout[3];
+		uint8_t bState;
+		uint8_t iString;
+	};
+
+	bool canDownload() const;
+	bool start(Callback callback, uint8_t alt);
+	void send(Request request);
+	void sendAfter(Request request, uint32_t delayMs);
+	bool submit(Request request);
+	void requestComplete(bool success);
+	void statusReceived();
+	bool readBlock();
+	void sendBlock();
+	void fail(dfu_status_t status);
+	void finish(dfu_status_t status);
+
+	Config config{};
+	Callback callback;
+	std::unique_ptr<IDataSourceStream> stream;
+	Storage::Partition partition;
+	std::unique_ptr<uint8_t[]> buffer;
+	SimpleTimer timer;
+	StatusResponse response{};
+	uint32_t sourceSize{};	///< Partition only
+	uint32_t sourceOffset{}; ///< Partition only
+	uint32_t position{};
+	uint16_t transferSize{};
+	uint16_t blockNum{};
+	uint16_t blockLength{};
+	Phase phase{};
+	Request current{};
+	dfu_state_t deviceState{};
+	dfu_status_t failStatus{};
+	uint8_t alternate{};
+	uint8_t resetCount{};
+	bool blockReady{};
+	bool inFlight{}; ///< Control request in progress
+};
+
+/**
+ * @brief Application callback to notify connection of a new device
+ * @param inst TinyUSB device instance
+ * @param cfg HostDevice configuration
+ * @retval HostDevice* Application returns pointer to implementation, or nullptr to ignore this device
+ */
+using MountCallback = Delegate<HostDevice*(const HostInterface::Instance& inst, const HostDevice::Config& cfg)>;
+
+/**
+ * @brief Application callback to notify disconnection of a device
+ * @param dev The device which has been disconnected
+ */
+using UnmountCallback = Delegate<void(HostDevice& dev)>;
+
+/**
+ * @brief Application should call this method to receive device connection notifications
+ * @param callback
+ */
+void onMount(MountCallback callback);
+
+/**
+ * @brief Application should call this method to receive device disconnection notifications
+ * @param callback
+ */
+void onUnmount(UnmountCallback callback);
+
+} // namespace USB::DFU
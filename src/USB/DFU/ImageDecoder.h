@@ -0,0 +1,65 @@
+/****
+ * DFU/ImageDecoder.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace USB::DFU
+{
+/**
+ * @brief Interface for decoding encoded images as they are downloaded
+ */
+class ImageDecoder
+{
+public:
+	virtual ~ImageDecoder()
+	{
+	}
+
+	/**
+	 * @brief Decode a chunk of the image
+	 * @param input Received data, pointer is advanced past consumed data
+	 * @param inputLength Number of bytes available, updated with number remaining
+	 * @param output Buffer for decoded data
+	 * @param outputSize Space available in output buffer
+	 * @retval int Number of bytes written to output, -1 if image is invalid
+	 */
+	virtual int decode(const uint8_t*& input, size_t& inputLength, uint8_t* output, size_t outputSize) = 0;
+
+	/**
+	 * @brief Get number of bytes decoded so far
+	 */
+	virtual uint32_t getOutputSize() const = 0;
+
+	/**
+	 * @brief Determine whether all image data has been decoded
+	 *
+	 * Any further input is padding and may be discarded.
+	 */
+	virtual bool isComplete() const = 0;
+
+	/**
+	 * @brief Check entire image was received and matches declared CRC
+	 */
+	virtual bool verify() const = 0;
+};
+
+} // namespace USB::DFU
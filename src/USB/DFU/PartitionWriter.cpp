@@ -0,0 +1,380 @@
+/****
+ * DFU/PartitionWriter.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if defined(ENABLE_USB_CLASSES) && CFG_TUD_DFU
+
+#include "PartitionWriter.h"
+#include <Platform/System.h>
+#include <Platform/Clock.h>
+#include <debug_progmem.h>
+
+namespace
+{
+// Weight new measurements at 1/4
+void updateAverage(uint32_t& average, uint32_t sample)
+{
+	average = (average * 3 + sample) / 4;
+}
+
+} // namespace
+
+namespace USB::DFU
+{
+void PartitionWriter::reset()
+{
+	for(auto& buf : buffers) {
+		buf.full = false;
+	}
+	head = 0;
+	eraseEnd = 0;
+	pendingData = nullptr;
+	manifesting = false;
+	decoder.reset();
+	status = DFU_STATUS_OK;
+}
+
+PartitionWriter::Buffer* PartitionWriter::getFreeBuffer()
+{
+	// Buffers are filled and programmed in order
+	for(unsigned i = 0; i < bufferCount; ++i) {
+		auto& buf = buffers[(head + i) % bufferCount];
+		if(!buf.full) {
+			return &buf;
+		}
+	}
+	return nullptr;
+}
+
+bool PartitionWriter::accept(uint32_t offset, const void* data, uint16_t length)
+{
+	auto buf = getFreeBuffer();
+	if(buf == nullptr) {
+		return false;
+	}
+
+	buf->offset = offset;
+	buf->length = length;
+	buf->position = 0;
+	memcpy(buf->data, data, length);
+	buf->full = true;
+	schedule();
+	return true;
+}
+
+uint32_t PartitionWriter::getTimeout(Alternate alt, dfu_state_t state)
+{
+	if(!getPartition(alt)) {
+		return 0;
+	}
+
+	uint32_t time;
+	if(state == DFU_DNBUSY) {
+		// Block gets accepted immediately if there's room
+		if(getFreeBuffer() != nullptr) {
+			return 0;
+		}
+		time = getPendingTime(true);
+	} else if(state == DFU_MANIFEST) {
+		time = getPendingTime(false);
+	} else {
+		return 0;
+	}
+
+	return std::max(1U, unsigned((time + 999) / 1000));
+}
+
+void PartitionWriter::download(Alternate alt, uint32_t offset, const void* data, uint16_t length)
+{
+	if(offset == 0) {
+		reset();
+		part = getPartition(alt);
+		if(!part) {
+			debug_e("[DFU] No partition for alt %u", alt);
+			status = DFU_STATUS_ERR_TARGET;
+		} else if(formats[alt] == Format::compressed) {
+			decoder.reset(new Decoder{});
+			decoder->image.reset(new CompressedImage);
+		} else if(formats[alt] == Format::delta) {
+			decoder.reset(new Decoder{});
+			decoder->image.reset(new DeltaImage(sources[alt]));
+		}
+	}
+
+	// Decoded image size is checked when written
+	if(status == DFU_STATUS_OK && !decoder && offset + length > part.size()) {
+		debug_e("[DFU] Image too big for partition '%s'", part.name().c_str());
+		status = DFU_STATUS_ERR_ADDRESS;
+	}
+
+	if(status != DFU_STATUS_OK) {
+		Device::complete(status);
+		return;
+	}
+
+	if(accept(offset, data, length)) {
+		Device::complete(DFU_STATUS_OK);
+		return;
+	}
+
+	// Host won't send another block until this one is acknowledged, so data remains valid
+	pendingData = data;
+	pendingOffset = offset;
+	pendingLength = length;
+}
+
+void PartitionWriter::manifest(Alternate)
+{
+	manifesting = true;
+	if(status != DFU_STATUS_OK || !isBusy()) {
+		manifesting = false;
+		Device::complete(verify());
+		return;
+	}
+
+	// Complete when all data has been programmed
+	schedule();
+}
+
+bool PartitionWriter::isBusy() const
+{
+	if(buffers[head].full) {
+		return true;
+	}
+	// Remaining decoded data gets written during manifestation
+	return manifesting && decoder && decoder->length != 0;
+}
+
+dfu_status_t PartitionWriter::verify()
+{
+	if(status == DFU_STATUS_OK && decoder && !decoder->image->verify()) {
+		status = DFU_STATUS_ERR_VERIFY;
+	}
+	return status;
+}
+
+uint16_t PartitionWriter::upload(Alternate alt, uint32_t offset, void* data, uint16_t length)
+{
+	auto part = getPartition(alt);
+	if(!part || offset >= part.size()) {
+		return 0;
+	}
+	length = std::min(storage_size_t(length), part.size() - offset);
+	return part.read(offset, data, length) ? length : 0;
+}
+
+void PartitionWriter::abort(Alternate)
+{
+	reset();
+}
+
+void PartitionWriter::schedule()
+{
+	if(scheduled) {
+		return;
+	}
+	scheduled = System.queueCallback(
+		[](void* param) {
+			auto self = static_cast<PartitionWriter*>(param);
+			self->scheduled = false;
+			self->program();
+		},
+		this);
+}
+
+/*
+ * Perform a single erase, write or decode operation, then return to the task queue
+ * so USB requests continue to be handled.
+ */
+void PartitionWriter::program()
+{
+	if(!isBusy()) {
+		return;
+	}
+
+	if(!programStep()) {
+		for(auto& buf : buffers) {
+			buf.full = false;
+		}
+		if(pendingData) {
+			pendingData = nullptr;
+			Device::complete(status);
+		} else if(manifesting) {
+			manifesting = false;
+			Device::complete(status);
+		}
+		return;
+	}
+
+	if(!buffers[head].full) {
+		head = (head + 1) % bufferCount;
+		if(pendingData && accept(pendingOffset, pendingData, pendingLength)) {
+			pendingData = nullptr;
+			Device::complete(DFU_STATUS_OK);
+		}
+	}
+
+	if(isBusy()) {
+		schedule();
+	} else if(manifesting) {
+		manifesting = false;
+		Device::complete(verify());
+	}
+}
+
+bool PartitionWriter::programStep()
+{
+	auto& buf = buffers[head];
+
+	bool written{false};
+	if(!decoder) {
+		if(!writeStep(buf.offset, buf.data, buf.length, written)) {
+			return false;
+		}
+		if(written) {
+			buf.full = false;
+		}
+		return true;
+	}
+
+	auto& dec = *decoder;
+	bool flush = dec.image->isComplete() || !buf.full;
+	if(dec.length == dec.bufferSize || (flush && dec.length != 0)) {
+		if(!writeStep(dec.offset, dec.output, dec.length, written)) {
+			return false;
+		}
+		if(written) {
+			dec.offset += dec.length;
+			dec.length = 0;
+		}
+		return true;
+	}
+
+	return decodeStep(buf);
+}
+
+bool PartitionWriter::decodeStep(Buffer& buf)
+{
+	auto& dec = *decoder;
+
+	if(dec.image->isComplete()) {
+		// Discard padding
+		buf.full = false;
+		return true;
+	}
+
+	const uint8_t* input = &buf.data[buf.position];
+	size_t inputLength = buf.length - buf.position;
+	auto startTime = micros();
+	int res = dec.image->decode(input, inputLength, &dec.output[dec.length], dec.bufferSize - dec.length);
+	if(res < 0) {
+		status = DFU_STATUS_ERR_FILE;
+		return false;
+	}
+	auto used = buf.length - buf.position - inputLength;
+	if(used != 0) {
+		updateAverage(decodeTime, (micros() - startTime) * 1000 / used);
+	}
+	dec.length += res;
+	dec.consumed += used;
+	buf.position += used;
+	if(inputLength == 0) {
+		buf.full = false;
+	}
+	return true;
+}
+
+/*
+ * Erase next block if required, otherwise write the data
+ */
+bool PartitionWriter::writeStep(uint32_t offset, const void* data, size_t length, bool& written)
+{
+	uint32_t endOffset = offset + length;
+	if(endOffset > part.size()) {
+		debug_e("[DFU] Image too big for partition '%s'", part.name().c_str());
+		status = DFU_STATUS_ERR_ADDRESS;
+		return false;
+	}
+
+	if(eraseEnd < endOffset) {
+		auto blockSize = part.getBlockSize();
+		auto startTime = micros();
+		if(!part.erase_range(eraseEnd, blockSize)) {
+			debug_e("[DFU] Erase failed at 0x%08x", eraseEnd);
+			status = DFU_STATUS_ERR_ERASE;
+			return false;
+		}
+		updateAverage(eraseTime, micros() - startTime);
+		eraseEnd += blockSize;
+		return true;
+	}
+
+	auto startTime = micros();
+	if(!part.write(offset, data, length)) {
+		debug_e("[DFU] Write failed at 0x%08x", offset);
+		status = DFU_STATUS_ERR_WRITE;
+		return false;
+	}
+	updateAverage(writeTime, (micros() - startTime) * 1000 / length);
+	written = true;
+	return true;
+}
+
+/*
+ * Estimate time (in microseconds) to program the current buffer, or all buffers
+ */
+uint32_t PartitionWriter::getPendingTime(bool headOnly) const
+{
+	uint32_t bytes{0};
+	uint32_t endOffset{eraseEnd};
+	for(unsigned i = 0; i < bufferCount; ++i) {
+		auto& buf = buffers[(head + i) % bufferCount];
+		if(!buf.full) {
+			break;
+		}
+		bytes += buf.length - buf.position;
+		endOffset = std::max(endOffset, buf.offset + buf.length);
+		if(headOnly) {
+			break;
+		}
+	}
+
+	uint32_t time{0};
+	if(decoder) {
+		// Estimate amount of output using compression ratio so far (fixed point, 4 fractional bits)
+		auto& dec = *decoder;
+		uint32_t ratio = dec.consumed ? uint64_t(dec.image->getOutputSize()) * 16 / dec.consumed : 32;
+		time += uint64_t(bytes) * decodeTime / 1000;
+		bytes = (uint64_t(bytes) * ratio / 16) + dec.length;
+		endOffset = dec.offset + bytes;
+	}
+
+	uint32_t eraseCount{0};
+	if(part && endOffset > eraseEnd) {
+		auto blockSize = part.getBlockSize();
+		eraseCount = (endOffset - eraseEnd + blockSize - 1) / blockSize;
+	}
+
+	return time + eraseCount * eraseTime + uint64_t(bytes) * writeTime / 1000;
+}
+
+} // namespace USB::DFU
+
+#endif
@@ -0,0 +1,166 @@
+/****
+ * DFU/PartitionWriter.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "Device.h"
+#include "CompressedImage.h"
+#include "DeltaImage.h"
+#include <Storage/Partition.h>
+
+namespace USB::DFU
+{
+/**
+ * @brief Callbacks implementation which writes downloaded images to partitions
+ *
+ * Each alternate is mapped to a partition using `setPartition()`.
+ *
+ * Received blocks are copied into one of two buffers and acknowledged immediately,
+ * so the host sends the next block whilst the previous one is being programmed.
+ * Erase and write operations are run from the task queue so USB continues to be serviced.
+ *
+ * Erase and write times are measured and used to report an accurate bwPollTimeout,
+ * so the host doesn't wait any longer than necessary when both buffers are in use.
+ *
+ * An alternate may instead accept compressed images or patches, created using `tools/dfu/dfupack.py`.
+ * These are decoded as they arrive, so transfer time depends on the encoded size.
+ * The image CRC is checked during manifestation.
+ *
+ * Upload reads directly from the partition.
+ */
+class PartitionWriter : public Callbacks
+{
+public:
+	static constexpr size_t bufferCount{2};
+
+	enum class Format {
+		raw,		///< Image is written as-is
+		compressed, ///< Image is decompressed, see CompressedImage
+		delta,		///< Image is a patch against the source partition, see DeltaImage
+	};
+
+	/**
+	 * @brief Assign a partition to an alternate
+	 * @param alt
+	 * @param part Partition to read/write, pass invalid partition to disable
+	 * @param format Format of downloaded images
+	 * @param source For delta format, partition containing image to be patched.
+	 * Must not be the same as `part`.
+	 */
+	void setPartition(Alternate alt, Storage::Partition part, Format format = Format::raw,
+					  Storage::Partition source = {})
+	{
+		if(alt < DFU_ALTERNATE_COUNT) {
+			partitions[alt] = part;
+			sources[alt] = source;
+			formats[alt] = format;
+		}
+	}
+
+	Storage::Partition getPartition(Alternate alt) const
+	{
+		return (alt < DFU_ALTERNATE_COUNT) ? partitions[alt] : Storage::Partition{};
+	}
+
+	/**
+	 * @brief Get measured time to erase one partition block
+	 * @retval uint32_t Time in microseconds
+	 */
+	uint32_t getEraseTime() const
+	{
+		return eraseTime;
+	}
+
+	/**
+	 * @brief Get measured write time
+	 * @retval uint32_t Time in nanoseconds per byte
+	 */
+	uint32_t getWriteTime() const
+	{
+		return writeTime;
+	}
+
+	/* Callbacks */
+
+	uint32_t getTimeout(Alternate alt, dfu_state_t state) override;
+	void download(Alternate alt, uint32_t offset, const void* data, uint16_t length) override;
+	void manifest(Alternate alt) override;
+	uint16_t upload(Alternate alt, uint32_t offset, void* data, uint16_t length) override;
+	void abort(Alternate alt) override;
+
+	/**
+	 * @brief Override to handle detach request, e.g. to restart into new firmware
+	 */
+	void detach() override
+	{
+	}
+
+private:
+	struct Buffer {
+		uint32_t offset;
+		uint16_t length;
+		uint16_t position; ///< Bytes consumed by decoder
+		bool full;
+		uint8_t data[CFG_TUD_DFU_XFER_BUFSIZE];
+	};
+
+	// Allocated for compressed or delta downloads
+	struct Decoder {
+		static constexpr size_t bufferSize{512};
+
+		std::unique_ptr<ImageDecoder> image;
+		uint32_t offset;   ///< Partition offset for output data
+		uint32_t consumed; ///< Total encoded bytes decoded
+		uint16_t length;   ///< Bytes in output buffer
+		uint8_t output[bufferSize];
+	};
+
+	Buffer* getFreeBuffer();
+	bool accept(uint32_t offset, const void* data, uint16_t length);
+	void reset();
+	void schedule();
+	void program();
+	bool programStep();
+	bool decodeStep(Buffer& buf);
+	bool writeStep(uint32_t offset, const void* data, size_t length, bool& written);
+	bool isBusy() const;
+	dfu_status_t verify();
+	uint32_t getPendingTime(bool headOnly) const;
+
+	Storage::Partition partitions[DFU_ALTERNATE_COUNT];
+	Storage::Partition sources[DFU_ALTERNATE_COUNT];
+	Format formats[DFU_ALTERNATE_COUNT]{};
+	Buffer buffers[bufferCount]{};
+	Storage::Partition part;
+	std::unique_ptr<Decoder> decoder;
+	uint32_t eraseEnd{};	   ///< Partition has been erased up to this offset
+	uint32_t eraseTime{50000}; ///< Average erase time per block (us)
+	uint32_t writeTime{3000};  ///< Average write time (ns/byte)
+	uint32_t decodeTime{500};  ///< Average decoding time (ns/input byte)
+	dfu_status_t status{DFU_STATUS_OK};
+	uint8_t head{}; ///< Buffer being programmed
+	// Download waiting for a free buffer
+	const void* pendingData{};
+	uint32_t pendingOffset{};
+	uint16_t pendingLength{};
+	bool scheduled{};
+	bool manifesting{};
+};
+
+} // namespace USB::DFU
@@ -0,0 +1,107 @@
+/****
+ * DFU/Verifier.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if defined(ENABLE_USB_CLASSES) && CFG_TUD_DFU
+
+#include "Verifier.h"
+#include <debug_progmem.h>
+
+namespace USB::DFU
+{
+void Verifier::discardReleased()
+{
+	bufferLength -= released;
+	memmove(buffer, &buffer[released], bufferLength);
+	released = 0;
+}
+
+void Verifier::hash(const void* data, size_t length)
+{
+	if(algorithm == Algorithm::crc32) {
+		crc.update(data, length);
+	} else {
+		sha.update(data, length);
+	}
+}
+
+uint16_t Verifier::update(const void* data, uint16_t length, const uint8_t*& output)
+{
+	// Previous output has been consumed
+	discardReleased();
+
+	length = std::min(length, uint16_t(sizeof(buffer) - bufferLength));
+	memcpy(&buffer[bufferLength], data, length);
+	bufferLength += length;
+
+	// Pass on a complete block once enough follows it to hold the trailer
+	if(bufferLength >= blockSize + sizeof(Trailer)) {
+		released = blockSize;
+		hash(buffer, released);
+		this->length += released;
+	}
+
+	output = buffer;
+	return released;
+}
+
+Verifier::Result Verifier::end()
+{
+	discardReleased();
+	tailLength = bufferLength;
+
+	Trailer trailer;
+	if(bufferLength < sizeof(trailer)) {
+		return Result::noTrailer;
+	}
+	uint16_t imageLength = bufferLength - sizeof(trailer);
+	memcpy(&trailer, &buffer[imageLength], sizeof(trailer));
+	if(trailer.magic != Trailer::magicValue || trailer.length != length + imageLength) {
+		return Result::noTrailer;
+	}
+
+	tailLength = imageLength;
+	if(trailer.algorithm != algorithm) {
+		debug_e("[DFU] Trailer digest algorithm %u, expected %u", unsigned(trailer.algorithm), unsigned(algorithm));
+		return Result::failed;
+	}
+
+	hash(buffer, imageLength);
+	bool match;
+	if(algorithm == Algorithm::crc32) {
+		uint32_t value = crc.getValue();
+		match = memcmp(trailer.digest, &value, sizeof(value)) == 0;
+	} else {
+		auto value = sha.getHash();
+		match = memcmp(trailer.digest, value.data(), value.size()) == 0;
+	}
+
+	if(!match) {
+		debug_e("[DFU] Image digest mismatch");
+		return Result::failed;
+	}
+
+	debug_d("[DFU] Image verified, %u bytes", trailer.length);
+	return Result::ok;
+}
+
+} // namespace USB::DFU
+
+#endif
@@ -0,0 +1,128 @@
+/****
+ * DFU/Verifier.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "Crc32.h"
+#include <Crypto/Sha2.h>
+#include <tusb.h>
+
+namespace USB::DFU
+{
+/**
+ * @brief Checks downloaded data against a trailer, as added by `tools/dfu/dfupack.py --digest`
+ *
+ * Data is hashed as it is passed on so the result is available immediately on completion.
+ * Since the final `sizeof(Trailer)` bytes may be the trailer itself, data is held back and passed on
+ * one CFG_TUD_DFU_XFER_BUFSIZE block at a time. Output offsets therefore match those of an unverified download.
+ */
+class Verifier
+{
+public:
+	enum class Algorithm : uint8_t {
+		crc32 = 1,
+		sha256 = 2,
+	};
+
+	struct Trailer {
+		static constexpr uint32_t magicValue{0x31565344}; // "DSV1"
+
+		uint32_t magic;
+		Algorithm algorithm;
+		uint8_t reserved[3];
+		uint32_t length; ///< Number of bytes preceding trailer
+		uint8_t digest[32];
+	};
+	static_assert(sizeof(Trailer) == 44, "Bad Trailer size");
+
+	enum class Result {
+		noTrailer,
+		ok,
+		failed,
+	};
+
+	static constexpr uint16_t blockSize{CFG_TUD_DFU_XFER_BUFSIZE};
+
+	/**
+	 * @brief Start a new download
+	 * @param algorithm Only this algorithm is used, so a trailer declaring any other fails verification
+	 */
+	void begin(Algorithm algorithm)
+	{
+		this->algorithm = algorithm;
+		crc = Crc32{};
+		sha.reset();
+		length = 0;
+		bufferLength = 0;
+		released = 0;
+		tailLength = 0;
+	}
+
+	/**
+	 * @brief Add downloaded data, which must be sequential
+	 * @param data Block of up to CFG_TUD_DFU_XFER_BUFSIZE bytes
+	 * @param length
+	 * @param output On return, points to a complete block, starting at `getLength()` before the call.
+	 * This remains valid until the next call to `update()` or `end()`.
+	 * @retval uint16_t Number of bytes in output, either 0 or `blockSize`
+	 */
+	uint16_t update(const void* data, uint16_t length, const uint8_t*& output);
+
+	/**
+	 * @brief Check trailer, if present, against received data
+	 */
+	Result end();
+
+	/**
+	 * @brief Get image data not yet passed on
+	 * @param data On return, points to held-back data, starting at `getLength()`
+	 * @retval uint16_t Number of bytes, excluding any trailer. May exceed `blockSize`.
+	 *
+	 * Valid after calling `end()`.
+	 */
+	uint16_t getTail(const uint8_t*& data) const
+	{
+		data = buffer;
+		return tailLength;
+	}
+
+	/**
+	 * @brief Get number of bytes passed on, excluding held-back data
+	 */
+	uint32_t getLength() const
+	{
+		return length;
+	}
+
+private:
+	void discardReleased();
+	void hash(const void* data, size_t length);
+
+	Crc32 crc;
+	Crypto::Sha256 sha;
+	uint32_t length{};
+	uint16_t bufferLength{};
+	uint16_t released{}; ///< Bytes at start of buffer passed on by last update()
+	uint16_t tailLength{};
+	Algorithm algorithm{};
+	// A block may arrive whilst up to one block plus a possible trailer is held
+	uint8_t buffer[2 * blockSize + sizeof(Trailer)];
+};
+
+} // namespace USB::DFU
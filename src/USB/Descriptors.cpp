@@ -18,6 +18,7 @@
  ****/
 
 #include "USB.h"
+#include "BosDescriptor.h"
 #include <Platform/System.h>
 #include <Data/HexString.h>
 
@@ -25,6 +26,7 @@ namespace
 {
 USB::GetDeviceDescriptor deviceDescriptorCallback;
 USB::GetDescriptorString descriptorStringCallback;
+USB::VendorControl vendorControlCallback;
 
 #define DESC_TYPE_MAP(XX)                                                                                              \
 	XX(DEVICE, 0x01)                                                                                                   \
@@ -119,6 +121,42 @@ const uint16_t* tud_descriptor_string_cb(uint8_t index, uint16_t langid)
 	return tud_get_descriptor_string(index);
 }
 
+// Invoked when a control transfer occurs on an interface of this class
+// Driver response accordingly to the request and the transfer stage (setup/data/ack)
+// return false to stall control endpoint (e.g unsupported request)
+bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage, const tusb_control_request_t* request)
+{
+	if(request->bmRequestType_bit.type == TUSB_REQ_TYPE_VENDOR &&
+	   request->bmRequestType_bit.direction == TUSB_DIR_IN) {
+		const uint8_t* desc{nullptr};
+		uint16_t length{0};
+		if(request->bRequest == BOS_VENDOR_REQUEST_WEBUSB && request->wIndex == WEBUSB_REQUEST_GET_URL) {
+			desc = tud_get_webusb_url();
+			if(desc) {
+				length = desc[0];
+			}
+		} else if(request->bRequest == BOS_VENDOR_REQUEST_MICROSOFT && request->wIndex == MS_OS_20_DESCRIPTOR_INDEX) {
+			desc = tud_get_ms_os_20_descriptor();
+			if(desc) {
+				// Total length is in set header
+				length = tu_u16(desc[9], desc[8]);
+			}
+		}
+		if(desc) {
+			if(stage != CONTROL_STAGE_SETUP) {
+				return true;
+			}
+			return tud_control_xfer(rhport, request, const_cast<uint8_t*>(desc), length);
+		}
+	}
+
+	if(vendorControlCallback) {
+		return vendorControlCallback(rhport, stage, *request);
+	}
+
+	return false;
+}
+
 #endif
 
 namespace USB
@@ -133,6 +171,11 @@ void onGetDescriptorSting(GetDescriptorString callback)
 	descriptorStringCallback = callback;
 }
 
+void onVendorControl(VendorControl callback)
+{
+	vendorControlCallback = callback;
+}
+
 size_t Descriptor::printTo(Print& p) const
 {
 	size_t n{0};
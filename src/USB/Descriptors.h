@@ -204,7 +204,18 @@ static_assert(sizeof(StringDescriptor<8>) == 18, "Bad descriptor alignment");
  */
 using GetDescriptorString = Delegate<const Descriptor*(uint8_t index)>;
 
+/**
+ * @brief Application-provided callback to handle vendor control requests
+ * @param rhport
+ * @param stage CONTROL_STAGE_SETUP, CONTROL_STAGE_DATA or CONTROL_STAGE_ACK
+ * @param request
+ * @retval bool Return false to stall unsupported requests
+ * @note Requests for WebUSB and Microsoft OS 2.0 descriptors are answered by the library
+ */
+using VendorControl = Delegate<bool(uint8_t rhport, uint8_t stage, const tusb_control_request_t& request)>;
+
 void onGetDeviceDescriptor(GetDeviceDescriptor callback);
 void onGetDescriptorSting(GetDescriptorString callback);
+void onVendorControl(VendorControl callback);
 
 } // namespace USB
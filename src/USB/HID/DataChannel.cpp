@@ -0,0 +1,247 @@
+/****
+ * HID/DataChannel.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if defined(ENABLE_USB_CLASSES) && CFG_TUD_HID
+
+#include "DataChannel.h"
+
+namespace USB::HID
+{
+bool DataChannel::begin(size_t txBufferSize, size_t maxMessageSize)
+{
+	if(reportSize <= headerSize || txBufferSize <= sizeof(uint16_t)) {
+		return false;
+	}
+
+	end();
+
+	txBuffer.reset(new uint8_t[txBufferSize]);
+	rxBuffer.reset(new uint8_t[maxMessageSize]);
+	if(!txBuffer || !rxBuffer) {
+		end();
+		return false;
+	}
+	txCapacity = txBufferSize;
+	rxCapacity = maxMessageSize;
+
+	device.onOutputReport([this](uint8_t report_id, const uint8_t* data, uint16_t length) {
+		received(report_id, data, length);
+	});
+	return true;
+}
+
+void DataChannel::end()
+{
+	if(!txBuffer) {
+		return;
+	}
+
+	device.onOutputReport(nullptr);
+	device.cancelNotifyReady(this);
+	device.cancelReportComplete(this);
+	inFlight = false;
+	txBuffer.reset();
+	rxBuffer.reset();
+	txCapacity = txHead = txCount = txMessageRemaining = 0;
+	rxCapacity = rxLength = 0;
+	txSeq = txAcked = rxSeq = rxAckSent = 0;
+	rxActive = reportReady = spaceWanted = false;
+}
+
+void DataChannel::writeTx(const void* data, size_t length)
+{
+	auto src = static_cast<const uint8_t*>(data);
+	auto pos = (txHead + txCount) % txCapacity;
+	auto n = std::min(length, txCapacity - pos);
+	memcpy(&txBuffer[pos], src, n);
+	memcpy(&txBuffer[0], src + n, length - n);
+	txCount += length;
+}
+
+void DataChannel::readTx(void* data, size_t length)
+{
+	auto dst = static_cast<uint8_t*>(data);
+	auto n = std::min(length, txCapacity - txHead);
+	memcpy(dst, &txBuffer[txHead], n);
+	memcpy(dst + n, &txBuffer[0], length - n);
+	txHead = (txHead + length) % txCapacity;
+	txCount -= length;
+}
+
+bool DataChannel::send(const void* data, size_t length)
+{
+	if(!txBuffer || length > UINT16_MAX || length > getFreeSpace()) {
+		spaceWanted = true;
+		return false;
+	}
+
+	uint16_t header = length;
+	writeTx(&header, sizeof(header));
+	writeTx(data, length);
+	sendNext();
+	return true;
+}
+
+/*
+ * Fill `report` with next fragment, or just an acknowledgement if the window is full.
+ * Fragment is removed from transmit buffer so it must be sent even if it has to be retried.
+ */
+bool DataChannel::prepareReport()
+{
+	bool haveData = (txMessageRemaining != 0 || txCount != 0) && uint8_t(txSeq - txAcked) < window;
+	if(!haveData && rxSeq == rxAckSent) {
+		return false;
+	}
+
+	memset(report, 0, reportSize);
+	uint8_t flags{0};
+	size_t length{0};
+	if(haveData) {
+		if(txMessageRemaining == 0) {
+			uint16_t header;
+			readTx(&header, sizeof(header));
+			txMessageRemaining = header;
+			flags |= flagFirst;
+		}
+		length = std::min(txMessageRemaining, size_t(reportSize - headerSize));
+		readTx(&report[headerSize], length);
+		txMessageRemaining -= length;
+		if(txMessageRemaining == 0) {
+			flags |= flagLast;
+		}
+	}
+	report[0] = flags | ((length >> 8) & lengthMask);
+	report[1] = haveData ? txSeq++ : txSeq;
+	report[3] = length;
+	return true;
+}
+
+void DataChannel::sendNext()
+{
+	if(inFlight || !txBuffer) {
+		return;
+	}
+
+	if(!reportReady) {
+		reportReady = prepareReport();
+		if(!reportReady) {
+			return;
+		}
+	}
+
+	// Acknowledgement is always current
+	report[2] = rxSeq;
+
+	auto complete = [this]() {
+		inFlight = false;
+		if(spaceWanted && spaceCallback) {
+			spaceWanted = false;
+			spaceCallback(*this);
+		}
+		sendNext();
+	};
+	if(device.sendReport(reportId, report, reportSize, complete, this)) {
+		inFlight = true;
+		reportReady = false;
+		rxAckSent = report[2];
+		++reportsSent;
+		return;
+	}
+
+	// Interface busy with another report
+	device.notifyReady(this, [this]() { sendNext(); });
+}
+
+void DataChannel::received(uint8_t report_id, const uint8_t* data, uint16_t length)
+{
+	// Reports from OUT endpoint include report ID
+	if(report_id == 0 && reportId != 0) {
+		if(length == 0 || data[0] != reportId) {
+			return;
+		}
+		++data;
+		--length;
+	} else if(report_id != reportId) {
+		return;
+	}
+
+	if(length < headerSize) {
+		return;
+	}
+
+	uint8_t flags = data[0];
+	uint8_t seq = data[1];
+	txAcked = data[2];
+	size_t fragmentLength = ((flags & lengthMask) << 8) | data[3];
+	if((flags & (flagFirst | flagLast)) == 0 && fragmentLength == 0) {
+		// Acknowledgement only
+		sendNext();
+		return;
+	}
+
+	if(seq == uint8_t(rxSeq - 1)) {
+		// Repeated at idle rate
+		return;
+	}
+	if(seq != rxSeq) {
+		debug_w("[HID] Expected seq %u, got %u", rxSeq, seq);
+		++errorCount;
+		rxActive = false;
+		rxSeq = seq;
+	}
+	++rxSeq;
+	if(fragmentLength > size_t(length - headerSize)) {
+		debug_w("[HID] Bad fragment length %u", fragmentLength);
+		++errorCount;
+		rxActive = false;
+	} else {
+		if(flags & flagFirst) {
+			if(rxActive) {
+				// Previous message incomplete
+				++errorCount;
+			}
+			rxActive = true;
+			rxLength = 0;
+		}
+		if(!rxActive) {
+			++errorCount;
+		} else if(rxLength + fragmentLength > rxCapacity) {
+			debug_w("[HID] Message too large");
+			++errorCount;
+			rxActive = false;
+		} else {
+			memcpy(&rxBuffer[rxLength], &data[headerSize], fragmentLength);
+			rxLength += fragmentLength;
+			if(flags & flagLast) {
+				rxActive = false;
+				if(messageCallback) {
+					messageCallback(*this, rxBuffer.get(), rxLength);
+				}
+			}
+		}
+	}
+
+	sendNext();
+}
+
+} // namespace USB::HID
+
+#endif
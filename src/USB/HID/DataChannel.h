@@ -0,0 +1,174 @@
+/****
+ * HID/DataChannel.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "Device.h"
+#include <memory>
+
+namespace USB::HID
+{
+/**
+ * @brief Message channel using generic HID input and output reports
+ *
+ * Provides bulk-style transfers without requiring a vendor driver on the host.
+ * Use the `hid-inout` template with a `generic-inout` report.
+ *
+ * Messages are split into fixed-size reports, each starting with a 4-byte header:
+ *
+ * - flags: bit 7 = first fragment, bit 6 = last fragment, bits 0-5 = payload length (high bits)
+ * - seq: Sequence number of this data report, modulo 256
+ * - ack: Total number of data reports received by sender, modulo 256
+ * - length: Payload length (low bits)
+ *
+ * A report with no flags and zero length carries only an acknowledgement.
+ * The sequence number ensures consecutive reports differ, so they are not suppressed
+ * by idle rate handling. Repeated reports are ignored.
+ * USB guarantees delivery, so acknowledgements are only for flow control: no more than
+ * `window` data reports may be outstanding, to avoid overrunning the host's report buffer.
+ * The next report is sent as soon as the previous one completes, giving one report per
+ * polling interval in each direction.
+ */
+class DataChannel
+{
+public:
+	static constexpr uint8_t headerSize{4};
+	static constexpr uint8_t defaultWindow{8};
+
+	using MessageReceived = Delegate<void(DataChannel& channel, const uint8_t* data, size_t length)>;
+	using SpaceAvailable = Delegate<void(DataChannel& channel)>;
+
+	/**
+	 * @brief Constructor
+	 * @param device HID interface, with an OUT endpoint
+	 * @param reportId Report ID for generic in/out report
+	 * @param reportSize Size of report excluding ID, as declared in report descriptor.
+	 * The endpoint buffer also holds the report ID, so this is limited to CFG_TUD_HID_EP_BUFSIZE - 1.
+	 */
+	DataChannel(Device& device, uint8_t reportId, uint16_t reportSize = CFG_TUD_HID_EP_BUFSIZE - 1)
+		: device(device), reportSize(std::min(reportSize, uint16_t(CFG_TUD_HID_EP_BUFSIZE - 1))), reportId(reportId)
+	{
+	}
+
+	~DataChannel()
+	{
+		end();
+	}
+
+	/**
+	 * @brief Allocate buffers and start handling output reports
+	 * @param txBufferSize Space for outgoing messages
+	 * @param maxMessageSize Largest incoming message
+	 */
+	bool begin(size_t txBufferSize = 2048, size_t maxMessageSize = 1024);
+
+	void end();
+
+	/**
+	 * @brief Set maximum number of unacknowledged reports
+	 * @note Both ends should use the same value
+	 */
+	void setWindow(uint8_t reports)
+	{
+		window = std::max(reports, uint8_t(1));
+	}
+
+	void onMessage(MessageReceived callback)
+	{
+		messageCallback = callback;
+	}
+
+	/**
+	 * @brief Set callback invoked when space becomes available after `send()` has failed
+	 */
+	void onSpace(SpaceAvailable callback)
+	{
+		spaceCallback = callback;
+	}
+
+	/**
+	 * @brief Queue a message for sending
+	 * @retval bool false if there is insufficient buffer space
+	 */
+	bool send(const void* data, size_t length);
+
+	/**
+	 * @brief Get size of largest message which can currently be sent
+	 */
+	size_t getFreeSpace() const
+	{
+		auto free = txCapacity - txCount;
+		return (free > sizeof(uint16_t)) ? free - sizeof(uint16_t) : 0;
+	}
+
+	/**
+	 * @brief Get number of reports sent, including acknowledgements
+	 */
+	uint32_t getReportsSent() const
+	{
+		return reportsSent;
+	}
+
+	/**
+	 * @brief Get number of incoming fragments discarded due to errors or overflow
+	 */
+	uint32_t getErrorCount() const
+	{
+		return errorCount;
+	}
+
+private:
+	static constexpr uint8_t flagFirst{0x80};
+	static constexpr uint8_t flagLast{0x40};
+	static constexpr uint8_t lengthMask{0x3f};
+
+	void received(uint8_t report_id, const uint8_t* data, uint16_t length);
+	bool prepareReport();
+	void sendNext();
+	void writeTx(const void* data, size_t length);
+	void readTx(void* data, size_t length);
+
+	Device& device;
+	MessageReceived messageCallback;
+	SpaceAvailable spaceCallback;
+	std::unique_ptr<uint8_t[]> txBuffer;
+	std::unique_ptr<uint8_t[]> rxBuffer;
+	uint32_t reportsSent{0};
+	uint32_t errorCount{0};
+	size_t txCapacity{0};
+	size_t txHead{0};
+	size_t txCount{0};
+	size_t txMessageRemaining{0}; ///< Bytes of current message still to send
+	size_t rxCapacity{0};
+	size_t rxLength{0};
+	uint16_t reportSize;
+	uint8_t report[CFG_TUD_HID_EP_BUFSIZE]; ///< Next report to send
+	uint8_t reportId;
+	uint8_t window{defaultWindow};
+	uint8_t txSeq{0};	 ///< Data reports sent
+	uint8_t txAcked{0};   ///< Data reports acknowledged by host
+	uint8_t rxSeq{0};	 ///< Data reports received
+	uint8_t rxAckSent{0}; ///< Last acknowledgement sent
+	bool rxActive{false};
+	bool reportReady{false};
+	bool inFlight{false};
+	bool spaceWanted{false};
+};
+
+} // namespace USB::HID
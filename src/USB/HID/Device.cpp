@@ -21,13 +21,25 @@
 
 #if defined(ENABLE_USB_CLASSES) && CFG_TUD_HID
 
+#include <Platform/System.h>
+#include <Platform/Clock.h>
+#include <algorithm>
+
 namespace USB::HID
 {
+namespace
+{
+// Interface isn't mounted or is suspended, so no report completion is expected
+constexpr uint32_t readyPollMs{10};
+
+} // namespace
+
 class InternalDevice : public Device
 {
 public:
 	using Device::get_report;
 	using Device::report_complete;
+	using Device::set_idle;
 	using Device::set_report;
 };
 
@@ -39,32 +51,341 @@ InternalDevice* getDevice(uint8_t inst)
 
 uint16_t Device::get_report(uint8_t report_id, hid_report_type_t report_type, uint8_t* buffer, uint16_t reqlen)
 {
-	return 0;
+	switch(report_type) {
+	case HID_REPORT_TYPE_INPUT: {
+		auto entry = findCached(report_id);
+		if(!entry) {
+			return 0;
+		}
+		auto len = std::min(reqlen, uint16_t(entry->length));
+		memcpy(buffer, entry->data, len);
+		return len;
+	}
+
+	case HID_REPORT_TYPE_FEATURE:
+		for(auto& feature : features) {
+			if(feature.reportId == report_id) {
+				return feature.getCallback ? feature.getCallback(buffer, reqlen) : 0;
+			}
+		}
+		return 0;
+
+	default:
+		return 0;
+	}
 }
 
 void Device::set_report(uint8_t report_id, hid_report_type_t report_type, uint8_t const* buffer, uint16_t bufsize)
 {
+	switch(report_type) {
+	case HID_REPORT_TYPE_FEATURE:
+		for(auto& feature : features) {
+			if(feature.reportId == report_id && feature.setCallback) {
+				feature.setCallback(buffer, bufsize);
+				return;
+			}
+		}
+		break;
+
+	case HID_REPORT_TYPE_INVALID:
+	case HID_REPORT_TYPE_OUTPUT:
+		if(outputReportCallback) {
+			outputReportCallback(report_id, buffer, bufsize);
+			return;
+		}
+		break;
+
+	default:
+		break;
+	}
+
 	char buf[32];
 	m_snprintf(buf, sizeof(buf), "%s(%u, %u, %u)", __FUNCTION__, report_id, report_type, bufsize);
 	m_printHex(buf, buffer, bufsize);
 }
 
-bool Device::sendReport(uint8_t report_id, void const* report, uint16_t len, ReportComplete callback)
+bool Device::set_idle(uint8_t idle_rate)
+{
+	debug_d("[HID] Idle rate %u", idle_rate);
+	idleRate = idle_rate;
+	scheduleIdle();
+	return true;
+}
+
+void Device::addFeature(uint8_t report_id, GetFeature getCallback, SetFeature setCallback)
 {
-	if(reportCompleteCallback || !isReady()) {
+	for(auto& feature : features) {
+		if(feature.reportId == report_id) {
+			feature.getCallback = getCallback;
+			feature.setCallback = setCallback;
+			return;
+		}
+	}
+	features.push_back({report_id, getCallback, setCallback});
+}
+
+Device::CachedReport* Device::findCached(uint8_t report_id)
+{
+	for(auto& entry : cache) {
+		if(entry.reportId == report_id) {
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+void Device::setAbsoluteReport(uint8_t report_id, bool state)
+{
+	auto it = std::find(absoluteReports.begin(), absoluteReports.end(), report_id);
+	if(state && it == absoluteReports.end()) {
+		absoluteReports.push_back(report_id);
+	} else if(!state && it != absoluteReports.end()) {
+		absoluteReports.erase(it);
+	}
+	scheduleIdle();
+}
+
+bool Device::isAbsolute(uint8_t report_id) const
+{
+	if(reportQueue && reportQueue->getPolicy(report_id) == ReportQueue::Policy::accumulate) {
+		return false;
+	}
+	return std::find(absoluteReports.begin(), absoluteReports.end(), report_id) != absoluteReports.end();
+}
+
+/*
+ * With idle rate 0 an unchanged absolute report is never re-sent,
+ * otherwise it's repeated once per idle period (by sendIdle).
+ */
+bool Device::isDuplicate(uint8_t report_id, const void* report, uint16_t len)
+{
+	if(!isAbsolute(report_id)) {
+		return false;
+	}
+	auto entry = findCached(report_id);
+	if(!entry || entry->length != len || memcmp(entry->data, report, len) != 0) {
+		return false;
+	}
+	return idleRate == 0 || millis() - entry->timestamp < getIdlePeriod();
+}
+
+bool Device::transmit(uint8_t report_id, const void* report, uint16_t len)
+{
+	if(!tud_hid_n_report(inst, report_id, report, len)) {
 		return false;
 	}
+
+	if(len <= CFG_TUD_HID_EP_BUFSIZE) {
+		auto entry = findCached(report_id);
+		if(!entry) {
+			cache.push_back({});
+			entry = &cache.back();
+			entry->reportId = report_id;
+		}
+		entry->timestamp = millis();
+		entry->length = len;
+		if(entry->data != report) {
+			memcpy(entry->data, report, len);
+		}
+	}
+
+	scheduleIdle();
+	return true;
+}
+
+bool Device::sendReport(uint8_t report_id, void const* report, uint16_t len, ReportComplete callback,
+						const void* owner)
+{
+	if(!isFree()) {
+		return false;
+	}
+	if(!readyRequests.empty() && !servingReady) {
+		// Other callers are waiting their turn
+		return false;
+	}
+	if(isDuplicate(report_id, report, len)) {
+		if(callback) {
+			// Complete from task queue as though report had been sent, so it can still be cancelled
+			reportCompleteCallback = callback;
+			reportCompleteOwner = owner;
+			System.queueCallback(
+				[](void* param) {
+					auto self = static_cast<Device*>(param);
+					self->report_complete();
+				},
+				this);
+		}
+		return true;
+	}
 	reportCompleteCallback = callback;
-	return tud_hid_n_report(inst, report_id, report, len);
+	reportCompleteOwner = owner;
+	if(transmit(report_id, report, len)) {
+		return true;
+	}
+	reportCompleteCallback = nullptr;
+	reportCompleteOwner = nullptr;
+	return false;
+}
+
+void Device::cancelReportComplete(const void* owner)
+{
+	if(owner && reportCompleteCallback && reportCompleteOwner == owner) {
+		// Interface remains busy until the report completes
+		reportCompleteCallback = [] {};
+		reportCompleteOwner = nullptr;
+	}
+}
+
+void Device::notifyReady(const void* owner, ReportComplete callback)
+{
+	cancelNotifyReady(owner);
+	readyRequests.push_back({owner, callback});
+	scheduleReady();
+}
+
+void Device::cancelNotifyReady(const void* owner)
+{
+	auto it = std::find_if(readyRequests.begin(), readyRequests.end(),
+						   [owner](const ReadyRequest& req) { return req.owner == owner; });
+	if(it != readyRequests.end()) {
+		readyRequests.erase(it);
+	}
+}
+
+/*
+ * Serve waiting callers in turn whilst the interface is free.
+ * A caller which asks again goes to the back of the queue.
+ */
+void Device::serviceReady()
+{
+	for(auto n = readyRequests.size(); n != 0 && isFree(); --n) {
+		auto req = readyRequests.front();
+		readyRequests.erase(readyRequests.begin());
+		servingReady = true;
+		req.callback();
+		servingReady = false;
+	}
+	scheduleReady();
+}
+
+/*
+ * Waiting callers are normally served on report completion.
+ * Poll only if no completion is expected.
+ */
+void Device::scheduleReady()
+{
+	bool completionPending = internalBusy || reportCompleteCallback || (tud_mounted() && !tud_suspended() && !isReady());
+	if(readyRequests.empty() || completionPending) {
+		readyTimer.stop();
+		return;
+	}
+	if(readyTimer.isStarted()) {
+		return;
+	}
+	readyTimer.initializeMs(
+		isFree() ? 1 : readyPollMs,
+		[](void* param) {
+			auto self = static_cast<Device*>(param);
+			self->serviceReady();
+		},
+		this);
+	readyTimer.startOnce();
+}
+
+ReportQueue& Device::getReportQueue()
+{
+	if(!reportQueue) {
+		reportQueue.reset(new ReportQueue);
+	}
+	return *reportQueue;
+}
+
+bool Device::queueReport(uint8_t report_id, void const* report, uint16_t len)
+{
+	if(!getReportQueue().push(report_id, report, len)) {
+		return false;
+	}
+	sendQueued();
+	return true;
+}
+
+void Device::sendQueued()
+{
+	if(!reportQueue || internalBusy || reportCompleteCallback || !isReady()) {
+		return;
+	}
+	const ReportQueue::Entry* entry;
+	while((entry = reportQueue->peek()) && isDuplicate(entry->reportId, entry->data, entry->length)) {
+		reportQueue->pop();
+	}
+	if(!entry) {
+		return;
+	}
+	// TinyUSB copies report so entry can be released immediately
+	if(transmit(entry->reportId, entry->data, entry->length)) {
+		reportQueue->pop();
+		internalBusy = true;
+	}
+}
+
+/*
+ * Repeat any absolute report whose idle period has expired
+ */
+void Device::sendIdle()
+{
+	if(idleRate == 0 || internalBusy || reportCompleteCallback || !isReady()) {
+		return;
+	}
+	uint32_t now = millis();
+	for(auto& entry : cache) {
+		if(isAbsolute(entry.reportId) && now - entry.timestamp >= getIdlePeriod()) {
+			internalBusy = transmit(entry.reportId, entry.data, entry.length);
+			return;
+		}
+	}
+	scheduleIdle();
+}
+
+void Device::scheduleIdle()
+{
+	uint32_t now = millis();
+	uint32_t delay = getIdlePeriod();
+	bool repeat{false};
+	for(auto& entry : cache) {
+		if(!isAbsolute(entry.reportId)) {
+			continue;
+		}
+		uint32_t elapsed = now - entry.timestamp;
+		delay = std::min(delay, (elapsed < getIdlePeriod()) ? getIdlePeriod() - elapsed : 0);
+		repeat = true;
+	}
+	if(idleRate == 0 || !repeat) {
+		idleTimer.stop();
+		return;
+	}
+	idleTimer.initializeMs(
+		std::max(delay, 1U),
+		[](void* param) {
+			auto self = static_cast<Device*>(param);
+			self->sendIdle();
+		},
+		this);
+	idleTimer.startOnce();
 }
 
 void Device::report_complete()
 {
-	if(reportCompleteCallback) {
+	if(internalBusy) {
+		internalBusy = false;
+	} else if(reportCompleteCallback) {
 		auto callback = reportCompleteCallback;
 		reportCompleteCallback = nullptr;
+		reportCompleteOwner = nullptr;
 		callback();
 	}
+	sendQueued();
+	sendIdle();
+	serviceReady();
 }
 
 } // namespace USB::HID
@@ -105,9 +426,11 @@ void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_
 // Invoked when received SET_IDLE request. return false will stall the request
 // - Idle Rate = 0 : only send report if there is changes, i.e skip duplication
 // - Idle Rate > 0 : skip duplication, but send at least 1 report every idle rate (in unit of 4 ms).
-//bool tud_hid_set_idle_cb(uint8_t instance, uint8_t idle_rate)
-// {
-// }
+bool tud_hid_set_idle_cb(uint8_t instance, uint8_t idle_rate)
+{
+	auto dev = getDevice(instance);
+	return dev ? dev->set_idle(idle_rate) : false;
+}
 
 // Invoked when sent REPORT successfully to host
 // Application can use this to send the next report
@@ -20,14 +20,47 @@
 #pragma once
 
 #include "../DeviceInterface.h"
+#include "ReportQueue.h"
+#include <SimpleTimer.h>
+#include <memory>
+#include <vector>
 
 namespace USB::HID
 {
+/**
+ * @brief HID device interface
+ *
+ * The last input report sent for each report ID is kept so GET_REPORT requests can be answered
+ * directly. For reports marked using `setAbsoluteReport()` it is also used to apply the idle rate
+ * set by the host: an unchanged report is not sent again until the idle period has elapsed,
+ * and with a non-zero idle rate the last report is repeated at that interval.
+ */
 class Device : public DeviceInterface
 {
 public:
 	using ReportComplete = Delegate<void()>;
 
+	/**
+	 * @brief Handler to provide content of a feature report
+	 * @param buffer Place report content here, excluding report ID
+	 * @param length Maximum size of report
+	 * @retval uint16_t Size of report, 0 to STALL request
+	 */
+	using GetFeature = Delegate<uint16_t(uint8_t* buffer, uint16_t length)>;
+
+	/**
+	 * @brief Handler for feature report sent by host
+	 */
+	using SetFeature = Delegate<void(const uint8_t* data, uint16_t length)>;
+
+	/**
+	 * @brief Handler for output reports
+	 * @param report_id Report ID, or 0 if received on OUT endpoint
+	 * @param data Report content. If received on OUT endpoint and report IDs are used, starts with the ID.
+	 * @param length
+	 */
+	using OutputReport = Delegate<void(uint8_t report_id, const uint8_t* data, uint16_t length)>;
+
 	using DeviceInterface::DeviceInterface;
 
 	bool isReady() const
@@ -35,15 +68,155 @@ public:
 		return tud_hid_n_ready(inst);
 	}
 
-	bool sendReport(uint8_t report_id, void const* report, uint16_t len, ReportComplete callback);
+	/**
+	 * @brief Send an input report
+	 * @param report_id
+	 * @param report Report content, excluding report ID
+	 * @param len
+	 * @param callback Invoked when report has been sent
+	 * @param owner Identifies the caller so the callback can be cancelled using `cancelReportComplete()`
+	 * @retval bool false if interface is busy
+	 * @note For absolute reports, one identical to the last one sent is suppressed according to the idle rate.
+	 * The callback is still invoked (from the task queue) so callers needn't handle this case.
+	 */
+	bool sendReport(uint8_t report_id, void const* report, uint16_t len, ReportComplete callback,
+					const void* owner = nullptr);
+
+	/**
+	 * @brief Cancel the completion callback for a report sent by `owner`
+	 *
+	 * The report itself is still sent. Call before an object whose callback captures `this` is destroyed.
+	 */
+	void cancelReportComplete(const void* owner);
+
+	/**
+	 * @brief Request a callback when the interface is free to send a report
+	 * @param owner Identifies the caller, replacing any request it has already made
+	 * @param callback Invoked once
+	 *
+	 * Use when `sendReport()` fails because another report is in progress.
+	 * Waiting callers are served in turn as reports complete, and `sendReport()`
+	 * fails for other callers until all have been served.
+	 */
+	void notifyReady(const void* owner, ReportComplete callback);
+
+	/**
+	 * @brief Cancel a request made by `notifyReady()`
+	 */
+	void cancelNotifyReady(const void* owner);
+
+	/**
+	 * @brief Queue a report for sending
+	 *
+	 * Reports are sent as the host polls, merged according to the policy set for the report ID.
+	 * Use this instead of `sendReport()` to submit reports at any rate.
+	 *
+	 * @retval bool false if queue is full
+	 */
+	bool queueReport(uint8_t report_id, void const* report, uint16_t len);
+
+	/**
+	 * @brief Get report queue, e.g. to set merge policies
+	 * @note Queue is allocated on first use
+	 */
+	ReportQueue& getReportQueue();
+
+	/**
+	 * @brief Mark a report as carrying absolute state, such as keyboard, gamepad or absolute pointer
+	 * @param report_id
+	 * @param state
+	 *
+	 * Unchanged absolute reports are suppressed, and repeated at the host's idle rate.
+	 * Other reports are always sent: an identical relative mouse report is a further movement.
+	 * Reports using the `ReportQueue::Policy::accumulate` policy are never treated as absolute.
+	 */
+	void setAbsoluteReport(uint8_t report_id, bool state = true);
+
+	/**
+	 * @brief Register handlers for a feature report
+	 * @param report_id
+	 * @param getCallback Answers GET_REPORT requests
+	 * @param setCallback Receives SET_REPORT requests, if feature is writeable
+	 *
+	 * Calling again with the same report ID replaces existing handlers.
+	 */
+	void addFeature(uint8_t report_id, GetFeature getCallback, SetFeature setCallback = nullptr);
+
+	/**
+	 * @brief Set handler for output reports, received via SET_REPORT or OUT endpoint
+	 */
+	void onOutputReport(OutputReport callback)
+	{
+		outputReportCallback = callback;
+	}
+
+	/**
+	 * @brief Get idle rate set by host
+	 * @retval uint8_t Interval in units of 4ms. 0 means reports are only sent when they change.
+	 */
+	uint8_t getIdleRate() const
+	{
+		return idleRate;
+	}
 
 protected:
 	uint16_t get_report(uint8_t report_id, hid_report_type_t report_type, uint8_t* buffer, uint16_t reqlen);
 	void set_report(uint8_t report_id, hid_report_type_t report_type, uint8_t const* buffer, uint16_t bufsize);
+	bool set_idle(uint8_t idle_rate);
 	void report_complete();
 
 private:
+	struct CachedReport {
+		uint32_t timestamp; ///< When report was last sent, in milliseconds
+		uint8_t reportId;
+		uint8_t length;
+		uint8_t data[CFG_TUD_HID_EP_BUFSIZE];
+	};
+
+	struct Feature {
+		uint8_t reportId;
+		GetFeature getCallback;
+		SetFeature setCallback;
+	};
+
+	struct ReadyRequest {
+		const void* owner;
+		ReportComplete callback;
+	};
+
+	CachedReport* findCached(uint8_t report_id);
+	bool isAbsolute(uint8_t report_id) const;
+	bool isDuplicate(uint8_t report_id, const void* report, uint16_t len);
+	bool transmit(uint8_t report_id, const void* report, uint16_t len);
+	void sendQueued();
+	void sendIdle();
+	void scheduleIdle();
+	void serviceReady();
+	void scheduleReady();
+
+	bool isFree() const
+	{
+		return !internalBusy && !reportCompleteCallback && isReady();
+	}
+
+	uint32_t getIdlePeriod() const
+	{
+		return idleRate * 4U;
+	}
+
 	ReportComplete reportCompleteCallback;
+	const void* reportCompleteOwner{};
+	OutputReport outputReportCallback;
+	std::unique_ptr<ReportQueue> reportQueue;
+	std::vector<CachedReport> cache;
+	std::vector<Feature> features;
+	std::vector<uint8_t> absoluteReports;
+	std::vector<ReadyRequest> readyRequests;
+	SimpleTimer idleTimer;
+	SimpleTimer readyTimer;
+	uint8_t idleRate{0};
+	bool internalBusy{false}; ///< Queued or idle report in progress
+	bool servingReady{false}; ///< Invoking a notifyReady() callback
 };
 
 } // namespace USB::HID
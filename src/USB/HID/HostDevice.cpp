@@ -21,6 +21,10 @@
 
 #if CFG_TUH_ENABLED && CFG_TUH_HID
 
+#include <host/hcd.h>
+#include <Platform/System.h>
+#include <Platform/Clock.h>
+
 namespace USB::HID
 {
 MountCallback mountCallback;
@@ -374,6 +378,228 @@ HostDevice* getDevice(HostDevice::Instance inst)
 	return nullptr;
 }
 
+bool HostDevice::begin(const Instance& inst, const Report& descriptor)
+{
+	HostInterface::begin(inst);
+	fieldValues.reset();
+	if(descriptor.length == 0) {
+		// Too large for enumeration buffer
+		return fetchReportMap();
+	}
+	if(!reportMap.parse(descriptor)) {
+		return false;
+	}
+	allocateFieldValues();
+	return true;
+}
+
+void HostDevice::end()
+{
+	stopStreaming();
+	fetchState = FetchState::idle;
+	fetchBuffer.reset();
+	reportMap.clear();
+	fieldValues.reset();
+	if(keyState) {
+		keyState->clear();
+	}
+	HostInterface::end();
+}
+
+void HostDevice::onField(FieldCallback callback, bool changedOnly)
+{
+	fieldCallback = callback;
+	this->changedOnly = changedOnly;
+	allocateFieldValues();
+}
+
+void HostDevice::onKey(KeyState::KeyCallback callback)
+{
+	if(!callback) {
+		keyState.reset();
+		return;
+	}
+	if(!keyState) {
+		keyState.reset(new KeyState);
+	}
+	keyState->onKey(callback);
+}
+
+void HostDevice::allocateFieldValues()
+{
+	if(fieldCallback && changedOnly && reportMap.getFieldCount() != 0) {
+		fieldValues.reset(new int32_t[reportMap.getFieldCount()]{});
+	} else {
+		fieldValues.reset();
+	}
+}
+
+bool HostDevice::fetchReportMap()
+{
+	if(fetchState != FetchState::idle) {
+		return false;
+	}
+
+	tuh_itf_info_t info;
+	if(!tuh_hid_itf_get_info(inst.dev_addr, inst.idx, &info)) {
+		return false;
+	}
+	itfNum = info.desc.bInterfaceNumber;
+
+	reportMap.clear();
+	fieldValues.reset();
+
+	// HID descriptor gives size of report descriptor
+	fetchLength = sizeof(tusb_hid_descriptor_hid_t);
+	fetchBuffer.reset(new uint8_t[fetchLength]);
+	fetchState = FetchState::hidDescriptor;
+	if(fetch()) {
+		return true;
+	}
+
+	fetchBuffer.reset();
+	fetchLength = 0;
+	fetchState = FetchState::idle;
+	return false;
+}
+
+bool HostDevice::fetch()
+{
+	uint8_t descType = (fetchState == FetchState::hidDescriptor) ? HID_DESC_TYPE_HID : HID_DESC_TYPE_REPORT;
+	const tusb_control_request_t request = {
+		.bmRequestType_bit =
+			{
+				.recipient = TUSB_REQ_RCPT_INTERFACE,
+				.type = TUSB_REQ_TYPE_STANDARD,
+				.direction = TUSB_DIR_IN,
+			},
+		.bRequest = TUSB_REQ_GET_DESCRIPTOR,
+		.wValue = tu_htole16(uint16_t(descType << 8)),
+		.wIndex = tu_htole16(itfNum),
+		.wLength = tu_htole16(fetchLength),
+	};
+
+	// Queued behind any other requests for this device, such as enumeration of its other interfaces
+	return controlTransfer(request, fetchBuffer.get(), [this](const tuh_xfer_t& xfer) {
+		if(fetchState != FetchState::idle) {
+			fetchComplete(xfer.result == XFER_RESULT_SUCCESS);
+		}
+	});
+}
+
+void HostDevice::fetchComplete(bool success)
+{
+	if(!success) {
+		debug_e("[HID] Failed to read %s descriptor",
+				(fetchState == FetchState::hidDescriptor) ? "HID" : "report");
+		fetchFinished(false);
+		return;
+	}
+
+	if(fetchState == FetchState::hidDescriptor) {
+		auto desc = reinterpret_cast<const tusb_hid_descriptor_hid_t*>(fetchBuffer.get());
+		fetchLength = tu_le16toh(desc->wReportLength);
+		if(fetchLength == 0 || fetchLength > maxReportDescriptorSize) {
+			debug_w("[HID] Report descriptor size %u not supported", fetchLength);
+			fetchFinished(false);
+			return;
+		}
+		debug_d("[HID] Fetching %u byte report descriptor", fetchLength);
+		fetchBuffer.reset(new uint8_t[fetchLength]);
+		fetchState = FetchState::reportDescriptor;
+		if(!fetch()) {
+			fetchFinished(false);
+		}
+		return;
+	}
+
+	// Only the compiled map is retained
+	reportMap.beginParse();
+	bool ok = reportMap.parse(fetchBuffer.get(), fetchLength) && reportMap.endParse();
+	fetchFinished(ok);
+}
+
+void HostDevice::fetchFinished(bool success)
+{
+	fetchBuffer.reset();
+	fetchLength = 0;
+	fetchState = FetchState::idle;
+	if(success) {
+		allocateFieldValues();
+	} else {
+		reportMap.clear();
+	}
+	if(reportMapCallback) {
+		reportMapCallback(*this, success);
+	}
+}
+
+bool HostDevice::startStreaming(uint16_t capacity, ReportsAvailable callback)
+{
+	stopStreaming();
+	if(!reports.begin(capacity, CFG_TUH_HID_EPIN_BUFSIZE)) {
+		return false;
+	}
+	reportsCallback = callback;
+	streaming = true;
+	if(!requestReport()) {
+		stopStreaming();
+		return false;
+	}
+	return true;
+}
+
+void HostDevice::stopStreaming()
+{
+	// Any transfer in progress will complete normally
+	streaming = false;
+	reportsCallback = nullptr;
+	reports.end();
+}
+
+void HostDevice::reportReceived(const Report& report)
+{
+	if(streaming) {
+		// Copy before re-arming as TinyUSB re-uses the endpoint buffer
+		auto timestamp = micros();
+		if(!reports.push(report.desc, report.length, timestamp, hcd_frame_number(BOARD_TUH_RHPORT))) {
+			debug_w("[HID] Report buffer full, %u dropped", reports.getDropCount());
+		}
+		requestReport();
+		if(!notifyPending && reportsCallback) {
+			notifyPending = System.queueCallback(
+				[](void* param) {
+					auto self = static_cast<HostDevice*>(param);
+					self->notifyPending = false;
+					if(self->streaming && self->reports.getCount() != 0) {
+						self->reportsCallback(*self, self->reports);
+					}
+				},
+				this);
+		}
+		return;
+	}
+
+	if(keyState) {
+		auto data = reinterpret_cast<const uint8_t*>(report.desc);
+		if(tuh_hid_interface_protocol(inst.dev_addr, inst.idx) == HID_ITF_PROTOCOL_KEYBOARD &&
+		   tuh_hid_get_protocol(inst.dev_addr, inst.idx) == HID_PROTOCOL_BOOT) {
+			if(report.length >= sizeof(hid_keyboard_report_t)) {
+				keyState->update(*reinterpret_cast<const hid_keyboard_report_t*>(data));
+			}
+		} else {
+			keyState->update(reportMap, data, report.length);
+		}
+	}
+	if(fieldCallback) {
+		reportMap.decode(reinterpret_cast<const uint8_t*>(report.desc), report.length, fieldValues.get(),
+						 fieldCallback);
+	}
+	if(reportReceivedCallback) {
+		reportReceivedCallback(report);
+	}
+}
+
 unsigned Report::parse(tuh_hid_report_info_t report_info_arr[], unsigned arr_count) const
 {
 	// Report Item 6.2.2.2 USB HID 1.11
@@ -20,6 +20,9 @@
 #pragma once
 
 #include "../HostInterface.h"
+#include "ReportMap.h"
+#include "ReportBuffer.h"
+#include "KeyState.h"
 #include <debug_progmem.h>
 
 namespace USB::HID
@@ -32,8 +35,83 @@ class HostDevice : public HostInterface
 {
 public:
 	using ReportReceived = Delegate<void(const Report& report)>;
+	using FieldCallback = ReportMap::FieldCallback;
+	using ReportMapReady = Delegate<void(HostDevice& dev, bool success)>;
+	using ReportsAvailable = Delegate<void(HostDevice& dev, ReportBuffer& reports)>;
+
+	/**
+	 * @brief Largest report descriptor which will be fetched from a device
+	 */
+	static constexpr size_t maxReportDescriptorSize{4096};
 
 	using HostInterface::HostInterface;
+	using HostInterface::begin;
+
+	/**
+	 * @brief Initialise device and compile report descriptor
+	 *
+	 * Use this method to enable decoding of reports with `onField()`.
+	 *
+	 * Descriptors larger than CFG_TUH_ENUMERATION_BUFSIZE are not provided by TinyUSB,
+	 * so in this case `fetchReportMap()` is called to read it from the device.
+	 *
+	 * @retval bool false if descriptor is invalid or could not be requested
+	 */
+	bool begin(const Instance& inst, const Report& descriptor);
+
+	void end() override;
+
+	/**
+	 * @brief Read report descriptor directly from device and compile it
+	 *
+	 * The descriptor is read into a temporary buffer which is released once parsing is complete.
+	 * Completion is notified via callback set using `onReportMap()`.
+	 *
+	 * @retval bool false if request could not be started
+	 */
+	bool fetchReportMap();
+
+	/**
+	 * @brief Set callback to be invoked when a fetched report map is ready
+	 */
+	void onReportMap(ReportMapReady callback)
+	{
+		reportMapCallback = callback;
+	}
+
+	bool isFetchingReportMap() const
+	{
+		return fetchState != FetchState::idle;
+	}
+
+	const ReportMap& getReportMap() const
+	{
+		return reportMap;
+	}
+
+	/**
+	 * @brief Set callback to receive decoded report fields
+	 * @param callback
+	 * @param changedOnly If true, callback is only invoked for fields whose value has changed
+	 */
+	void onField(FieldCallback callback, bool changedOnly = true);
+
+	/**
+	 * @brief Set callback to receive keyboard events
+	 *
+	 * Key state is tracked using `KeyState`. Boot protocol reports are handled directly,
+	 * otherwise the report map is used so NKRO keyboards are supported.
+	 */
+	void onKey(KeyState::KeyCallback callback);
+
+	/**
+	 * @brief Get keyboard state
+	 * @retval KeyState* nullptr if `onKey()` hasn't been called
+	 */
+	const KeyState* getKeyState() const
+	{
+		return keyState.get();
+	}
 
 	bool requestReport()
 	{
@@ -45,15 +123,61 @@ public:
 		reportReceivedCallback = callback;
 	}
 
-	void reportReceived(const Report& report)
+	/**
+	 * @brief Start continuous polling of the interrupt IN endpoint
+	 *
+	 * Reports are stored in a ring buffer with their time of arrival and the transfer
+	 * is re-armed immediately, so reports aren't missed if the application is slow to respond.
+	 * The `onReport()` and `onField()` callbacks are not used in this mode.
+	 *
+	 * @param capacity Number of reports to buffer
+	 * @param callback Invoked from the task queue when reports are available.
+	 * Handle any number of reports then release them using `ReportBuffer::discard()`.
+	 * @retval bool false if buffer could not be allocated or transfer could not be started
+	 */
+	bool startStreaming(uint16_t capacity, ReportsAvailable callback);
+
+	void stopStreaming();
+
+	bool isStreaming() const
 	{
-		if(reportReceivedCallback) {
-			reportReceivedCallback(report);
-		}
+		return streaming;
 	}
 
+	ReportBuffer& getReports()
+	{
+		return reports;
+	}
+
+	void reportReceived(const Report& report);
+
 private:
+	enum class FetchState {
+		idle,
+		hidDescriptor,
+		reportDescriptor,
+	};
+
+	void allocateFieldValues();
+	bool fetch();
+	void fetchComplete(bool success);
+	void fetchFinished(bool success);
+
 	ReportReceived reportReceivedCallback;
+	FieldCallback fieldCallback;
+	ReportMapReady reportMapCallback;
+	ReportsAvailable reportsCallback;
+	ReportMap reportMap;
+	ReportBuffer reports;
+	std::unique_ptr<int32_t[]> fieldValues;
+	std::unique_ptr<uint8_t[]> fetchBuffer;
+	std::unique_ptr<KeyState> keyState;
+	uint16_t fetchLength{0};
+	uint8_t itfNum{0};
+	FetchState fetchState{};
+	bool changedOnly{true};
+	bool streaming{false};
+	bool notifyPending{false};
 };
 
 /**
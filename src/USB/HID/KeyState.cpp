@@ -0,0 +1,131 @@
+/****
+ * HID/KeyState.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if CFG_TUH_ENABLED && CFG_TUH_HID
+
+#include "KeyState.h"
+
+namespace USB::HID
+{
+namespace
+{
+// Usages 0x01-0x03 indicate an error condition, e.g. too many keys pressed
+constexpr uint8_t firstValidKey{0x04};
+
+bool isError(unsigned key)
+{
+	return key != 0 && key < firstValidKey;
+}
+
+} // namespace
+
+void KeyState::update(const hid_keyboard_report_t& report)
+{
+	Bitmap keys{};
+	keys.words[HID_KEY_CONTROL_LEFT / 32] = uint32_t(report.modifier) << (HID_KEY_CONTROL_LEFT % 32);
+	for(auto key : report.keycode) {
+		if(isError(key)) {
+			return;
+		}
+		if(key != 0) {
+			keys.set(key);
+		}
+	}
+	update(keys);
+}
+
+void KeyState::update(const void* data, size_t length, uint8_t modifiers, uint8_t firstKey)
+{
+	Bitmap keys{};
+	keys.words[HID_KEY_CONTROL_LEFT / 32] = uint32_t(modifiers) << (HID_KEY_CONTROL_LEFT % 32);
+	auto bytes = static_cast<const uint8_t*>(data);
+	length = std::min(length, (keyCount - firstKey + 7) / 8);
+	for(unsigned i = 0; i < length; ++i) {
+		unsigned bits = bytes[i];
+		while(bits != 0) {
+			unsigned key = firstKey + i * 8 + __builtin_ctz(bits);
+			bits &= bits - 1;
+			if(key >= keyCount) {
+				break;
+			}
+			if(isError(key)) {
+				return;
+			}
+			keys.set(key);
+		}
+	}
+	update(keys);
+}
+
+bool KeyState::update(const ReportMap& map, const uint8_t* report, size_t length)
+{
+	Bitmap keys{};
+	bool found{false};
+	bool error{false};
+	map.decode(report, length, [&](const Field& field, unsigned, int32_t value) {
+		if(field.usagePage != HID_USAGE_PAGE_KEYBOARD) {
+			return;
+		}
+		found = true;
+		unsigned key;
+		if(field.isVariable()) {
+			if(value == 0) {
+				return;
+			}
+			key = field.usageMin;
+		} else {
+			key = field.getUsage(value);
+		}
+		if(isError(key)) {
+			error = true;
+		} else if(key != 0 && key < keyCount) {
+			keys.set(key);
+		}
+	});
+
+	if(found && !error) {
+		update(keys);
+	}
+	return found;
+}
+
+void KeyState::update(const Bitmap& newState)
+{
+	// Update state first so callback sees current modifiers
+	auto oldState = state;
+	state = newState;
+	if(!keyCallback) {
+		return;
+	}
+
+	for(unsigned i = 0; i < Bitmap::wordCount; ++i) {
+		uint32_t diff = newState.words[i] ^ oldState.words[i];
+		while(diff != 0) {
+			unsigned bit = __builtin_ctz(diff);
+			diff &= diff - 1;
+			keyCallback(i * 32 + bit, newState.words[i] & (1U << bit));
+		}
+	}
+}
+
+} // namespace USB::HID
+
+#endif
@@ -0,0 +1,128 @@
+/****
+ * HID/KeyState.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "ReportMap.h"
+
+namespace USB::HID
+{
+/**
+ * @brief Tracks which keys are held down on a keyboard
+ *
+ * State is kept as a bitmap indexed by usage from the keyboard page (0x07), including
+ * modifiers (0xE0-0xE7). Each report is converted to a bitmap and compared with the
+ * previous one a word at a time, so only keys which have changed are visited.
+ *
+ * Boot protocol (6-key rollover), raw NKRO bitmaps and reports described by a `ReportMap`
+ * are all supported. Reports indicating rollover error (usage 0x01) are ignored.
+ */
+class KeyState
+{
+public:
+	static constexpr size_t keyCount{256};
+
+	/**
+	 * @brief Called for each key pressed or released
+	 * @param key Usage code from keyboard page
+	 * @param pressed true if key is now down, false if released
+	 */
+	using KeyCallback = Delegate<void(uint8_t key, bool pressed)>;
+
+	struct Bitmap {
+		static constexpr size_t wordCount{keyCount / 32};
+
+		uint32_t words[wordCount];
+
+		void set(uint8_t key)
+		{
+			words[key / 32] |= 1U << (key % 32);
+		}
+
+		bool test(uint8_t key) const
+		{
+			return words[key / 32] & (1U << (key % 32));
+		}
+	};
+
+	void onKey(KeyCallback callback)
+	{
+		keyCallback = callback;
+	}
+
+	/**
+	 * @brief Process a boot protocol keyboard report
+	 */
+	void update(const hid_keyboard_report_t& report);
+
+	/**
+	 * @brief Process an NKRO bitmap
+	 * @param data Bitmap, bit 0 corresponds to key `firstKey`
+	 * @param length Size of bitmap in bytes
+	 * @param modifiers Modifier byte, if not included in bitmap
+	 * @param firstKey Usage code for first bit
+	 */
+	void update(const void* data, size_t length, uint8_t modifiers = 0, uint8_t firstKey = 0);
+
+	/**
+	 * @brief Process a report using its compiled descriptor
+	 * @param map
+	 * @param report Report as received, including report ID if used
+	 * @param length
+	 * @retval bool false if report contains no keyboard fields
+	 */
+	bool update(const ReportMap& map, const uint8_t* report, size_t length);
+
+	/**
+	 * @brief Set new key state, generating events for changed keys
+	 */
+	void update(const Bitmap& newState);
+
+	/**
+	 * @brief Release all keys
+	 */
+	void clear()
+	{
+		update(Bitmap{});
+	}
+
+	bool isPressed(uint8_t key) const
+	{
+		return state.test(key);
+	}
+
+	/**
+	 * @brief Get modifier keys in boot report format
+	 */
+	uint8_t getModifiers() const
+	{
+		return state.words[HID_KEY_CONTROL_LEFT / 32] >> (HID_KEY_CONTROL_LEFT % 32);
+	}
+
+	const Bitmap& getState() const
+	{
+		return state;
+	}
+
+private:
+	Bitmap state{};
+	KeyCallback keyCallback;
+};
+
+} // namespace USB::HID
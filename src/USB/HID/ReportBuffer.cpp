@@ -0,0 +1,85 @@
+/****
+ * HID/ReportBuffer.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if CFG_TUH_ENABLED && CFG_TUH_HID
+
+#include "ReportBuffer.h"
+
+namespace USB::HID
+{
+bool ReportBuffer::begin(uint16_t capacity, uint16_t maxReportSize)
+{
+	end();
+
+	if(capacity == 0 || maxReportSize == 0) {
+		return false;
+	}
+
+	// Keep entries word-aligned
+	unsigned size = (sizeof(Entry) + maxReportSize + 3) & ~3U;
+	if(size > UINT16_MAX) {
+		return false;
+	}
+	buffer.reset(new uint8_t[size * capacity]);
+	slotSize = size;
+	this->maxReportSize = maxReportSize;
+	this->capacity = capacity;
+	return true;
+}
+
+void ReportBuffer::end()
+{
+	buffer.reset();
+	slotSize = maxReportSize = capacity = 0;
+	head = count = 0;
+	dropCount = 0;
+}
+
+bool ReportBuffer::push(const void* data, uint16_t length, uint32_t timestamp, uint32_t frame)
+{
+	if(count == capacity) {
+		++dropCount;
+		return false;
+	}
+
+	auto slot = &buffer[((head + count) % capacity) * slotSize];
+	auto entry = reinterpret_cast<Entry*>(slot);
+	entry->timestamp = timestamp;
+	entry->frame = frame;
+	entry->length = std::min(length, maxReportSize);
+	memcpy(slot + sizeof(Entry), data, entry->length);
+	++count;
+	return true;
+}
+
+void ReportBuffer::discard(unsigned n)
+{
+	n = std::min(n, unsigned(count));
+	if(n == 0) {
+		return;
+	}
+	head = (head + n) % capacity;
+	count -= n;
+}
+
+} // namespace USB::HID
+
+#endif
@@ -0,0 +1,122 @@
+/****
+ * HID/ReportBuffer.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "../Descriptors.h"
+#include <memory>
+
+namespace USB::HID
+{
+/**
+ * @brief Ring buffer of received reports
+ *
+ * Reports are stored in fixed-size slots together with the time of arrival.
+ * Entries are accessed in place and released using `discard()`.
+ * If the buffer is full then incoming reports are dropped and counted.
+ */
+class ReportBuffer
+{
+public:
+	/**
+	 * @brief Header for a stored report, data follows immediately
+	 */
+	struct Entry {
+		uint32_t timestamp; ///< System time in microseconds when report was received
+		uint32_t frame;		///< USB frame number when report was received
+		uint16_t length;	///< Size of report data, including report ID if used
+
+		const uint8_t* getData() const
+		{
+			return reinterpret_cast<const uint8_t*>(this + 1);
+		}
+
+		DescriptorList getReport() const
+		{
+			return DescriptorList{reinterpret_cast<const Descriptor*>(getData()), length};
+		}
+	};
+
+	/**
+	 * @brief Allocate buffer
+	 * @param capacity Number of reports to store
+	 * @param maxReportSize Reports larger than this are truncated
+	 */
+	bool begin(uint16_t capacity, uint16_t maxReportSize);
+
+	void end();
+
+	/**
+	 * @brief Store a report
+	 * @retval bool false if buffer is full and report was dropped
+	 */
+	bool push(const void* data, uint16_t length, uint32_t timestamp, uint32_t frame);
+
+	/**
+	 * @brief Get number of reports in buffer
+	 */
+	uint16_t getCount() const
+	{
+		return count;
+	}
+
+	uint16_t getCapacity() const
+	{
+		return capacity;
+	}
+
+	/**
+	 * @brief Access a stored report
+	 * @param index From 0 (oldest) to `getCount() - 1` (newest)
+	 * @note Entry remains valid until discarded
+	 */
+	const Entry& operator[](unsigned index) const
+	{
+		return *reinterpret_cast<const Entry*>(&buffer[((head + index) % capacity) * slotSize]);
+	}
+
+	/**
+	 * @brief Release oldest reports
+	 */
+	void discard(unsigned n);
+
+	void clear()
+	{
+		head = count = 0;
+	}
+
+	/**
+	 * @brief Get number of reports dropped because buffer was full
+	 */
+	uint32_t getDropCount() const
+	{
+		return dropCount;
+	}
+
+private:
+	std::unique_ptr<uint8_t[]> buffer;
+	uint32_t dropCount{0};
+	uint16_t slotSize{0};
+	uint16_t maxReportSize{0};
+	uint16_t capacity{0};
+	uint16_t head{0};
+	uint16_t count{0};
+};
+
+} // namespace USB::HID
@@ -0,0 +1,130 @@
+/****
+ * HID/ReportDescriptors.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ * HID report descriptors in addition to those provided by TinyUSB.
+ * This header is included by generated C code so must remain C-compatible.
+ *
+ ****/
+
+#pragma once
+
+#include <tusb.h>
+
+// Digitizer page usages
+#define HID_DIGITIZER_TOUCH_SCREEN 0x04
+#define HID_DIGITIZER_FINGER 0x22
+#define HID_DIGITIZER_TIP_SWITCH 0x42
+#define HID_DIGITIZER_CONTACT_ID 0x51
+#define HID_DIGITIZER_CONTACT_COUNT 0x54
+#define HID_DIGITIZER_CONTACT_COUNT_MAX 0x55
+#define HID_DIGITIZER_SCAN_TIME 0x56
+
+// Coordinates for touch screen and absolute pointer reports range from 0 to this value
+#define HID_ABSOLUTE_MAX 32767
+
+// Physical size of touch screen in units of 0.1mm, may be overridden in project
+#ifndef HID_TOUCH_PHYSICAL_WIDTH
+#define HID_TOUCH_PHYSICAL_WIDTH 1600
+#endif
+#ifndef HID_TOUCH_PHYSICAL_HEIGHT
+#define HID_TOUCH_PHYSICAL_HEIGHT 900
+#endif
+
+// Largest number of contacts in a single touch report
+#define HID_TOUCH_MAX_CONTACTS_PER_REPORT 10
+
+/**
+ * @brief Touch contact
+ */
+typedef struct TU_ATTR_PACKED {
+	uint8_t tip; ///< 1 if finger is touching surface
+	uint8_t id;  ///< Contact identifier, must remain unchanged while touching
+	uint16_t x;
+	uint16_t y;
+} hid_touch_contact_t;
+
+/**
+ * @brief Absolute pointer report
+ */
+typedef struct TU_ATTR_PACKED {
+	uint8_t buttons;
+	uint16_t x;
+	uint16_t y;
+	int8_t wheel;
+} hid_absolute_pointer_report_t;
+
+#define _TUD_HID_TOUCH_CONTACT                                                                                         \
+	HID_USAGE(HID_DIGITIZER_FINGER), HID_COLLECTION(HID_COLLECTION_LOGICAL), HID_USAGE(HID_DIGITIZER_TIP_SWITCH),      \
+		HID_LOGICAL_MIN(0), HID_LOGICAL_MAX(1), HID_REPORT_SIZE(1), HID_REPORT_COUNT(1),                               \
+		HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), HID_REPORT_COUNT(7),                                        \
+		HID_INPUT(HID_CONSTANT | HID_VARIABLE | HID_ABSOLUTE), HID_USAGE(HID_DIGITIZER_CONTACT_ID),                    \
+		HID_LOGICAL_MAX(127), HID_REPORT_SIZE(8), HID_REPORT_COUNT(1), HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
+		HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP), HID_UNIT_EXPONENT(0x0e), HID_UNIT(0x11),                               \
+		HID_LOGICAL_MAX_N(HID_ABSOLUTE_MAX, 2), HID_REPORT_SIZE(16), HID_USAGE(HID_USAGE_DESKTOP_X),                  \
+		HID_PHYSICAL_MAX_N(HID_TOUCH_PHYSICAL_WIDTH, 2), HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),            \
+		HID_USAGE(HID_USAGE_DESKTOP_Y), HID_PHYSICAL_MAX_N(HID_TOUCH_PHYSICAL_HEIGHT, 2),                            \
+		HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), HID_PHYSICAL_MAX(0), HID_UNIT_EXPONENT(0), HID_UNIT(0),     \
+		HID_USAGE_PAGE(HID_USAGE_PAGE_DIGITIZER), HID_COLLECTION_END
+
+#define _TUD_HID_TOUCH_CONTACTS_1 _TUD_HID_TOUCH_CONTACT
+#define _TUD_HID_TOUCH_CONTACTS_2 _TUD_HID_TOUCH_CONTACTS_1, _TUD_HID_TOUCH_CONTACT
+#define _TUD_HID_TOUCH_CONTACTS_3 _TUD_HID_TOUCH_CONTACTS_2, _TUD_HID_TOUCH_CONTACT
+#define _TUD_HID_TOUCH_CONTACTS_4 _TUD_HID_TOUCH_CONTACTS_3, _TUD_HID_TOUCH_CONTACT
+#define _TUD_HID_TOUCH_CONTACTS_5 _TUD_HID_TOUCH_CONTACTS_4, _TUD_HID_TOUCH_CONTACT
+#define _TUD_HID_TOUCH_CONTACTS_6 _TUD_HID_TOUCH_CONTACTS_5, _TUD_HID_TOUCH_CONTACT
+#define _TUD_HID_TOUCH_CONTACTS_7 _TUD_HID_TOUCH_CONTACTS_6, _TUD_HID_TOUCH_CONTACT
+#define _TUD_HID_TOUCH_CONTACTS_8 _TUD_HID_TOUCH_CONTACTS_7, _TUD_HID_TOUCH_CONTACT
+#define _TUD_HID_TOUCH_CONTACTS_9 _TUD_HID_TOUCH_CONTACTS_8, _TUD_HID_TOUCH_CONTACT
+#define _TUD_HID_TOUCH_CONTACTS_10 _TUD_HID_TOUCH_CONTACTS_9, _TUD_HID_TOUCH_CONTACT
+#define _TUD_HID_TOUCH_CONTACTS(n) _TUD_HID_TOUCH_CONTACTS_##n
+
+/*
+ * Multi-touch screen
+ *
+ * Input report contains `contacts` entries (hid_touch_contact_t), then 16-bit scan time
+ * in units of 100us and 8-bit contact count. In hybrid mode a frame with more contacts
+ * is sent as several reports with the same scan time, the first giving the total contact count
+ * and the others zero.
+ *
+ * Feature report contains the maximum number of contacts supported.
+ */
+#define TUD_HID_REPORT_DESC_TOUCHSCREEN(contacts, ...)                                                                 \
+	HID_USAGE_PAGE(HID_USAGE_PAGE_DIGITIZER), HID_USAGE(HID_DIGITIZER_TOUCH_SCREEN),                                   \
+		HID_COLLECTION(HID_COLLECTION_APPLICATION), /* Report ID if any */                                             \
+		__VA_ARGS__ _TUD_HID_TOUCH_CONTACTS(contacts), HID_USAGE(HID_DIGITIZER_SCAN_TIME), HID_UNIT_EXPONENT(0x0c),    \
+		HID_UNIT_N(0x1001, 2), HID_LOGICAL_MIN(0), HID_LOGICAL_MAX_N(0xffff, 3), HID_REPORT_SIZE(16),                 \
+		HID_REPORT_COUNT(1), HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), HID_UNIT_EXPONENT(0), HID_UNIT(0),      \
+		HID_USAGE(HID_DIGITIZER_CONTACT_COUNT), HID_LOGICAL_MAX(127), HID_REPORT_SIZE(8),                              \
+		HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), HID_USAGE(HID_DIGITIZER_CONTACT_COUNT_MAX),                 \
+		HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), HID_COLLECTION_END
+
+/*
+ * Pointer with absolute 16-bit coordinates, 5 buttons and wheel.
+ * Report layout is hid_absolute_pointer_report_t.
+ */
+#define TUD_HID_REPORT_DESC_ABSOLUTE_POINTER(...)                                                                      \
+	HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP), HID_USAGE(HID_USAGE_DESKTOP_MOUSE),                                        \
+		HID_COLLECTION(HID_COLLECTION_APPLICATION), /* Report ID if any */                                             \
+		__VA_ARGS__ HID_USAGE(HID_USAGE_DESKTOP_POINTER), HID_COLLECTION(HID_COLLECTION_PHYSICAL),                     \
+		HID_USAGE_PAGE(HID_USAGE_PAGE_BUTTON), HID_USAGE_MIN(1), HID_USAGE_MAX(5), HID_LOGICAL_MIN(0),                 \
+		HID_LOGICAL_MAX(1), HID_REPORT_SIZE(1), HID_REPORT_COUNT(5), HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
+		HID_REPORT_COUNT(3), HID_INPUT(HID_CONSTANT | HID_VARIABLE | HID_ABSOLUTE),                                    \
+		HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP), HID_USAGE(HID_USAGE_DESKTOP_X), HID_USAGE(HID_USAGE_DESKTOP_Y),        \
+		HID_LOGICAL_MAX_N(HID_ABSOLUTE_MAX, 2), HID_REPORT_SIZE(16), HID_REPORT_COUNT(2),                              \
+		HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), HID_USAGE(HID_USAGE_DESKTOP_WHEEL), HID_LOGICAL_MIN(0x81),   \
+		HID_LOGICAL_MAX(0x7f), HID_REPORT_SIZE(8), HID_REPORT_COUNT(1), HID_INPUT(HID_DATA | HID_VARIABLE | HID_RELATIVE), \
+		HID_COLLECTION_END, HID_COLLECTION_END
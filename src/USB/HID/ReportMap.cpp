@@ -0,0 +1,535 @@
+/****
+ * HID/ReportMap.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if CFG_TUH_HID || CFG_TUD_HID
+
+#include "ReportMap.h"
+#include <debug_progmem.h>
+#include <vector>
+
+namespace USB::HID
+{
+namespace
+{
+constexpr unsigned maxUsages{16};
+constexpr unsigned maxStackDepth{4};
+constexpr unsigned maxItemFields{64}; ///< Larger items (e.g. vendor data blocks) are not decoded, except bitmaps
+constexpr uint8_t longItemPrefix{0xfe};
+
+// Item state which persists across main items, may be saved with PUSH/POP
+struct Globals {
+	uint16_t usagePage;
+	uint8_t reportId;
+	uint8_t reportSize;
+	uint16_t reportCount;
+	uint8_t logicalMaxSize;
+	int32_t logicalMin;
+	uint32_t logicalMax; ///< Raw value, interpretation depends on sign of logicalMin
+};
+
+// Item state which is cleared after each main item
+struct Locals {
+	uint32_t usages[maxUsages]; ///< Extended usages include page in upper 16 bits
+	uint8_t usageCount;
+	bool haveMin;
+	bool haveMax;
+	uint32_t usageMin;
+	uint32_t usageMax;
+};
+
+int32_t signExtend(uint32_t value, unsigned bits)
+{
+	if(bits == 0 || bits >= 32) {
+		return value;
+	}
+	uint32_t signBit = 1U << (bits - 1);
+	return (value ^ signBit) - signBit;
+}
+
+const char* getKindName(Field::Kind kind)
+{
+	switch(kind) {
+	case Field::Kind::input:
+		return "input";
+	case Field::Kind::output:
+		return "output";
+	case Field::Kind::feature:
+		return "feature";
+	default:
+		return "?";
+	}
+}
+
+} // namespace
+
+int32_t Field::extract(const uint8_t* data, size_t length) const
+{
+	unsigned byteOffset = bitOffset / 8;
+	unsigned shift = bitOffset % 8;
+	unsigned byteCount = (shift + bitSize + 7) / 8;
+	if(byteOffset + byteCount > length) {
+		return 0;
+	}
+
+	data += byteOffset;
+	uint64_t raw{0};
+	for(unsigned i = 0; i < byteCount; ++i) {
+		raw |= uint64_t(data[i]) << (i * 8);
+	}
+	raw >>= shift;
+	if(bitSize < 32) {
+		raw &= (1U << bitSize) - 1;
+	}
+
+	return isSigned() ? signExtend(raw, bitSize) : int32_t(raw);
+}
+
+size_t Field::printTo(Print& p) const
+{
+	size_t n{0};
+	if(reportId != 0) {
+		n += p.print("ID ");
+		n += p.print(reportId);
+		n += p.print(' ');
+	}
+	n += p.print(getKindName(kind));
+	n += p.print(" @ ");
+	n += p.print(bitOffset);
+	n += p.print(':');
+	n += p.print(bitSize);
+	n += p.print(", page ");
+	n += p.print(String(usagePage, HEX, 2));
+	n += p.print(", usage ");
+	n += p.print(String(usageMin, HEX, 2));
+	if(!isVariable()) {
+		n += p.print("..");
+		n += p.print(String(usageMax, HEX, 2));
+	}
+	n += p.print(", range ");
+	n += p.print(logicalMin);
+	n += p.print("..");
+	n += p.print(logicalMax);
+	if(isRelative()) {
+		n += p.print(", relative");
+	}
+	return n;
+}
+
+// Parsing state, only allocated whilst parsing is in progress
+struct ReportMap::Parser {
+	Globals global{};
+	Globals stack[maxStackDepth];
+	uint8_t stackDepth{0};
+	Locals local{};
+	uint8_t item[5]; ///< Current short item, may be split across blocks
+	uint8_t itemLength{0};
+	uint16_t skip{0}; ///< Bytes remaining in long item
+	bool failed{false};
+	std::vector<Field> fields; ///< In descriptor order
+};
+
+ReportMap::ReportMap() = default;
+ReportMap::~ReportMap() = default;
+
+void ReportMap::clear()
+{
+	parser.reset();
+	fields.reset();
+	fieldCount = 0;
+	reportCount = 0;
+	usesReportIds = false;
+}
+
+void ReportMap::beginParse()
+{
+	clear();
+	parser.reset(new Parser);
+}
+
+bool ReportMap::parse(const void* data, size_t length)
+{
+	if(!parser || parser->failed) {
+		return false;
+	}
+
+	auto& p = *parser;
+	auto ptr = static_cast<const uint8_t*>(data);
+	while(length != 0) {
+		if(p.skip != 0) {
+			auto n = std::min(size_t(p.skip), length);
+			p.skip -= n;
+			ptr += n;
+			length -= n;
+			continue;
+		}
+
+		p.item[p.itemLength++] = *ptr++;
+		--length;
+
+		// Long items are not defined by the specification so are skipped: prefix, size, tag then data
+		if(p.item[0] == longItemPrefix) {
+			if(p.itemLength == 2) {
+				p.skip = 1 + p.item[1];
+				p.itemLength = 0;
+			}
+			continue;
+		}
+
+		unsigned size = p.item[0] & 0x03;
+		if(size == 3) {
+			size = 4;
+		}
+		if(p.itemLength < 1 + size) {
+			continue;
+		}
+
+		uint32_t value{0};
+		for(unsigned i = 0; i < size; ++i) {
+			value |= uint32_t(p.item[1 + i]) << (i * 8);
+		}
+		p.itemLength = 0;
+		if(!parseItem(p.item[0], value, size)) {
+			p.failed = true;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ReportMap::endParse()
+{
+	if(!parser) {
+		return false;
+	}
+
+	std::unique_ptr<Parser> p(std::move(parser));
+	if(p->failed || p->itemLength != 0 || p->skip != 0) {
+		if(!p->failed) {
+			debug_w("[HID] Report descriptor truncated");
+		}
+		clear();
+		return false;
+	}
+
+	auto count = p->fields.size();
+	if(count > UINT16_MAX) {
+		clear();
+		return false;
+	}
+
+	// Group fields by report so each report is a contiguous slice of the table
+	unsigned first{0};
+	for(unsigned i = 0; i < reportCount; ++i) {
+		auto& report = reports[i];
+		report.firstField = first;
+		first += report.fieldCount;
+		report.fieldCount = 0;
+	}
+	fields.reset(new Field[count]);
+	for(auto& field : p->fields) {
+		auto report = getReport(field.reportId, field.kind, false);
+		fields[report->firstField + report->fieldCount++] = field;
+	}
+	fieldCount = count;
+
+	debug_d("[HID] Report map has %u fields in %u reports", fieldCount, reportCount);
+	return true;
+}
+
+ReportMap::ReportInfo* ReportMap::getReport(uint8_t id, Field::Kind kind, bool create)
+{
+	for(unsigned i = 0; i < reportCount; ++i) {
+		auto& report = reports[i];
+		if(report.id == id && report.kind == kind) {
+			return &report;
+		}
+	}
+
+	if(!create || reportCount >= maxReports) {
+		return nullptr;
+	}
+
+	auto& report = reports[reportCount++];
+	report = ReportInfo{id, kind};
+	return &report;
+}
+
+const ReportMap::ReportInfo* ReportMap::findReport(uint8_t id, Field::Kind kind) const
+{
+	for(unsigned i = 0; i < reportCount; ++i) {
+		auto& report = reports[i];
+		if(report.id == id && report.kind == kind) {
+			return &report;
+		}
+	}
+	return nullptr;
+}
+
+size_t ReportMap::getReportSize(uint8_t reportId, Field::Kind kind) const
+{
+	auto report = findReport(reportId, kind);
+	return report ? (report->bitLength + 7) / 8 : 0;
+}
+
+bool ReportMap::parseItem(uint8_t header, uint32_t value, unsigned size)
+{
+	// Report Item 6.2.2.2 USB HID 1.11
+	union Header {
+		uint8_t byte;
+		struct {
+			uint8_t size : 2;
+			uint8_t type : 2;
+			uint8_t tag : 4;
+		};
+	};
+
+	auto& global = parser->global;
+	auto& local = parser->local;
+	const Header hdr{header};
+
+	switch(hdr.type) {
+	case RI_TYPE_MAIN: {
+		Field::Kind kind;
+		switch(hdr.tag) {
+		case RI_MAIN_INPUT:
+			kind = Field::Kind::input;
+			break;
+		case RI_MAIN_OUTPUT:
+			kind = Field::Kind::output;
+			break;
+		case RI_MAIN_FEATURE:
+			kind = Field::Kind::feature;
+			break;
+		default:
+			// Collections
+			local = {};
+			return true;
+		}
+
+		auto report = getReport(global.reportId, kind, true);
+		if(!report) {
+			debug_w("[HID] Too many reports");
+			return false;
+		}
+		if(global.reportId != 0) {
+			usesReportIds = true;
+		}
+
+		uint8_t flags = value;
+		unsigned bitSize = global.reportSize;
+		unsigned count = global.reportCount;
+		bool decode = !(flags & Field::constant) && bitSize != 0 && bitSize <= 32;
+		// Bitmaps such as NKRO key states are always decoded, typically 104-232 bits
+		bool bitmap = (flags & Field::variable) && bitSize == 1;
+		if(decode && count > maxItemFields && !bitmap) {
+			debug_w("[HID] Item with %u fields not decoded", count);
+			decode = false;
+		}
+		if(decode) {
+			int32_t logicalMax = (global.logicalMin < 0) ? signExtend(global.logicalMax, global.logicalMaxSize * 8)
+														 : int32_t(global.logicalMax);
+			for(unsigned i = 0; i < count; ++i) {
+				uint32_t usageMin;
+				uint32_t usageMax;
+				if(flags & Field::variable) {
+					if(local.usageCount != 0) {
+						usageMin = local.usages[std::min(i, unsigned(local.usageCount - 1))];
+					} else if(local.haveMin) {
+						usageMin = std::min(local.usageMin + i, local.usageMax);
+					} else {
+						usageMin = 0;
+					}
+					usageMax = usageMin;
+				} else if(local.haveMin) {
+					usageMin = local.usageMin;
+					usageMax = local.usageMax;
+				} else if(local.usageCount != 0) {
+					usageMin = local.usages[0];
+					usageMax = local.usages[local.usageCount - 1];
+				} else {
+					usageMin = usageMax = 0;
+				}
+
+				Field field;
+				field.bitOffset = report->bitLength + i * bitSize;
+				field.bitSize = bitSize;
+				field.reportId = global.reportId;
+				field.kind = kind;
+				field.flags = flags;
+				field.usagePage = (usageMin >> 16) ?: global.usagePage;
+				field.usageMin = usageMin;
+				field.usageMax = usageMax;
+				field.logicalMin = global.logicalMin;
+				field.logicalMax = logicalMax;
+				parser->fields.push_back(field);
+				++report->fieldCount;
+			}
+		}
+		report->bitLength += bitSize * count;
+		local = {};
+		break;
+	}
+
+	case RI_TYPE_GLOBAL:
+		switch(hdr.tag) {
+		case RI_GLOBAL_USAGE_PAGE:
+			global.usagePage = value;
+			break;
+		case RI_GLOBAL_LOGICAL_MIN:
+			global.logicalMin = signExtend(value, size * 8);
+			break;
+		case RI_GLOBAL_LOGICAL_MAX:
+			global.logicalMax = value;
+			global.logicalMaxSize = size;
+			break;
+		case RI_GLOBAL_REPORT_ID:
+			global.reportId = value;
+			break;
+		case RI_GLOBAL_REPORT_SIZE:
+			global.reportSize = value;
+			break;
+		case RI_GLOBAL_REPORT_COUNT:
+			global.reportCount = value;
+			break;
+		case RI_GLOBAL_PUSH:
+			if(parser->stackDepth >= maxStackDepth) {
+				debug_w("[HID] PUSH too deep");
+				return false;
+			}
+			parser->stack[parser->stackDepth++] = global;
+			break;
+		case RI_GLOBAL_POP:
+			if(parser->stackDepth == 0) {
+				debug_w("[HID] POP without PUSH");
+				return false;
+			}
+			global = parser->stack[--parser->stackDepth];
+			break;
+		default:
+			// Physical range and units not required for decoding
+			break;
+		}
+		break;
+
+	case RI_TYPE_LOCAL:
+		// 4-byte usages include the usage page
+		if(size < 4 && hdr.tag <= RI_LOCAL_USAGE_MAX) {
+			value &= 0xffff;
+		}
+		switch(hdr.tag) {
+		case RI_LOCAL_USAGE:
+			if(local.usageCount < maxUsages) {
+				local.usages[local.usageCount++] = value;
+			}
+			break;
+		case RI_LOCAL_USAGE_MIN:
+			local.usageMin = value;
+			local.haveMin = true;
+			if(!local.haveMax) {
+				local.usageMax = value;
+			}
+			break;
+		case RI_LOCAL_USAGE_MAX:
+			local.usageMax = value;
+			local.haveMax = true;
+			break;
+		default:
+			break;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return true;
+}
+
+unsigned ReportMap::decode(const uint8_t* report, size_t length, int32_t* values, FieldCallback callback) const
+{
+	uint8_t id{0};
+	if(usesReportIds) {
+		if(length == 0) {
+			return 0;
+		}
+		id = *report++;
+		--length;
+	}
+
+	auto info = findReport(id, Field::Kind::input);
+	if(!info) {
+		return 0;
+	}
+
+	unsigned count{0};
+	unsigned endField = info->firstField + info->fieldCount;
+	for(unsigned i = info->firstField; i < endField; ++i) {
+		auto& field = fields[i];
+		auto value = field.extract(report, length);
+		if(values) {
+			if(values[i] == value) {
+				continue;
+			}
+			values[i] = value;
+		}
+		++count;
+		if(callback) {
+			callback(field, i, value);
+		}
+	}
+
+	return count;
+}
+
+unsigned ReportMap::getInputs(uint8_t reportId, InputState::Input* inputs, unsigned maxCount) const
+{
+	auto info = findReport(reportId, Field::Kind::input);
+	if(!info) {
+		return 0;
+	}
+
+	unsigned idOffset = usesReportIds ? 8 : 0;
+	unsigned count{0};
+	unsigned endField = info->firstField + info->fieldCount;
+	for(unsigned i = info->firstField; i < endField && count < maxCount; ++i) {
+		auto& field = fields[i];
+		if(!field.isVariable()) {
+			continue;
+		}
+		inputs[count++] = {uint16_t(idOffset + field.bitOffset), field.bitSize, field.isSigned(), 0, 0};
+	}
+
+	return count;
+}
+
+size_t ReportMap::printTo(Print& p) const
+{
+	size_t n{0};
+	for(auto& field : *this) {
+		n += p.println(field);
+	}
+	return n;
+}
+
+} // namespace USB::HID
+
+#endif
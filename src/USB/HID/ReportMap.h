@@ -0,0 +1,247 @@
+/****
+ * HID/ReportMap.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "../InputState.h"
+#include <memory>
+
+namespace USB::HID
+{
+/**
+ * @brief Describes one value within a report
+ *
+ * Variable items produce one field per value. Array items produce one field per element,
+ * each containing an index into the usage range (see `getUsage()`).
+ * Constant (padding) items are omitted.
+ */
+struct Field {
+	enum class Kind : uint8_t {
+		input,
+		output,
+		feature,
+	};
+
+	// Main item flags
+	static constexpr uint8_t constant{0x01};
+	static constexpr uint8_t variable{0x02};
+	static constexpr uint8_t relative{0x04};
+	static constexpr uint8_t nullState{0x40};
+
+	uint16_t bitOffset; ///< Offset from start of report data, excluding report ID
+	uint8_t bitSize;
+	uint8_t reportId; ///< 0 if device doesn't use report IDs
+	Kind kind;
+	uint8_t flags;
+	uint16_t usagePage;
+	uint16_t usageMin; ///< Usage for variable fields
+	uint16_t usageMax;
+	int32_t logicalMin;
+	int32_t logicalMax;
+
+	bool isVariable() const
+	{
+		return flags & variable;
+	}
+
+	bool isRelative() const
+	{
+		return flags & relative;
+	}
+
+	bool isSigned() const
+	{
+		return logicalMin < 0;
+	}
+
+	/**
+	 * @brief Obtain usage for a value
+	 * @retval uint16_t For array fields, usage selected by value; 0 if none
+	 */
+	uint16_t getUsage(int32_t value) const
+	{
+		if(isVariable()) {
+			return usageMin;
+		}
+		if(value < logicalMin || value > logicalMax) {
+			return 0;
+		}
+		unsigned usage = usageMin + unsigned(value - logicalMin);
+		return (usage <= usageMax) ? usage : 0;
+	}
+
+	/**
+	 * @brief Read value for this field from report data
+	 * @param data Report data, excluding report ID
+	 * @param length Size of report data
+	 */
+	int32_t extract(const uint8_t* data, size_t length) const;
+
+	size_t printTo(Print& p) const;
+};
+
+/**
+ * @brief Table of report fields compiled from a HID report descriptor
+ *
+ * Parsing is done once, typically when a device is mounted.
+ * Incoming reports can then be decoded by iterating over the relevant fields.
+ *
+ * The descriptor may be parsed in one go or supplied in blocks of any size
+ * using `beginParse()`, `parse()` and `endParse()`. Only the compiled fields are retained.
+ */
+class ReportMap
+{
+public:
+	static constexpr size_t maxReports{16};
+
+	/**
+	 * @brief Called for each decoded field
+	 * @param field
+	 * @param index Position of field within table
+	 * @param value
+	 */
+	using FieldCallback = Delegate<void(const Field& field, unsigned index, int32_t value)>;
+
+	ReportMap();
+	~ReportMap();
+
+	/**
+	 * @brief Compile report descriptor
+	 * @retval bool false if descriptor is invalid or too complex
+	 */
+	bool parse(const DescriptorList& descriptor)
+	{
+		beginParse();
+		return parse(descriptor.desc, descriptor.length) && endParse();
+	}
+
+	/**
+	 * @brief Start incremental parsing, discarding any existing content
+	 */
+	void beginParse();
+
+	/**
+	 * @brief Parse next block of report descriptor data
+	 * @param data
+	 * @param length Items may be split across blocks
+	 * @retval bool false if descriptor is invalid or too complex
+	 */
+	bool parse(const void* data, size_t length);
+
+	/**
+	 * @brief Complete parsing and build field table
+	 * @retval bool false on error, or if descriptor is truncated
+	 */
+	bool endParse();
+
+	void clear();
+
+	size_t getFieldCount() const
+	{
+		return fieldCount;
+	}
+
+	const Field& operator[](unsigned index) const
+	{
+		return fields[index];
+	}
+
+	const Field* begin() const
+	{
+		return fields.get();
+	}
+
+	const Field* end() const
+	{
+		return fields.get() + fieldCount;
+	}
+
+	/**
+	 * @brief Determine whether reports are prefixed with a report ID
+	 */
+	bool hasReportIds() const
+	{
+		return usesReportIds;
+	}
+
+	/**
+	 * @brief Get size of a report, excluding report ID
+	 * @retval size_t Size in bytes, 0 if report not defined
+	 */
+	size_t getReportSize(uint8_t reportId, Field::Kind kind = Field::Kind::input) const;
+
+	/**
+	 * @brief Decode all input fields in a report
+	 * @param report Report as received, including report ID if used
+	 * @param length Size of report
+	 * @param callback Invoked for each field
+	 * @retval unsigned Number of fields decoded
+	 */
+	unsigned decode(const uint8_t* report, size_t length, FieldCallback callback) const
+	{
+		return decode(report, length, nullptr, callback);
+	}
+
+	/**
+	 * @brief Decode only those input fields which have changed
+	 * @param report Report as received, including report ID if used
+	 * @param length Size of report
+	 * @param values Array of `getFieldCount()` values from previous call, updated on return
+	 * @param callback Invoked for each changed field
+	 * @retval unsigned Number of fields changed
+	 */
+	unsigned decode(const uint8_t* report, size_t length, int32_t* values, FieldCallback callback) const;
+
+	/**
+	 * @brief Describe variable input fields in a report for use with `InputState`
+	 * @param reportId
+	 * @param inputs Array to receive input definitions, in field order
+	 * @param maxCount Size of array
+	 * @retval unsigned Number of inputs
+	 * @note Array fields such as keyboard key codes are not included.
+	 * Use `InputState::setFilter()` to configure deadband for axes.
+	 */
+	unsigned getInputs(uint8_t reportId, InputState::Input* inputs, unsigned maxCount) const;
+
+	size_t printTo(Print& p) const;
+
+private:
+	struct ReportInfo {
+		uint8_t id;
+		Field::Kind kind;
+		uint16_t bitLength;
+		uint16_t firstField;
+		uint16_t fieldCount;
+	};
+
+	struct Parser;
+
+	bool parseItem(uint8_t header, uint32_t value, unsigned size);
+	ReportInfo* getReport(uint8_t id, Field::Kind kind, bool create);
+	const ReportInfo* findReport(uint8_t id, Field::Kind kind) const;
+
+	std::unique_ptr<Parser> parser;
+	std::unique_ptr<Field[]> fields;
+	ReportInfo reports[maxReports];
+	uint16_t fieldCount{0};
+	uint8_t reportCount{0};
+	bool usesReportIds{false};
+};
+
+} // namespace USB::HID
@@ -0,0 +1,147 @@
+/****
+ * HID/ReportQueue.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if defined(ENABLE_USB_CLASSES) && CFG_TUD_HID
+
+#include "ReportQueue.h"
+
+namespace USB::HID
+{
+namespace
+{
+int32_t readValue(const uint8_t* data, unsigned size)
+{
+	return (size == 2) ? int16_t(data[0] | (data[1] << 8)) : int8_t(data[0]);
+}
+
+void writeValue(uint8_t* data, unsigned size, int32_t value)
+{
+	data[0] = value;
+	if(size == 2) {
+		data[1] = value >> 8;
+	}
+}
+
+} // namespace
+
+bool ReportQueue::setPolicy(uint8_t reportId, Policy policy, uint8_t offset, uint8_t count, uint8_t size)
+{
+	if(policy == Policy::accumulate && (size < 1 || size > 2 || unsigned(offset + count * size) > maxReportSize)) {
+		return false;
+	}
+
+	auto info = const_cast<PolicyInfo*>(findPolicy(reportId));
+	if(!info) {
+		if(policyCount >= maxPolicies) {
+			return false;
+		}
+		info = &policies[policyCount++];
+	}
+	*info = PolicyInfo{reportId, policy, offset, count, size};
+	return true;
+}
+
+const ReportQueue::PolicyInfo* ReportQueue::findPolicy(uint8_t reportId) const
+{
+	for(unsigned i = 0; i < policyCount; ++i) {
+		if(policies[i].reportId == reportId) {
+			return &policies[i];
+		}
+	}
+	return nullptr;
+}
+
+ReportQueue::Entry* ReportQueue::findLast(uint8_t reportId)
+{
+	for(unsigned i = count; i > 0; --i) {
+		auto& entry = entries[(head + i - 1) % capacity];
+		if(entry.reportId == reportId) {
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+/*
+ * Sum relative values into entry, provided other content is unchanged and values don't overflow
+ */
+bool ReportQueue::accumulate(Entry& entry, const PolicyInfo& info, const uint8_t* data)
+{
+	unsigned start = info.offset;
+	unsigned end = start + info.count * info.size;
+	if(memcmp(entry.data, data, start) != 0 || memcmp(&entry.data[end], &data[end], entry.length - end) != 0) {
+		return false;
+	}
+
+	int32_t limit = (info.size == 2) ? INT16_MAX : INT8_MAX;
+	int32_t sums[maxReportSize];
+	for(unsigned i = 0; i < info.count; ++i) {
+		unsigned pos = start + i * info.size;
+		sums[i] = readValue(&entry.data[pos], info.size) + readValue(&data[pos], info.size);
+		if(sums[i] > limit || sums[i] < -limit) {
+			return false;
+		}
+	}
+
+	for(unsigned i = 0; i < info.count; ++i) {
+		writeValue(&entry.data[start + i * info.size], info.size, sums[i]);
+	}
+	return true;
+}
+
+bool ReportQueue::push(uint8_t reportId, const void* data, uint16_t length)
+{
+	if(length > maxReportSize) {
+		return false;
+	}
+
+	auto info = findPolicy(reportId);
+	if(info && info->policy != Policy::queue) {
+		auto entry = findLast(reportId);
+		if(entry && entry->length == length) {
+			if(info->policy == Policy::latest) {
+				memcpy(entry->data, data, length);
+				++mergeCount;
+				return true;
+			}
+			if(length >= info->offset + info->count * info->size &&
+			   accumulate(*entry, *info, static_cast<const uint8_t*>(data))) {
+				++mergeCount;
+				return true;
+			}
+		}
+	}
+
+	if(count == capacity) {
+		return false;
+	}
+
+	auto& entry = entries[(head + count) % capacity];
+	entry.reportId = reportId;
+	entry.length = length;
+	memcpy(entry.data, data, length);
+	++count;
+	return true;
+}
+
+} // namespace USB::HID
+
+#endif
@@ -0,0 +1,141 @@
+/****
+ * HID/ReportQueue.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "../DeviceInterface.h"
+
+namespace USB::HID
+{
+/**
+ * @brief Queue of reports waiting to be sent, merged according to report ID
+ *
+ * A policy may be set for each report ID to determine how a new report is combined with
+ * one already waiting:
+ *
+ * - `queue`: Reports are sent in order. Use for keyboard and consumer control.
+ * - `latest`: Only the most recent state is sent. Use for gamepads and absolute pointers.
+ * - `accumulate`: A run of signed relative values (e.g. mouse X, Y, wheel) is summed.
+ *   Reports are only combined if all other bytes (e.g. buttons) are identical
+ *   and no value overflows, so clicks and large movements are preserved.
+ *
+ * Reports without an explicit policy are queued.
+ */
+class ReportQueue
+{
+public:
+	static constexpr size_t capacity{8};
+	static constexpr size_t maxReportSize{CFG_TUD_HID_EP_BUFSIZE};
+	static constexpr size_t maxPolicies{8};
+
+	enum class Policy : uint8_t {
+		queue,
+		latest,
+		accumulate,
+	};
+
+	struct Entry {
+		uint8_t reportId;
+		uint8_t length;
+		uint8_t data[maxReportSize];
+	};
+
+	/**
+	 * @brief Set merge policy for a report
+	 * @param reportId
+	 * @param policy
+	 * @param offset For `accumulate`, position of first relative value (excluding report ID)
+	 * @param count Number of relative values
+	 * @param size Size of each value in bytes, 1 or 2
+	 * @retval bool false if too many policies
+	 */
+	bool setPolicy(uint8_t reportId, Policy policy, uint8_t offset = 0, uint8_t count = 0, uint8_t size = 1);
+
+	/**
+	 * @brief Get merge policy for a report
+	 */
+	Policy getPolicy(uint8_t reportId) const
+	{
+		auto info = findPolicy(reportId);
+		return info ? info->policy : Policy::queue;
+	}
+
+	/**
+	 * @brief Add or merge a report
+	 * @retval bool false if queue is full or report too large
+	 */
+	bool push(uint8_t reportId, const void* data, uint16_t length);
+
+	/**
+	 * @brief Get next report to send
+	 * @retval Entry* nullptr if queue is empty
+	 */
+	const Entry* peek() const
+	{
+		return (count == 0) ? nullptr : &entries[head];
+	}
+
+	void pop()
+	{
+		if(count != 0) {
+			head = (head + 1) % capacity;
+			--count;
+		}
+	}
+
+	unsigned getCount() const
+	{
+		return count;
+	}
+
+	void clear()
+	{
+		head = count = 0;
+	}
+
+	/**
+	 * @brief Get number of reports combined with an earlier one
+	 */
+	uint32_t getMergeCount() const
+	{
+		return mergeCount;
+	}
+
+private:
+	struct PolicyInfo {
+		uint8_t reportId;
+		Policy policy;
+		uint8_t offset;
+		uint8_t count;
+		uint8_t size;
+	};
+
+	const PolicyInfo* findPolicy(uint8_t reportId) const;
+	Entry* findLast(uint8_t reportId);
+	static bool accumulate(Entry& entry, const PolicyInfo& info, const uint8_t* data);
+
+	Entry entries[capacity];
+	PolicyInfo policies[maxPolicies];
+	uint32_t mergeCount{0};
+	uint8_t policyCount{0};
+	uint8_t head{0};
+	uint8_t count{0};
+};
+
+} // namespace USB::HID
@@ -0,0 +1,171 @@
+/****
+ * HID/TouchScreen.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if defined(ENABLE_USB_CLASSES) && CFG_TUD_HID
+
+#include "TouchScreen.h"
+#include <Platform/Clock.h>
+
+namespace USB::HID
+{
+namespace
+{
+// Scan time and contact count follow the contacts
+constexpr uint8_t trailerSize{3};
+
+} // namespace
+
+void TouchScreen::begin(uint8_t contactCountMax)
+{
+	this->contactCountMax = std::min(contactCountMax, maxContacts);
+	device.addFeature(reportId, [this](uint8_t* buffer, uint16_t length) -> uint16_t {
+		if(length < 1) {
+			return 0;
+		}
+		buffer[0] = this->contactCountMax;
+		return 1;
+	});
+}
+
+TouchScreen::Contact* TouchScreen::findContact(uint8_t id)
+{
+	for(auto& c : contacts) {
+		if(c.active && c.id == id) {
+			return &c;
+		}
+	}
+	return nullptr;
+}
+
+bool TouchScreen::setContact(uint8_t id, uint16_t x, uint16_t y)
+{
+	auto contact = findContact(id);
+	if(contact == nullptr) {
+		unsigned count{0};
+		for(auto& c : contacts) {
+			if(c.active && !c.released) {
+				++count;
+			} else if(contact == nullptr && !c.active) {
+				contact = &c;
+			}
+		}
+		if(contact == nullptr || count >= contactCountMax) {
+			return false;
+		}
+		contact->active = true;
+		contact->id = id;
+	}
+	contact->released = false;
+	contact->x = std::min(x, uint16_t(HID_ABSOLUTE_MAX));
+	contact->y = std::min(y, uint16_t(HID_ABSOLUTE_MAX));
+	return true;
+}
+
+void TouchScreen::release(uint8_t id)
+{
+	auto contact = findContact(id);
+	if(contact != nullptr) {
+		contact->released = true;
+	}
+}
+
+void TouchScreen::releaseAll()
+{
+	for(auto& c : contacts) {
+		if(c.active) {
+			c.released = true;
+		}
+	}
+}
+
+void TouchScreen::commit()
+{
+	if(sending) {
+		// Latest contact state is picked up when current frame completes
+		if(pending) {
+			++coalescedCount;
+		}
+		pending = true;
+		return;
+	}
+
+	sendFrame();
+}
+
+void TouchScreen::sendFrame()
+{
+	frameContacts = 0;
+	for(auto& c : contacts) {
+		if(!c.active) {
+			continue;
+		}
+		frame[frameContacts++] = hid_touch_contact_t{!c.released, c.id, c.x, c.y};
+		if(c.released) {
+			c.active = false;
+		}
+	}
+
+	if(frameContacts == 0) {
+		// Nothing to report, all contacts already lifted
+		return;
+	}
+
+	scanTime = micros() / 100;
+	frameIndex = 0;
+	sending = true;
+	++frameCount;
+	sendNext();
+}
+
+void TouchScreen::sendNext()
+{
+	uint8_t report[HID_TOUCH_MAX_CONTACTS_PER_REPORT * sizeof(hid_touch_contact_t) + trailerSize]{};
+	auto count = std::min(uint8_t(frameContacts - frameIndex), contactsPerReport);
+	memcpy(report, &frame[frameIndex], count * sizeof(hid_touch_contact_t));
+	auto trailer = &report[contactsPerReport * sizeof(hid_touch_contact_t)];
+	trailer[0] = scanTime;
+	trailer[1] = scanTime >> 8;
+	trailer[2] = (frameIndex == 0) ? frameContacts : 0;
+	uint16_t length = trailer + trailerSize - report;
+
+	auto complete = [this, count]() {
+		frameIndex += count;
+		if(frameIndex < frameContacts) {
+			sendNext();
+			return;
+		}
+		sending = false;
+		if(pending) {
+			pending = false;
+			sendFrame();
+		}
+	};
+	if(device.sendReport(reportId, report, length, complete, this)) {
+		return;
+	}
+
+	// Interface busy with another report
+	device.notifyReady(this, [this]() { sendNext(); });
+}
+
+} // namespace USB::HID
+
+#endif
@@ -0,0 +1,144 @@
+/****
+ * HID/TouchScreen.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "Device.h"
+#include "ReportDescriptors.h"
+
+namespace USB::HID
+{
+/**
+ * @brief Multi-touch screen using the `touchscreen` report
+ *
+ * Contacts are updated at any rate using `setContact()` and `release()`, then `commit()`
+ * marks the end of a frame. Frames are sent in hybrid mode: each report carries several
+ * contacts, and a frame with more contacts than fit in one report is split across reports
+ * sharing the same scan time. The first report gives the total contact count, the others zero.
+ *
+ * If a frame is still being sent when the next is committed, updates are coalesced
+ * so only the latest position of each contact is sent. A released contact is reported
+ * once with its tip switch cleared, then its slot becomes free.
+ *
+ * With 64-byte reports all 10 contacts fit in one report, so a full frame needs a single
+ * interrupt transfer and the frame rate is limited only by the polling interval.
+ */
+class TouchScreen
+{
+public:
+	static constexpr uint8_t maxContacts{16};
+
+	/**
+	 * @brief Constructor
+	 * @param device HID interface
+	 * @param reportId Report ID for touch screen reports
+	 * @param contactsPerReport As given in report descriptor (HID_TOUCH_CONTACTS_PER_REPORT)
+	 */
+	TouchScreen(Device& device, uint8_t reportId, uint8_t contactsPerReport)
+		: device(device), reportId(reportId),
+		  contactsPerReport(std::min(contactsPerReport, uint8_t(HID_TOUCH_MAX_CONTACTS_PER_REPORT)))
+	{
+	}
+
+	~TouchScreen()
+	{
+		device.cancelNotifyReady(this);
+		device.cancelReportComplete(this);
+	}
+
+	/**
+	 * @brief Register contact count feature report
+	 * @param contactCountMax Maximum number of simultaneous contacts
+	 */
+	void begin(uint8_t contactCountMax = maxContacts);
+
+	/**
+	 * @brief Set position of a contact, which becomes active if not already
+	 * @param id Contact identifier (0-127)
+	 * @param x Horizontal position, 0 to HID_ABSOLUTE_MAX
+	 * @param y Vertical position, 0 to HID_ABSOLUTE_MAX
+	 * @retval bool false if there are already `contactCountMax` active contacts
+	 */
+	bool setContact(uint8_t id, uint16_t x, uint16_t y);
+
+	/**
+	 * @brief Release a contact
+	 */
+	void release(uint8_t id);
+
+	/**
+	 * @brief Release all contacts
+	 */
+	void releaseAll();
+
+	/**
+	 * @brief Submit current state of contacts as a frame
+	 */
+	void commit();
+
+	/**
+	 * @brief Number of frames sent
+	 */
+	uint32_t getFrameCount() const
+	{
+		return frameCount;
+	}
+
+	/**
+	 * @brief Number of committed frames merged into a later frame
+	 */
+	uint32_t getCoalescedCount() const
+	{
+		return coalescedCount;
+	}
+
+	bool isBusy() const
+	{
+		return sending;
+	}
+
+private:
+	struct Contact {
+		uint16_t x;
+		uint16_t y;
+		uint8_t id;
+		bool active;   ///< Slot in use
+		bool released; ///< Send once with tip clear, then free slot
+	};
+
+	Contact* findContact(uint8_t id);
+	void sendFrame();
+	void sendNext();
+
+	Device& device;
+	Contact contacts[maxContacts]{};
+	hid_touch_contact_t frame[maxContacts]; ///< Contacts being sent
+	uint32_t frameCount{0};
+	uint32_t coalescedCount{0};
+	uint16_t scanTime{0};
+	uint8_t reportId;
+	uint8_t contactsPerReport;
+	uint8_t contactCountMax{maxContacts};
+	uint8_t frameContacts{0}; ///< Contacts in current frame
+	uint8_t frameIndex{0};	///< Next contact to send
+	bool sending{false};
+	bool pending{false};
+};
+
+} // namespace USB::HID
@@ -0,0 +1,220 @@
+/****
+ * HID/Typist.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if defined(ENABLE_USB_CLASSES) && CFG_TUD_HID
+
+#include "Typist.h"
+
+namespace USB::HID
+{
+namespace
+{
+const uint8_t asciiToKeycode[128][2]{HID_ASCII_TO_KEYCODE};
+
+} // namespace
+
+bool Typist::Batch::contains(uint8_t key) const
+{
+	for(unsigned i = 0; i < count; ++i) {
+		if(keys[i] == key) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Typist::setNkro(uint8_t reportId, uint8_t bitmapSize)
+{
+	nkroReportId = reportId;
+	this->bitmapSize = std::min(bitmapSize, uint8_t(CFG_TUD_HID_EP_BUFSIZE - 1));
+}
+
+bool Typist::type(const String& text, Complete callback)
+{
+	if(busy) {
+		return false;
+	}
+
+	this->text = text;
+	this->callback = callback;
+	position = 0;
+	reportCount = 0;
+	current = {};
+	nextReady = false;
+	busy = true;
+	sendNext();
+	return true;
+}
+
+void Typist::stop()
+{
+	if(!busy) {
+		return;
+	}
+
+	// Remaining keys are released by next report
+	text = nullptr;
+	position = 0;
+	nextReady = false;
+	if(!inFlight) {
+		device.cancelNotifyReady(this);
+		sendNext();
+	}
+}
+
+/*
+ * Collect as many characters as can be sent in one report
+ */
+bool Typist::nextBatch()
+{
+	unsigned maxKeys = bitmapSize ? maxNkroKeys : maxBootKeys;
+	next = {};
+	while(position < text.length() && next.count < maxKeys) {
+		uint8_t c = text[position];
+		if(c >= ARRAY_SIZE(asciiToKeycode) || asciiToKeycode[c][1] == 0) {
+			debug_d("[HID] Cannot type 0x%02x", c);
+			++position;
+			continue;
+		}
+		uint8_t modifier = asciiToKeycode[c][0] ? KEYBOARD_MODIFIER_LEFTSHIFT : 0;
+		uint8_t key = asciiToKeycode[c][1];
+		if(bitmapSize != 0 && key / 8 >= bitmapSize) {
+			debug_d("[HID] Key 0x%02x outside NKRO bitmap", key);
+			++position;
+			continue;
+		}
+		if(next.count != 0) {
+			if(modifier != next.modifier) {
+				break;
+			}
+			// Bitmap is scanned by host in usage order
+			if(bitmapSize ? (key <= next.keys[next.count - 1]) : next.contains(key)) {
+				break;
+			}
+		}
+		next.modifier = modifier;
+		next.keys[next.count++] = key;
+		++position;
+	}
+	return next.count != 0;
+}
+
+/*
+ * Next batch can't follow current one directly if any key is still held,
+ * or modifiers change
+ */
+bool Typist::conflicts() const
+{
+	if(current.count == 0) {
+		return false;
+	}
+	if(next.modifier != current.modifier) {
+		return true;
+	}
+	for(unsigned i = 0; i < next.count; ++i) {
+		if(current.contains(next.keys[i])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Typist::sendNext()
+{
+	if(!busy) {
+		return;
+	}
+
+	if(!nextReady) {
+		nextReady = nextBatch();
+	}
+
+	if(!nextReady) {
+		// All done, release keys
+		if(current.count == 0 && current.modifier == 0) {
+			finish();
+		} else if(send(Batch{})) {
+			current = {};
+		}
+		return;
+	}
+
+	if(conflicts()) {
+		if(send(Batch{})) {
+			current = {};
+		}
+		return;
+	}
+
+	if(send(next)) {
+		current = next;
+		nextReady = false;
+	}
+}
+
+bool Typist::send(const Batch& batch)
+{
+	uint8_t report[CFG_TUD_HID_EP_BUFSIZE]{};
+	uint8_t id;
+	uint16_t length;
+	if(bitmapSize != 0) {
+		id = nkroReportId;
+		report[0] = batch.modifier;
+		for(unsigned i = 0; i < batch.count; ++i) {
+			auto key = batch.keys[i];
+			report[1 + key / 8] |= 1 << (key % 8);
+		}
+		length = 1 + bitmapSize;
+	} else {
+		id = reportId;
+		auto kbd = reinterpret_cast<hid_keyboard_report_t*>(report);
+		kbd->modifier = batch.modifier;
+		memcpy(kbd->keycode, batch.keys, batch.count);
+		length = sizeof(hid_keyboard_report_t);
+	}
+
+	auto complete = [this]() {
+		inFlight = false;
+		sendNext();
+	};
+	if(device.sendReport(id, report, length, complete, this)) {
+		inFlight = true;
+		++reportCount;
+		return true;
+	}
+
+	// Interface busy or host hasn't polled yet
+	device.notifyReady(this, [this]() { sendNext(); });
+	return false;
+}
+
+void Typist::finish()
+{
+	busy = false;
+	text = nullptr;
+	if(callback) {
+		callback(*this);
+	}
+}
+
+} // namespace USB::HID
+
+#endif
@@ -0,0 +1,131 @@
+/****
+ * HID/Typist.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "Device.h"
+
+namespace USB::HID
+{
+/**
+ * @brief Types text using a HID keyboard interface
+ *
+ * Several characters are sent in each report, so text is typed much faster than with
+ * one key press and release per character. The host generates characters in the order
+ * keys appear in the report:
+ *
+ * - Boot reports contain up to 6 keys, in text order.
+ * - NKRO (bitmap) reports are scanned in usage order, so a report contains a run
+ *   of characters with increasing key codes.
+ *
+ * All keys in a report must share the same modifiers (i.e. shift state) and be distinct.
+ * A release report is only sent when the next group of keys cannot follow directly,
+ * because a key is repeated or the modifiers change.
+ *
+ * Only ASCII characters are supported, mapped using a US keyboard layout.
+ */
+class Typist
+{
+public:
+	using Complete = Delegate<void(Typist& typist)>;
+
+	/**
+	 * @brief Constructor
+	 * @param device Keyboard interface
+	 * @param reportId Report ID for keyboard reports, 0 if not used
+	 */
+	Typist(Device& device, uint8_t reportId) : device(device), reportId(reportId)
+	{
+	}
+
+	~Typist()
+	{
+		device.cancelNotifyReady(this);
+		device.cancelReportComplete(this);
+	}
+
+	/**
+	 * @brief Use NKRO report format instead of boot format
+	 * @param reportId Report ID for NKRO report
+	 * @param bitmapSize Bytes in key bitmap, which covers usages from 0
+	 *
+	 * The report must consist of a modifier byte followed by the bitmap.
+	 */
+	void setNkro(uint8_t reportId, uint8_t bitmapSize);
+
+	/**
+	 * @brief Start typing
+	 * @param text
+	 * @param callback Invoked when all keys have been released
+	 * @retval bool false if already typing
+	 */
+	bool type(const String& text, Complete callback = nullptr);
+
+	/**
+	 * @brief Stop typing, releasing all keys
+	 */
+	void stop();
+
+	bool isBusy() const
+	{
+		return busy;
+	}
+
+	/**
+	 * @brief Get number of reports sent for current (or last) text
+	 */
+	unsigned getReportCount() const
+	{
+		return reportCount;
+	}
+
+private:
+	static constexpr uint8_t maxBootKeys{6};
+	static constexpr uint8_t maxNkroKeys{32};
+
+	struct Batch {
+		uint8_t modifier;
+		uint8_t count;
+		uint8_t keys[maxNkroKeys];
+
+		bool contains(uint8_t key) const;
+	};
+
+	bool nextBatch();
+	bool conflicts() const;
+	void sendNext();
+	bool send(const Batch& batch);
+	void finish();
+
+	Device& device;
+	Complete callback;
+	String text;
+	Batch current{};
+	Batch next{};
+	unsigned position{0};
+	unsigned reportCount{0};
+	uint8_t reportId;
+	uint8_t nkroReportId{0};
+	uint8_t bitmapSize{0};
+	bool nextReady{false};
+	bool inFlight{false};
+	bool busy{false};
+};
+
+} // namespace USB::HID
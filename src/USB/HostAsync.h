@@ -0,0 +1,206 @@
+/****
+ * HostAsync.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Coroutine support for host transfers. Requires C++20.
+ *
+ ****/
+
+#pragma once
+
+#include "HostInterface.h"
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <cstdlib>
+
+#if !CFG_TUH_API_EDPT_XFER
+#error "USB/HostAsync.h requires CFG_TUH_API_EDPT_XFER"
+#endif
+
+/**
+ * @brief Defined when coroutine support is available
+ */
+#define USB_HOST_ASYNC 1
+
+namespace USB::Async
+{
+/**
+ * @brief Result of an awaited transfer
+ */
+struct Result {
+	xfer_result_t result;
+	uint32_t length; ///< Number of bytes transferred
+
+	explicit operator bool() const
+	{
+		return result == XFER_RESULT_SUCCESS;
+	}
+};
+
+/**
+ * @brief Return type for coroutines which run independently of their caller
+ *
+ * The coroutine starts immediately and its frame is released when it returns.
+ */
+struct Task {
+	struct promise_type {
+		Task get_return_object()
+		{
+			return {};
+		}
+
+		std::suspend_never initial_suspend() noexcept
+		{
+			return {};
+		}
+
+		std::suspend_never final_suspend() noexcept
+		{
+			return {};
+		}
+
+		void return_void()
+		{
+		}
+
+		void unhandled_exception()
+		{
+			abort();
+		}
+	};
+};
+
+/**
+ * @brief Awaits a control transfer, issued via the device control queue
+ */
+class ControlAwaiter
+{
+public:
+	ControlAwaiter(HostInterface& itf, const tusb_control_request_t& request, void* buffer)
+		: itf(itf), request(request), buffer(buffer)
+	{
+	}
+
+	bool await_ready() const noexcept
+	{
+		return false;
+	}
+
+	bool await_suspend(std::coroutine_handle<> handle)
+	{
+		// Don't suspend if the request wasn't queued
+		return itf.controlTransfer(request, buffer, [this, handle](const tuh_xfer_t& xfer) {
+			result = {xfer.result, xfer.actual_len};
+			handle.resume();
+		});
+	}
+
+	Result await_resume() const noexcept
+	{
+		return result;
+	}
+
+private:
+	HostInterface& itf;
+	tusb_control_request_t request;
+	void* buffer;
+	Result result{XFER_RESULT_FAILED, 0};
+};
+
+/**
+ * @brief Awaits a bulk or interrupt transfer on an endpoint
+ */
+class TransferAwaiter
+{
+public:
+	TransferAwaiter(uint8_t dev_addr, uint8_t ep_addr, void* buffer, uint16_t length)
+		: buffer(buffer), length(length), dev_addr(dev_addr), ep_addr(ep_addr)
+	{
+	}
+
+	bool await_ready() const noexcept
+	{
+		return false;
+	}
+
+	bool await_suspend(std::coroutine_handle<> handle)
+	{
+		this->handle = handle;
+		tuh_xfer_t xfer{};
+		xfer.daddr = dev_addr;
+		xfer.ep_addr = ep_addr;
+		xfer.buflen = length;
+		xfer.buffer = static_cast<uint8_t*>(buffer);
+		xfer.complete_cb = transferComplete;
+		xfer.user_data = uintptr_t(this);
+		return tuh_edpt_xfer(&xfer);
+	}
+
+	Result await_resume() const noexcept
+	{
+		return result;
+	}
+
+private:
+	static void transferComplete(tuh_xfer_t* xfer)
+	{
+		auto self = reinterpret_cast<TransferAwaiter*>(xfer->user_data);
+		self->result = {xfer->result, xfer->actual_len};
+		self->handle.resume();
+	}
+
+	std::coroutine_handle<> handle;
+	void* buffer;
+	Result result{XFER_RESULT_FAILED, 0};
+	uint16_t length;
+	uint8_t dev_addr;
+	uint8_t ep_addr;
+};
+
+/**
+ * @brief Issue a control transfer and wait for completion
+ * @param itf Interface making the request
+ * @param request Setup packet
+ * @param buffer For data stage
+ *
+ * Requests are queued so several coroutines may use the control pipe at once.
+ * If the interface is closed whilst waiting the result is XFER_RESULT_FAILED.
+ */
+inline ControlAwaiter control(HostInterface& itf, const tusb_control_request_t& request, void* buffer = nullptr)
+{
+	return ControlAwaiter(itf, request, buffer);
+}
+
+/**
+ * @brief Transfer data on an endpoint and wait for completion
+ * @param itf Interface owning the endpoint, which must be open
+ * @param ep_addr Direction is given by bit 7
+ * @param buffer Data to send, or where to store received data
+ * @param length Size of data, or of buffer
+ *
+ * If the device is disconnected whilst waiting, the coroutine is never resumed
+ * so its frame, and anything it owns, is leaked.
+ */
+inline TransferAwaiter transfer(HostInterface& itf, uint8_t ep_addr, void* buffer, uint16_t length)
+{
+	return TransferAwaiter(itf.getAddress(), ep_addr, buffer, length);
+}
+
+} // namespace USB::Async
+
+#endif
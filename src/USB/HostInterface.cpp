@@ -0,0 +1,255 @@
+/****
+ * HostInterface.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if CFG_TUH_ENABLED
+
+#include "HostInterface.h"
+#include <SimpleTimer.h>
+#include <debug_progmem.h>
+#include <memory>
+
+namespace USB
+{
+namespace
+{
+constexpr uint32_t retryDelayMs{1};
+
+struct ControlRequest {
+	ControlRequest* next;
+	const HostInterface* owner; ///< nullptr if cancelled
+	tusb_control_request_t setup;
+	uint8_t* buffer;
+	HostInterface::ControlCallback callback;
+	std::unique_ptr<uint8_t[]> data; ///< Data stage, owned by queue so callers may release their buffer on cancel
+};
+
+/*
+ * Requests for one device. `active` is owned by TinyUSB until it completes, even if cancelled.
+ */
+struct ControlQueue {
+	ControlRequest* head;
+	ControlRequest* tail;
+	ControlRequest* active;
+	uint8_t seq; ///< Identifies active transfer, so stale completions are ignored
+};
+
+// Hubs also have addresses
+ControlQueue controlQueues[CFG_TUH_DEVICE_MAX + CFG_TUH_HUB];
+SimpleTimer retryTimer;
+
+ControlQueue* getQueue(uint8_t dev_addr)
+{
+	unsigned idx = dev_addr - 1;
+	return (idx < ARRAY_SIZE(controlQueues)) ? &controlQueues[idx] : nullptr;
+}
+
+/*
+ * Detach request from its owner and report failure. The request may then be retained until TinyUSB is done with it.
+ */
+void cancelRequest(uint8_t dev_addr, ControlRequest& req)
+{
+	auto callback = req.callback;
+	auto buffer = req.buffer;
+	req.owner = nullptr;
+	req.callback = nullptr;
+	req.buffer = nullptr;
+	if(callback) {
+		tuh_xfer_t xfer{};
+		xfer.daddr = dev_addr;
+		xfer.result = XFER_RESULT_FAILED;
+		xfer.setup = &req.setup;
+		xfer.buffer = buffer;
+		callback(xfer);
+	}
+}
+
+void submit(uint8_t dev_addr);
+
+void controlComplete(tuh_xfer_t* xfer)
+{
+	uint8_t dev_addr = xfer->user_data;
+	uint8_t seq = xfer->user_data >> 8;
+	auto queue = getQueue(dev_addr);
+	if(queue == nullptr || queue->active == nullptr || queue->seq != seq) {
+		return;
+	}
+
+	std::unique_ptr<ControlRequest> req(queue->active);
+	queue->active = nullptr;
+
+	// Keep control pipe busy whilst callback runs
+	submit(dev_addr);
+
+	if(req->owner == nullptr) {
+		// Cancelled
+		return;
+	}
+	if(req->setup.bmRequestType_bit.direction == TUSB_DIR_IN && req->buffer && xfer->actual_len != 0) {
+		memcpy(req->buffer, req->data.get(), xfer->actual_len);
+	}
+	if(req->callback) {
+		// TinyUSB's copy of the setup packet is overwritten by the next submission
+		tuh_xfer_t result = *xfer;
+		result.setup = &req->setup;
+		result.buffer = req->buffer;
+		req->callback(result);
+	}
+}
+
+void retry(void*)
+{
+	bool pending{false};
+	for(unsigned i = 0; i < ARRAY_SIZE(controlQueues); ++i) {
+		auto& queue = controlQueues[i];
+		if(queue.head && !queue.active) {
+			submit(i + 1);
+			pending |= !queue.active;
+		}
+	}
+	if(pending) {
+		retryTimer.startOnce();
+	}
+}
+
+void submit(uint8_t dev_addr)
+{
+	auto queue = getQueue(dev_addr);
+	if(queue == nullptr || queue->active || queue->head == nullptr) {
+		return;
+	}
+
+	auto req = queue->head;
+	uint8_t seq = queue->seq + 1;
+	tuh_xfer_t xfer{};
+	xfer.daddr = dev_addr;
+	xfer.ep_addr = 0;
+	xfer.setup = &req->setup;
+	xfer.buffer = req->data.get();
+	xfer.complete_cb = controlComplete;
+	xfer.user_data = dev_addr | (seq << 8);
+	if(!tuh_control_xfer(&xfer)) {
+		// Pipe in use by enumeration or another device
+		if(!retryTimer.isStarted()) {
+			retryTimer.initializeMs<retryDelayMs>(retry).startOnce();
+		}
+		return;
+	}
+	queue->head = req->next;
+	if(queue->head == nullptr) {
+		queue->tail = nullptr;
+	}
+	req->next = nullptr;
+	queue->seq = seq;
+	queue->active = req;
+}
+
+} // namespace
+
+bool HostInterface::controlTransfer(const tusb_control_request_t& request, void* buffer, ControlCallback callback)
+{
+	auto queue = getQueue(inst.dev_addr);
+	if(queue == nullptr) {
+		return false;
+	}
+
+	auto req = new ControlRequest{nullptr, this, request, static_cast<uint8_t*>(buffer), callback, nullptr};
+	if(req == nullptr) {
+		return false;
+	}
+	uint16_t length = tu_le16toh(request.wLength);
+	if(length != 0) {
+		req->data.reset(new uint8_t[length]);
+		if(!req->data) {
+			delete req;
+			return false;
+		}
+		if(request.bmRequestType_bit.direction == TUSB_DIR_OUT) {
+			memcpy(req->data.get(), buffer, length);
+		}
+	}
+
+	if(queue->tail) {
+		queue->tail->next = req;
+	} else {
+		queue->head = req;
+	}
+	queue->tail = req;
+
+	submit(inst.dev_addr);
+	return true;
+}
+
+void HostInterface::cancelControlTransfers(uint8_t dev_addr, bool closed)
+{
+	auto queue = getQueue(dev_addr);
+	if(queue == nullptr) {
+		return;
+	}
+
+	// Detach requests first, as callbacks may queue more
+	ControlRequest* cancelled{nullptr};
+	ControlRequest** link = &cancelled;
+	ControlRequest* prev{nullptr};
+	for(auto req = queue->head; req;) {
+		auto next = req->next;
+		if(!closed && req->owner != this) {
+			prev = req;
+		} else {
+			if(prev) {
+				prev->next = next;
+			} else {
+				queue->head = next;
+			}
+			req->next = nullptr;
+			*link = req;
+			link = &req->next;
+		}
+		req = next;
+	}
+	queue->tail = prev;
+
+	auto active = queue->active;
+	if(active && closed) {
+		// TinyUSB has closed the device so won't complete the transfer
+		queue->active = nullptr;
+		*link = active;
+	}
+
+	while(cancelled) {
+		auto req = cancelled;
+		cancelled = req->next;
+		cancelRequest(dev_addr, *req);
+		delete req;
+	}
+
+	if(active && !closed && active->owner == this) {
+		// Request and its data buffer are released when TinyUSB completes the transfer
+		cancelRequest(dev_addr, *active);
+	}
+
+	if(!closed) {
+		submit(dev_addr);
+	}
+}
+
+} // namespace USB
+
+#endif
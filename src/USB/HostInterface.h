@@ -51,13 +51,21 @@ public:
 		this->inst = inst;
 	}
 
+	/**
+	 * @brief Callback for queued control transfers
+	 * @param xfer Transfer details, including result and actual_len
+	 */
+	using ControlCallback = Delegate<void(const tuh_xfer_t& xfer)>;
+
 	/**
 	 * @brief Called when device is disconnected. Override as required.
 	 */
 	virtual void end()
 	{
+		auto dev_addr = inst.dev_addr;
 		inst.dev_addr = 255;
 		inst.idx = 255;
+		cancelControlTransfers(dev_addr, true);
 	}
 
 	const char* getName() const
@@ -80,8 +88,41 @@ public:
 		return inst == other;
 	}
 
+	/**
+	 * @brief Queue a control transfer
+	 * @param request Setup packet, copied
+	 * @param buffer For data stage, must remain valid until completion or cancellation
+	 * @param callback Invoked on completion (optional)
+	 * @retval bool false if interface is not mounted
+	 *
+	 * Each device has one control pipe, shared by all its interfaces. Requests from
+	 * every interface on a device are queued and issued in turn, so several may be
+	 * submitted without waiting for the previous one to complete.
+	 *
+	 * The queue uses its own copy of the data: OUT data is copied when queued,
+	 * and IN data is copied to `buffer` on completion.
+	 */
+	bool controlTransfer(const tusb_control_request_t& request, void* buffer, ControlCallback callback = nullptr);
+
+	/**
+	 * @brief Discard queued control transfers for this interface
+	 *
+	 * Callbacks are invoked with XFER_RESULT_FAILED, after which buffers are no longer accessed.
+	 * A transfer in progress is left to complete but its result is discarded.
+	 */
+	void cancelControlTransfers()
+	{
+		cancelControlTransfers(inst.dev_addr, false);
+	}
+
 protected:
 	Instance inst;
+
+private:
+	/*
+	 * If device has been closed then all its requests are cancelled, whatever the owning interface.
+	 */
+	void cancelControlTransfers(uint8_t dev_addr, bool closed);
 };
 
 } // namespace USB
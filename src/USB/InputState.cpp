@@ -0,0 +1,233 @@
+/****
+ * InputState.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if CFG_TUH_ENABLED
+
+#include "InputState.h"
+
+namespace USB
+{
+// Run of adjacent 1-bit inputs, compared as a single word
+struct InputState::Buttons {
+	uint16_t bitOffset;
+	uint8_t bitCount;
+	uint8_t firstInput;
+	uint32_t state;
+};
+
+struct InputState::Axis {
+	uint16_t bitOffset;
+	uint8_t bitSize;
+	bool isSigned;
+	uint8_t input;
+	uint16_t deadzone;
+	uint16_t threshold;
+};
+
+namespace
+{
+bool readBits(const uint8_t* data, size_t length, unsigned bitOffset, unsigned bitSize, uint32_t& value)
+{
+	unsigned byteOffset = bitOffset / 8;
+	unsigned shift = bitOffset % 8;
+	unsigned byteCount = (shift + bitSize + 7) / 8;
+	if(byteOffset + byteCount > length) {
+		return false;
+	}
+
+	data += byteOffset;
+	uint64_t raw{0};
+	for(unsigned i = 0; i < byteCount; ++i) {
+		raw |= uint64_t(data[i]) << (i * 8);
+	}
+	raw >>= shift;
+	if(bitSize < 32) {
+		raw &= (1U << bitSize) - 1;
+	}
+	value = raw;
+	return true;
+}
+
+} // namespace
+
+/*
+ * Count button groups, filling in table if provided
+ */
+unsigned InputState::groupButtons(const Input* inputs, unsigned count, Buttons* groups)
+{
+	unsigned groupCount{0};
+	bool inGroup{false};
+	uint16_t nextOffset{0};
+	uint8_t groupSize{0};
+	for(unsigned i = 0; i < count; ++i) {
+		auto& input = inputs[i];
+		if(input.bitSize != 1) {
+			inGroup = false;
+			continue;
+		}
+		if(inGroup && input.bitOffset == nextOffset && groupSize < 32) {
+			++groupSize;
+			if(groups) {
+				++groups[groupCount - 1].bitCount;
+			}
+		} else {
+			if(groups) {
+				groups[groupCount] = {input.bitOffset, 1, uint8_t(i), 0};
+			}
+			++groupCount;
+			groupSize = 1;
+			inGroup = true;
+		}
+		nextOffset = input.bitOffset + 1;
+	}
+	return groupCount;
+}
+
+InputState::InputState() = default;
+InputState::~InputState() = default;
+
+bool InputState::begin(const Input* inputs, unsigned count, uint8_t reportId)
+{
+	end();
+
+	if(count == 0 || count > maxInputs) {
+		return false;
+	}
+
+	unsigned axisCount{0};
+	for(unsigned i = 0; i < count; ++i) {
+		auto size = inputs[i].bitSize;
+		if(size == 0 || size > 32) {
+			debug_e("[INPUT] Input %u has invalid size %u", i, size);
+			return false;
+		}
+		if(size > 1) {
+			++axisCount;
+		}
+	}
+
+	unsigned buttonCount = groupButtons(inputs, count, nullptr);
+	buttons.reset(new Buttons[buttonCount]);
+	groupButtons(inputs, count, buttons.get());
+
+	axes.reset(new Axis[axisCount]);
+	unsigned n{0};
+	for(unsigned i = 0; i < count; ++i) {
+		auto& input = inputs[i];
+		if(input.bitSize > 1) {
+			axes[n++] = {input.bitOffset, input.bitSize, input.isSigned, uint8_t(i), input.deadzone, input.threshold};
+		}
+	}
+
+	values.reset(new int32_t[count]{});
+	inputCount = count;
+	this->buttonCount = buttonCount;
+	this->axisCount = axisCount;
+	this->reportId = reportId;
+
+	debug_d("[INPUT] %u inputs, %u button groups, %u axes", count, buttonCount, axisCount);
+	return true;
+}
+
+void InputState::end()
+{
+	buttons.reset();
+	axes.reset();
+	values.reset();
+	inputCount = buttonCount = axisCount = 0;
+	reportId = 0;
+}
+
+void InputState::setFilter(unsigned index, uint16_t deadzone, uint16_t threshold)
+{
+	for(unsigned i = 0; i < axisCount; ++i) {
+		auto& axis = axes[i];
+		if(axis.input == index) {
+			axis.deadzone = deadzone;
+			axis.threshold = threshold;
+			break;
+		}
+	}
+}
+
+InputState::Mask InputState::update(const void* data, size_t length)
+{
+	auto report = static_cast<const uint8_t*>(data);
+	if(reportId != 0 && (length == 0 || report[0] != reportId)) {
+		return 0;
+	}
+
+	Mask changed{0};
+
+	for(unsigned i = 0; i < buttonCount; ++i) {
+		auto& group = buttons[i];
+		uint32_t word;
+		if(!readBits(report, length, group.bitOffset, group.bitCount, word)) {
+			continue;
+		}
+		uint32_t diff = word ^ group.state;
+		if(diff == 0) {
+			continue;
+		}
+		group.state = word;
+		changed |= Mask(diff) << group.firstInput;
+		while(diff != 0) {
+			unsigned bit = __builtin_ctz(diff);
+			diff &= diff - 1;
+			values[group.firstInput + bit] = (word >> bit) & 1;
+		}
+	}
+
+	for(unsigned i = 0; i < axisCount; ++i) {
+		auto& axis = axes[i];
+		uint32_t raw;
+		if(!readBits(report, length, axis.bitOffset, axis.bitSize, raw)) {
+			continue;
+		}
+		int32_t value = raw;
+		if(axis.isSigned && axis.bitSize < 32) {
+			uint32_t signBit = 1U << (axis.bitSize - 1);
+			value = int32_t((raw ^ signBit) - signBit);
+		}
+		if(abs(value) <= axis.deadzone) {
+			value = 0;
+		}
+		auto& current = values[axis.input];
+		if(value == current) {
+			continue;
+		}
+		if(value != 0 && llabs(int64_t(value) - current) < axis.threshold) {
+			continue;
+		}
+		current = value;
+		changed |= Mask(1) << axis.input;
+	}
+
+	if(changed && changeCallback) {
+		changeCallback(changed);
+	}
+
+	return changed;
+}
+
+} // namespace USB
+
+#endif
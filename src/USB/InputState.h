@@ -0,0 +1,132 @@
+/****
+ * InputState.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "Descriptors.h"
+#include <memory>
+
+namespace USB
+{
+/**
+ * @brief Tracks state of buttons and axes in input reports, notifying only significant changes
+ *
+ * The report layout is described once as a list of inputs, each giving the position and size
+ * of a value within the report. This is compiled so that runs of adjacent 1-bit inputs (buttons)
+ * are compared a word at a time, and wider inputs (axes) are filtered:
+ *
+ * - Values within `deadzone` of zero are treated as zero
+ * - Changes smaller than `threshold` from the last reported value are ignored (hysteresis).
+ *   A return to zero is always reported.
+ *
+ * Suitable for both HID reports (see `HID::ReportMap::getInputs()`) and vendor-specific packets.
+ */
+class InputState
+{
+public:
+	static constexpr size_t maxInputs{64};
+
+	/**
+	 * @brief Bit mask of inputs, bit 0 corresponds to first input
+	 */
+	using Mask = uint64_t;
+
+	using ChangeCallback = Delegate<void(Mask changed)>;
+
+	/**
+	 * @brief Describes one input value
+	 */
+	struct Input {
+		uint16_t bitOffset; ///< Position from start of report, including report ID if used
+		uint8_t bitSize;	///< 1 to 32 bits
+		bool isSigned;
+		uint16_t deadzone;  ///< Values with magnitude up to this are reported as 0
+		uint16_t threshold; ///< Minimum change to report
+	};
+
+	InputState();
+	~InputState();
+
+	/**
+	 * @brief Compile report layout
+	 * @param inputs List of inputs, up to `maxInputs`
+	 * @param count Number of inputs
+	 * @param reportId If non-zero, only reports starting with this ID are processed
+	 * @retval bool false if layout is invalid
+	 */
+	bool begin(const Input* inputs, unsigned count, uint8_t reportId = 0);
+
+	void end();
+
+	/**
+	 * @brief Set filtering for an axis
+	 */
+	void setFilter(unsigned index, uint16_t deadzone, uint16_t threshold);
+
+	/**
+	 * @brief Set callback to be invoked when `update()` detects changes
+	 */
+	void onChange(ChangeCallback callback)
+	{
+		changeCallback = callback;
+	}
+
+	/**
+	 * @brief Process a report
+	 * @param data
+	 * @param length Inputs beyond end of report are left unchanged
+	 * @retval Mask Inputs which have changed
+	 */
+	Mask update(const void* data, size_t length);
+
+	/**
+	 * @brief Get last reported value of an input
+	 */
+	int32_t getValue(unsigned index) const
+	{
+		return (index < inputCount) ? values[index] : 0;
+	}
+
+	int32_t operator[](unsigned index) const
+	{
+		return getValue(index);
+	}
+
+	unsigned getInputCount() const
+	{
+		return inputCount;
+	}
+
+private:
+	struct Buttons;
+	struct Axis;
+
+	static unsigned groupButtons(const Input* inputs, unsigned count, Buttons* groups);
+
+	std::unique_ptr<Buttons[]> buttons;
+	std::unique_ptr<Axis[]> axes;
+	std::unique_ptr<int32_t[]> values;
+	ChangeCallback changeCallback;
+	uint8_t inputCount{0};
+	uint8_t buttonCount{0};
+	uint8_t axisCount{0};
+	uint8_t reportId{0};
+};
+
+} // namespace USB
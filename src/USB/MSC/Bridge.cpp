@@ -0,0 +1,312 @@
+/****
+ * MSC/Bridge.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if defined(ENABLE_USB_CLASSES) && CFG_TUD_MSC && CFG_TUH_MSC
+
+#include "Bridge.h"
+#include <debug_progmem.h>
+
+namespace USB::MSC
+{
+Bridge::Bridge(HostDevice& host, uint8_t lun, size_t bufferSize) : host(host), bufferSize(bufferSize), lun(lun)
+{
+	// Upstream requests must fit within a single buffer
+	this->bufferSize = std::max(this->bufferSize, uint32_t(CFG_TUD_MSC_EP_BUFSIZE));
+	for(auto& buf : buffers) {
+		buf.data.reset(new uint8_t[this->bufferSize]);
+	}
+}
+
+void Bridge::reset()
+{
+	waitWrites();
+	for(auto& buf : buffers) {
+		buf.state = Buffer::State::empty;
+		buf.length = 0;
+	}
+}
+
+String Bridge::getName() const
+{
+	auto unit = host[lun];
+	return unit ? unit->getName() : F("bridge");
+}
+
+bool Bridge::isReady() const
+{
+	return host.getAddress() != 255 && host[lun] != nullptr;
+}
+
+void Bridge::getCapacity(uint32_t& blockCount, uint16_t& blockSize) const
+{
+	blockCount = host.getSectorCount(lun);
+	blockSize = host.getSectorSize(lun);
+}
+
+/*
+ * Find a buffer which can be re-used. Completed reads are preferred over buffers
+ * which are still being written downstream, as those require waiting.
+ */
+Bridge::Buffer* Bridge::getFreeBuffer(const Buffer* exclude)
+{
+	Buffer* writing{};
+	for(auto& buf : buffers) {
+		if(&buf == exclude) {
+			continue;
+		}
+		switch(buf.state) {
+		case Buffer::State::empty:
+		case Buffer::State::valid:
+		case Buffer::State::failed:
+			return &buf;
+		case Buffer::State::writing:
+			writing = &buf;
+			break;
+		default:;
+		}
+	}
+
+	if(writing) {
+		waitWrites();
+	}
+	return writing;
+}
+
+void Bridge::waitWrites()
+{
+	if(!host.wait()) {
+		debug_e("[MSC] Bridge write failed");
+		for(auto& buf : buffers) {
+			if(buf.state == Buffer::State::writing) {
+				buf.state = Buffer::State::empty;
+			}
+		}
+		return;
+	}
+
+	// Written data remains valid for subsequent reads
+	for(auto& buf : buffers) {
+		if(buf.state == Buffer::State::writing) {
+			buf.state = Buffer::State::valid;
+		}
+	}
+}
+
+bool Bridge::startRead(Buffer& buf, storage_size_t address)
+{
+	auto shift = getBlockShift();
+	uint32_t lba = address >> shift;
+	uint32_t blockCount = host.getSectorCount(lun);
+	if(lba >= blockCount) {
+		return false;
+	}
+	blockCount = std::min(blockCount - lba, bufferSize >> shift);
+
+	// Downstream device may re-order commands so ensure overlapping writes have completed
+	for(auto& other : buffers) {
+		if(other.state == Buffer::State::writing && other.overlaps(address, blockCount << shift)) {
+			waitWrites();
+			break;
+		}
+	}
+
+	buf.address = storage_size_t(lba) << shift;
+	buf.length = blockCount << shift;
+	buf.state = Buffer::State::reading;
+
+	auto callback = [this, &buf, lba, blockCount](bool success) {
+		if(buf.state != Buffer::State::reading) {
+			return;
+		}
+		if(success && filter && !filter(lba, buf.data.get(), blockCount, false)) {
+			success = false;
+		}
+		buf.state = success ? Buffer::State::valid : Buffer::State::failed;
+	};
+
+	if(!host.read_sectors_async(lun, lba, buf.data.get(), blockCount, callback)) {
+		buf.state = Buffer::State::failed;
+		return false;
+	}
+
+	return true;
+}
+
+void Bridge::prefetch(const Buffer& current)
+{
+	auto address = current.address + current.length;
+	for(auto& buf : buffers) {
+		if(buf.contains(address, 1) && (buf.state == Buffer::State::reading || buf.state == Buffer::State::valid)) {
+			return;
+		}
+	}
+
+	for(auto& buf : buffers) {
+		if(&buf == &current) {
+			continue;
+		}
+		if(buf.state == Buffer::State::empty || buf.state == Buffer::State::valid || buf.state == Buffer::State::failed) {
+			startRead(buf, address);
+		}
+		return;
+	}
+}
+
+int Bridge::read(uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize)
+{
+	if(!isReady()) {
+		return -1;
+	}
+
+	auto address = getAddress(lba, offset);
+
+	// Pass any buffered writes downstream first
+	for(auto& buf : buffers) {
+		if(buf.state == Buffer::State::filling && buf.overlaps(address, bufsize)) {
+			flushBuffer(buf);
+		}
+	}
+
+	for(auto& buf : buffers) {
+		if(!buf.contains(address, bufsize)) {
+			continue;
+		}
+		switch(buf.state) {
+		case Buffer::State::valid:
+			memcpy(buffer, &buf.data[address - buf.address], bufsize);
+			prefetch(buf);
+			return bufsize;
+
+		case Buffer::State::reading:
+			// Service downstream transfer: TinyUSB will retry this request
+			tuh_task();
+			return 0;
+
+		case Buffer::State::failed:
+			buf.state = Buffer::State::empty;
+			return -1;
+
+		default:;
+		}
+	}
+
+	auto buf = getFreeBuffer();
+	if(buf && !startRead(*buf, address)) {
+		return -1;
+	}
+	tuh_task();
+	return 0;
+}
+
+int Bridge::write(uint32_t lba, uint32_t offset, const uint8_t* buffer, uint32_t bufsize)
+{
+	if(!isReady()) {
+		return -1;
+	}
+
+	auto address = getAddress(lba, offset);
+
+	// Discard stale read data
+	for(auto& buf : buffers) {
+		if(!buf.overlaps(address, bufsize)) {
+			continue;
+		}
+		if(buf.state == Buffer::State::reading) {
+			host.wait();
+			buf.state = Buffer::State::empty;
+		} else if(buf.state == Buffer::State::valid || buf.state == Buffer::State::failed) {
+			buf.state = Buffer::State::empty;
+		}
+	}
+
+	Buffer* buf{};
+	for(auto& b : buffers) {
+		if(b.state == Buffer::State::filling) {
+			buf = &b;
+			break;
+		}
+	}
+
+	// Writes are sequential within a command, so anything else starts a new buffer
+	if(buf && (address != buf->address + buf->length || buf->length + bufsize > bufferSize)) {
+		if(!flushBuffer(*buf)) {
+			return -1;
+		}
+		buf = nullptr;
+	}
+
+	if(!buf) {
+		buf = getFreeBuffer();
+		if(!buf) {
+			return -1;
+		}
+		buf->state = Buffer::State::filling;
+		buf->address = address;
+		buf->length = 0;
+	}
+
+	memcpy(&buf->data[buf->length], buffer, bufsize);
+	buf->length += bufsize;
+	if(buf->length == bufferSize && !flushBuffer(*buf)) {
+		return -1;
+	}
+
+	return bufsize;
+}
+
+void Bridge::flush()
+{
+	for(auto& buf : buffers) {
+		if(buf.state == Buffer::State::filling) {
+			flushBuffer(buf);
+		}
+	}
+}
+
+bool Bridge::flushBuffer(Buffer& buf)
+{
+	auto shift = getBlockShift();
+	uint32_t lba = buf.address >> shift;
+	uint32_t blockCount = buf.length >> shift;
+	if((buf.address | buf.length) & ((1U << shift) - 1)) {
+		debug_e("[MSC] Bridge write not block-aligned");
+		buf.state = Buffer::State::failed;
+		return false;
+	}
+
+	if(filter && !filter(lba, buf.data.get(), blockCount, true)) {
+		buf.state = Buffer::State::failed;
+		return false;
+	}
+
+	if(!host.write_sectors(lun, lba, buf.data.get(), blockCount)) {
+		debug_e("[MSC] Bridge write failed");
+		buf.state = Buffer::State::failed;
+		return false;
+	}
+
+	buf.state = Buffer::State::writing;
+	return true;
+}
+
+} // namespace USB::MSC
+
+#endif
@@ -0,0 +1,137 @@
+/****
+ * MSC/Bridge.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "Device.h"
+#include "HostDevice.h"
+
+namespace USB::MSC
+{
+/**
+ * @brief Expose a logical unit on an attached USB storage device as a device-side logical unit
+ *
+ * Requires both device and host stacks. For example:
+ *
+ * 		USB::MSC::Bridge bridge(msc_host, 0);
+ * 		...
+ * 		msc_device.setLogicalUnit(0, {bridge});
+ *
+ * Reads are pipelined: as soon as a buffer has been filled from the downstream device
+ * the following block range is requested into the other buffer, so it is read whilst the
+ * upstream host is receiving the current one.
+ *
+ * Writes are collected into a buffer and passed downstream when full, when a non-sequential
+ * write occurs or at the end of the WRITE command. Downstream writes are asynchronous.
+ */
+class Bridge : public UnitHandler
+{
+public:
+	/**
+	 * @brief Optional callback to inspect or modify data passing through the bridge
+	 * @param lba First block
+	 * @param data Block data
+	 * @param blockCount Number of blocks
+	 * @param write true for data from upstream host being written downstream,
+	 * false for data read from downstream device
+	 * @retval bool Return false to fail the operation
+	 */
+	using Filter = Delegate<bool(uint32_t lba, uint8_t* data, size_t blockCount, bool write)>;
+
+	/**
+	 * @brief Constructor
+	 * @param host The downstream device
+	 * @param lun Logical Unit Number on downstream device
+	 * @param bufferSize Size of each of the two transfer buffers.
+	 * Must be a multiple of the downstream sector size.
+	 */
+	Bridge(HostDevice& host, uint8_t lun, size_t bufferSize = 4096);
+
+	void onFilter(Filter filter)
+	{
+		this->filter = filter;
+	}
+
+	/**
+	 * @brief Discard all buffered data
+	 *
+	 * Call if the downstream device is replaced.
+	 */
+	void reset();
+
+	/* UnitHandler */
+
+	String getName() const override;
+	bool isReady() const override;
+	void getCapacity(uint32_t& blockCount, uint16_t& blockSize) const override;
+	int read(uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize) override;
+	int write(uint32_t lba, uint32_t offset, const uint8_t* buffer, uint32_t bufsize) override;
+	void flush() override;
+
+private:
+	struct Buffer {
+		enum class State {
+			empty,
+			reading, ///< Waiting for data from downstream device
+			valid,   ///< Contains data from downstream device
+			filling, ///< Receiving data from upstream host
+			writing, ///< Data passed to downstream device
+			failed,
+		};
+
+		std::unique_ptr<uint8_t[]> data;
+		storage_size_t address{}; ///< Byte address of start of data
+		uint32_t length{};		  ///< Number of bytes held
+		State state{};
+
+		bool contains(storage_size_t addr, uint32_t size) const
+		{
+			return addr >= address && addr + size <= address + length;
+		}
+
+		bool overlaps(storage_size_t addr, uint32_t size) const
+		{
+			return addr < address + length && addr + size > address;
+		}
+	};
+
+	uint8_t getBlockShift() const
+	{
+		return Storage::getSizeBits(host.getSectorSize(lun));
+	}
+
+	storage_size_t getAddress(uint32_t lba, uint32_t offset) const
+	{
+		return (storage_size_t(lba) << getBlockShift()) + offset;
+	}
+
+	Buffer* getFreeBuffer(const Buffer* exclude = nullptr);
+	bool startRead(Buffer& buf, storage_size_t address);
+	void prefetch(const Buffer& current);
+	bool flushBuffer(Buffer& buf);
+	void waitWrites();
+
+	HostDevice& host;
+	Buffer buffers[2];
+	Filter filter;
+	uint32_t bufferSize;
+	uint8_t lun;
+};
+
+} // namespace USB::MSC
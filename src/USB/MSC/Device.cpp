@@ -22,10 +22,16 @@
 #if defined(ENABLE_USB_CLASSES) && CFG_TUD_MSC
 
 #include <debug_progmem.h>
+#if USB_MSC_STATS
+#include <Platform/Clock.h>
+#endif
 
 namespace USB::MSC
 {
-LogicalUnit Device::logicalUnits[MAX_LUN];
+Device::LogicalUnit Device::logicalUnits[MAX_LUN];
+#if USB_MSC_STATS
+UnitStats Device::stats[MAX_LUN];
+#endif
 
 bool Device::setLogicalUnit(uint8_t lun, LogicalUnit unit)
 {
@@ -38,6 +44,35 @@ bool Device::setLogicalUnit(uint8_t lun, LogicalUnit unit)
 	return true;
 }
 
+int Device::read(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize)
+{
+#if USB_MSC_STATS
+	auto startTime = micros();
+	int res = getLogicalUnit(lun).read(lba, offset, buffer, bufsize);
+	// Busy units get retried so don't count these
+	if(res != 0 && lun < MAX_LUN) {
+		stats[lun].transfer(false, bufsize, micros() - startTime, res > 0);
+	}
+	return res;
+#else
+	return getLogicalUnit(lun).read(lba, offset, buffer, bufsize);
+#endif
+}
+
+int Device::write(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+{
+#if USB_MSC_STATS
+	auto startTime = micros();
+	int res = getLogicalUnit(lun).write(lba, offset, buffer, bufsize);
+	if(lun < MAX_LUN) {
+		stats[lun].transfer(true, bufsize, micros() - startTime, res > 0);
+	}
+	return res;
+#else
+	return getLogicalUnit(lun).write(lba, offset, buffer, bufsize);
+#endif
+}
+
 void Device::inquiry(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16], uint8_t product_rev[4])
 {
 	auto unit = Device::getLogicalUnit(lun);
@@ -49,13 +84,45 @@ void Device::inquiry(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16],
 	const char rev[] = "1.0";
 
 	memcpy(vendor_id, vid, strlen(vid));
-	String devname = unit.device->getName();
+	String devname = unit.getName();
 	memcpy(product_id, devname.c_str(), std::min(devname.length(), 16U));
 	memcpy(product_rev, rev, strlen(rev));
 
 	debug_i("%s(%u, \"%s\", \"%s\", \"%s\")", __FUNCTION__, lun, vid, devname.c_str(), rev);
 }
 
+#if USB_MSC_STATS
+void Device::clearStats()
+{
+	for(auto& s : stats) {
+		s.clear();
+	}
+}
+
+size_t Device::printStats(Print& p)
+{
+	size_t n{0};
+	for(unsigned lun = 0; lun < MAX_LUN; ++lun) {
+		if(!logicalUnits[lun]) {
+			continue;
+		}
+		n += p.print("LUN ");
+		n += p.print(lun);
+		n += p.print(": ");
+		n += p.println(logicalUnits[lun].getName());
+		n += p.print(stats[lun]);
+	}
+	return n;
+}
+#endif
+
+#if !CFG_TUD_MSC_UAS_QUEUE_DEPTH
+bool Device::isUasActive()
+{
+	return false;
+}
+#endif
+
 } // namespace USB::MSC
 
 using namespace USB::MSC;
@@ -64,7 +131,9 @@ using namespace USB::MSC;
 // Application fill vendor id, product id and revision with string up to 8, 16, 4 characters respectively
 void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16], uint8_t product_rev[4])
 {
-	return Device::inquiry(lun, vendor_id, product_id, product_rev);
+	Device::beginCommand(lun, SCSI_CMD_INQUIRY);
+	Device::inquiry(lun, vendor_id, product_id, product_rev);
+	Device::endCommand(lun, true);
 }
 
 // Invoked when received GET_MAX_LUN request, required for multiple LUNs implementation
@@ -91,6 +160,8 @@ uint8_t tud_msc_get_maxlun_cb(void)
 int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void* buffer, uint16_t bufsize)
 {
 	debug_i("%s(%u, %u)", __FUNCTION__, lun, bufsize);
+	Device::beginCommand(lun, scsi_cmd[0]);
+	Device::endCommand(lun, false);
 	return -1;
 }
 
@@ -98,20 +169,28 @@ int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void* buffer, u
 // Application update block count and block size
 void tud_msc_capacity_cb(uint8_t lun, uint32_t* block_count, uint16_t* block_size)
 {
-	return Device::getCapacity(lun, block_count, block_size);
+	Device::beginCommand(lun, SCSI_CMD_READ_CAPACITY_10);
+	Device::getCapacity(lun, block_count, block_size);
+	Device::endCommand(lun, true);
 }
 
 // Invoked when received Test Unit Ready command.
 // return true allowing host to read/write this LUN e.g SD card inserted
 bool tud_msc_test_unit_ready_cb(uint8_t lun)
 {
-	return Device::isReady(lun);
+	Device::beginCommand(lun, SCSI_CMD_TEST_UNIT_READY);
+	bool ready = Device::isReady(lun);
+	Device::endCommand(lun, ready);
+	return ready;
 }
 
 // Callback invoked when received READ10 command.
 // Copy disk's data to buffer (up to bufsize) and return number of copied bytes.
 int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize)
 {
+	if(offset == 0) {
+		Device::beginCommand(lun, SCSI_CMD_READ_10, lba);
+	}
 	return Device::read(lun, lba, offset, buffer, bufsize);
 }
 
@@ -124,7 +203,17 @@ bool tud_msc_is_writable_cb(uint8_t lun)
 // Process data in buffer to disk's storage and return number of written bytes
 int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
 {
+	if(offset == 0) {
+		Device::beginCommand(lun, SCSI_CMD_WRITE_10, lba);
+	}
 	return Device::write(lun, lba, offset, buffer, bufsize);
 }
 
+// Invoked when command in tud_msc_write10_cb() is complete
+void tud_msc_write10_complete_cb(uint8_t lun)
+{
+	Device::flush(lun);
+	Device::endCommand(lun, true);
+}
+
 #endif
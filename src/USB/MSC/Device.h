@@ -21,54 +21,157 @@
 
 #include <Storage/Device.h>
 #include "../DeviceInterface.h"
+#if USB_MSC_STATS
+#include "Stats.h"
+#endif
 
 namespace USB::MSC
 {
-struct LogicalUnit {
-	Storage::Device* device;
-	bool readOnly;
-
-	operator bool() const
+/**
+ * @brief Interface for logical units which are not backed directly by a Storage::Device
+ *
+ * For example, see MSC::Bridge.
+ */
+class UnitHandler
+{
+public:
+	virtual ~UnitHandler()
 	{
-		return device != nullptr;
 	}
 
-	void getCapacity(uint32_t* block_count, uint16_t* block_size)
-	{
-		if(device == nullptr) {
-			return;
-		}
+	virtual String getName() const = 0;
 
-		*block_size = device->getSectorSize();
-		*block_count = device->getSectorCount();
-	}
+	/**
+	 * @brief Determine whether unit is able to accept commands
+	 */
+	virtual bool isReady() const = 0;
 
-	int read(uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize)
-	{
-		if(device == nullptr) {
-			return -1;
-		}
+	virtual void getCapacity(uint32_t& blockCount, uint16_t& blockSize) const = 0;
 
-		auto blockSize = device->getSectorSize();
-		offset += blockSize * lba;
-		return device->read(offset, buffer, bufsize) ? bufsize : -1;
-	}
+	/**
+	 * @brief Read data from unit
+	 * @param lba Logical Block Address of command
+	 * @param offset Byte offset from LBA
+	 * @param buffer
+	 * @param bufsize Number of bytes to read
+	 * @retval int Number of bytes read, 0 if unit is busy and request should be retried, -1 on error
+	 */
+	virtual int read(uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize) = 0;
 
-	int write(uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
-	{
-		if(device == nullptr || readOnly) {
-			return -1;
-		}
+	/**
+	 * @brief Write data to unit
+	 * @param lba Logical Block Address of command
+	 * @param offset Byte offset from LBA
+	 * @param buffer
+	 * @param bufsize Number of bytes to write
+	 * @retval int Number of bytes written, -1 on error
+	 */
+	virtual int write(uint32_t lba, uint32_t offset, const uint8_t* buffer, uint32_t bufsize) = 0;
 
-		auto blockSize = device->getSectorSize();
-		offset += blockSize * lba;
-		return device->write(offset, buffer, bufsize) ? bufsize : -1;
+	/**
+	 * @brief Called when a WRITE command has completed
+	 */
+	virtual void flush()
+	{
 	}
 };
 
 class Device : public DeviceInterface
 {
 public:
+	/**
+	 * @brief A logical unit is either a storage device or a custom handler
+	 */
+	struct LogicalUnit {
+		Storage::Device* device{};
+		UnitHandler* handler{};
+		bool readOnly{};
+
+		LogicalUnit() = default;
+
+		LogicalUnit(Storage::Device* device, bool readOnly = false) : device(device), readOnly(readOnly)
+		{
+		}
+
+		LogicalUnit(UnitHandler& handler, bool readOnly = false) : handler(&handler), readOnly(readOnly)
+		{
+		}
+
+		operator bool() const
+		{
+			return device != nullptr || handler != nullptr;
+		}
+
+		bool isReady() const
+		{
+			return handler ? handler->isReady() : device != nullptr;
+		}
+
+		String getName() const
+		{
+			if(handler) {
+				return handler->getName();
+			}
+			return device ? device->getName() : String{};
+		}
+
+		void getCapacity(uint32_t* block_count, uint16_t* block_size)
+		{
+			if(handler) {
+				handler->getCapacity(*block_count, *block_size);
+				return;
+			}
+
+			if(device == nullptr) {
+				return;
+			}
+
+			*block_size = device->getSectorSize();
+			*block_count = device->getSectorCount();
+		}
+
+		int read(uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize)
+		{
+			if(handler) {
+				return handler->read(lba, offset, buffer, bufsize);
+			}
+
+			if(device == nullptr) {
+				return -1;
+			}
+
+			auto blockSize = device->getSectorSize();
+			offset += blockSize * lba;
+			return device->read(offset, buffer, bufsize) ? bufsize : -1;
+		}
+
+		int write(uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+		{
+			if(readOnly) {
+				return -1;
+			}
+
+			if(handler) {
+				return handler->write(lba, offset, buffer, bufsize);
+			}
+
+			if(device == nullptr) {
+				return -1;
+			}
+
+			auto blockSize = device->getSectorSize();
+			offset += blockSize * lba;
+			return device->write(offset, buffer, bufsize) ? bufsize : -1;
+		}
+
+		void flush()
+		{
+			if(handler) {
+				handler->flush();
+			}
+		}
+	};
+
 	using DeviceInterface::DeviceInterface;
 
 	static bool setLogicalUnit(uint8_t lun, LogicalUnit unit);
@@ -78,21 +181,20 @@ public:
 		return getLogicalUnit(lun).getCapacity(block_count, block_size);
 	}
 
-	static int read(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize)
-	{
-		return getLogicalUnit(lun).read(lba, offset, buffer, bufsize);
-	}
+	static int read(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize);
+
+	static int write(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize);
 
-	static int write(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t* buffer, uint32_t bufsize)
+	static void flush(uint8_t lun)
 	{
-		return getLogicalUnit(lun).write(lba, offset, buffer, bufsize);
+		getLogicalUnit(lun).flush();
 	}
 
 	static void inquiry(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16], uint8_t product_rev[4]);
 
 	static bool isReady(uint8_t lun)
 	{
-		return getLogicalUnit(lun);
+		return getLogicalUnit(lun).isReady();
 	}
 
 	static bool isReadOnly(uint8_t lun)
@@ -100,8 +202,60 @@ public:
 		return getLogicalUnit(lun).readOnly;
 	}
 
+	/**
+	 * @brief Determine whether host has selected USB Attached SCSI transport
+	 * @retval bool false if using Bulk-Only Transport, or UAS not configured
+	 *
+	 * UAS is available using the `msc-uas` interface template.
+	 */
+	static bool isUasActive();
+
 	static constexpr size_t MAX_LUN{4};
 
+#if USB_MSC_STATS
+	/**
+	 * @brief Get activity statistics for a logical unit
+	 * @param lun Logical Unit Number
+	 * @retval UnitStats* nullptr if lun is invalid
+	 *
+	 * Available when :envvar:`USB_MSC_STATS` is enabled.
+	 */
+	static const UnitStats* getStats(uint8_t lun)
+	{
+		return (lun < MAX_LUN) ? &stats[lun] : nullptr;
+	}
+
+	static void clearStats();
+
+	/**
+	 * @brief Print statistics for all logical units which have been used
+	 */
+	static size_t printStats(Print& p);
+#endif
+
+	/**
+	 * @brief Used by transport to record start of a command
+	 * @{
+	 */
+	static void beginCommand(uint8_t lun, uint8_t opcode, uint32_t lba = 0)
+	{
+#if USB_MSC_STATS
+		if(lun < MAX_LUN) {
+			stats[lun].begin(opcode, lba);
+		}
+#endif
+	}
+
+	static void endCommand(uint8_t lun, bool success)
+	{
+#if USB_MSC_STATS
+		if(lun < MAX_LUN) {
+			stats[lun].end(success);
+		}
+#endif
+	}
+	/** @} */
+
 private:
 	static LogicalUnit getLogicalUnit(uint8_t lun)
 	{
@@ -109,6 +263,9 @@ private:
 	}
 
 	static LogicalUnit logicalUnits[];
+#if USB_MSC_STATS
+	static UnitStats stats[];
+#endif
 };
 
 } // namespace USB::MSC
@@ -95,6 +95,11 @@ bool HostDevice::begin(const Instance& inst)
 {
 	HostInterface::begin(inst);
 	state = State::ready;
+	transferError = false;
+#if CFG_TUH_MSC_UAS_QUEUE_DEPTH
+	uas.reset(new UasHost(*this));
+	memset(capacity, 0, sizeof(capacity));
+#endif
 	debug_i("[MSC] Device %u (%s) mounted, max_lun %u", inst.dev_addr, inst.name, tuh_msc_get_maxlun(inst.dev_addr));
 	return true;
 }
@@ -110,6 +115,25 @@ bool HostDevice::enumerate(EnumCallback callback)
 		unit.reset();
 	}
 
+#if CFG_TUH_MSC_UAS_QUEUE_DEPTH
+	if(uas && !uas->isProbed()) {
+		// Inquiry buffer also indicates enumeration is in progress
+		inquiry.reset(new Inquiry{});
+		auto probeComplete = [this](bool) {
+			if(!sendInquiry(0)) {
+				inquiry.reset();
+				enumCallback = nullptr;
+			}
+		};
+		if(!uas->probe(probeComplete)) {
+			inquiry.reset();
+			return false;
+		}
+		enumCallback = callback;
+		return true;
+	}
+#endif
+
 	if(!sendInquiry(0)) {
 		return false;
 	}
@@ -118,17 +142,60 @@ bool HostDevice::enumerate(EnumCallback callback)
 	return true;
 }
 
+size_t HostDevice::getSectorSize(uint8_t lun) const
+{
+#if CFG_TUH_MSC_UAS_QUEUE_DEPTH
+	if(isUas()) {
+		return (lun < MAX_LUN) ? capacity[lun].blockSize : 0;
+	}
+#endif
+	return tuh_msc_get_block_size(inst.dev_addr, lun);
+}
+
+storage_size_t HostDevice::getSectorCount(uint8_t lun) const
+{
+#if CFG_TUH_MSC_UAS_QUEUE_DEPTH
+	if(isUas()) {
+		return (lun < MAX_LUN) ? capacity[lun].blockCount : 0;
+	}
+#endif
+	return tuh_msc_get_block_count(inst.dev_addr, lun);
+}
+
 bool HostDevice::sendInquiry(uint8_t lun)
 {
 	auto callback = [](uint8_t dev_addr, const tuh_msc_complete_data_t* cb_data) {
 		auto dev = reinterpret_cast<HostDevice*>(cb_data->user_arg);
-		return dev ? dev->handleInquiry(cb_data) : false;
+		if(!dev) {
+			return false;
+		}
+		dev->inquiryComplete(cb_data->cbw->lun, cb_data->csw->status == 0);
+		return true;
 	};
 
 	if(!inquiry) {
 		inquiry.reset(new Inquiry{});
 	}
 
+#if CFG_TUH_MSC_UAS_QUEUE_DEPTH
+	if(isUas()) {
+		scsi_inquiry_t cmd{};
+		cmd.cmd_code = SCSI_CMD_INQUIRY;
+		cmd.alloc_length = sizeof(inquiry->resp);
+		auto inquiryCallback = [this, lun](bool success) {
+			// TinyUSB only reads capacity for BOT devices during mount
+			if(!success || !sendReadCapacity(lun)) {
+				inquiryComplete(lun, false);
+			}
+		};
+		if(!uas->submit(lun, &cmd, sizeof(cmd), &inquiry->resp, sizeof(inquiry->resp), true, inquiryCallback)) {
+			debug_e("[MSC] UAS inquiry failed");
+			return false;
+		}
+		return true;
+	}
+#endif
+
 	if(!tuh_msc_inquiry(inst.dev_addr, lun, &inquiry->resp, callback, reinterpret_cast<uintptr_t>(this))) {
 		debug_e("tuh_msc_inquiry failed");
 		return false;
@@ -137,15 +204,34 @@ bool HostDevice::sendInquiry(uint8_t lun)
 	return true;
 }
 
-bool HostDevice::handleInquiry(const tuh_msc_complete_data_t* cb_data)
+#if CFG_TUH_MSC_UAS_QUEUE_DEPTH
+bool HostDevice::sendReadCapacity(uint8_t lun)
 {
-	auto lun = cb_data->cbw->lun;
-	if(cb_data->csw->status != 0) {
+	if(lun >= MAX_LUN) {
+		return false;
+	}
+
+	scsi_read_capacity10_t cmd{};
+	cmd.cmd_code = SCSI_CMD_READ_CAPACITY_10;
+	auto callback = [this, lun](bool success) {
+		if(success) {
+			capacity[lun].blockCount = tu_ntohl(capacityResponse.last_lba) + 1;
+			capacity[lun].blockSize = tu_ntohl(capacityResponse.block_size);
+		}
+		inquiryComplete(lun, success);
+	};
+	return uas->submit(lun, &cmd, sizeof(cmd), &capacityResponse, sizeof(capacityResponse), true, callback);
+}
+#endif
+
+void HostDevice::inquiryComplete(uint8_t lun, bool success)
+{
+	if(!success) {
 		debug_e("[MSC] Inquiry failed (addr %u, lun %u)", inst.dev_addr, lun);
 	} else {
 		debug_hex(DBG, "INQUIRY", inquiry.get(), sizeof(*inquiry));
-		auto block_count = tuh_msc_get_block_count(inst.dev_addr, lun);
-		debug_d("[MSC] Block count %u, size %u", block_count, tuh_msc_get_block_size(inst.dev_addr, lun));
+		auto block_count = getSectorCount(lun);
+		debug_d("[MSC] Block count %u, size %u", uint32_t(block_count), getSectorSize(lun));
 		// Ignore any un-populated units
 		if(block_count != 0) {
 			auto& unit = units[lun];
@@ -162,17 +248,22 @@ bool HostDevice::handleInquiry(const tuh_msc_complete_data_t* cb_data)
 	++lun;
 	if(lun < MAX_LUN && lun < tuh_msc_get_maxlun(inst.dev_addr)) {
 		if(sendInquiry(lun)) {
-			return true;
+			return;
 		}
 	}
 
 	inquiry.reset();
 	enumCallback = nullptr;
-	return true;
 }
 
 void HostDevice::end()
 {
+#if CFG_TUH_MSC_UAS_QUEUE_DEPTH
+	// Device has gone so abort any outstanding commands, including a probe waiting on the control queue
+	if(uas) {
+		uas->end();
+	}
+#endif
 	HostInterface::end();
 	if(state == State::idle) {
 		return;
@@ -187,19 +278,65 @@ void HostDevice::end()
 
 bool HostDevice::wait()
 {
+#if CFG_TUH_MSC_UAS_QUEUE_DEPTH
+	if(uas) {
+		while(uas->getPending() != 0) {
+			tuh_task();
+			system_soft_wdt_feed();
+		}
+	}
+#endif
 	while(state == State::busy) {
 		tuh_task();
 		system_soft_wdt_feed();
 	}
+	if(transferError) {
+		transferError = false;
+		return false;
+	}
 	return state == State::ready;
 }
 
+#if CFG_TUH_MSC_UAS_QUEUE_DEPTH
+bool HostDevice::submitReadWrite(uint8_t lun, uint32_t lba, void* buffer, size_t size, bool read,
+								 UasHost::Callback callback)
+{
+	// READ10 and WRITE10 have identical layout
+	scsi_read10_t cmd{};
+	cmd.cmd_code = read ? SCSI_CMD_READ_10 : SCSI_CMD_WRITE_10;
+	cmd.lba = tu_htonl(lba);
+	cmd.block_count = tu_htons(size);
+
+	// Wait for a free command slot
+	while(uas->isFull()) {
+		tuh_task();
+		system_soft_wdt_feed();
+	}
+
+	return uas->submit(lun, &cmd, sizeof(cmd), buffer, size * getSectorSize(lun), read, callback);
+}
+#endif
+
 bool HostDevice::read_sectors(uint8_t lun, uint32_t lba, void* dst, size_t size)
 {
 	if(state < State::ready) {
 		return false;
 	}
 
+#if CFG_TUH_MSC_UAS_QUEUE_DEPTH
+	if(isUas()) {
+		int result{-1};
+		if(!submitReadWrite(lun, lba, dst, size, true, [&result](bool success) { result = success; })) {
+			return false;
+		}
+		while(result < 0) {
+			tuh_task();
+			system_soft_wdt_feed();
+		}
+		return result;
+	}
+#endif
+
 	auto callback = [](uint8_t dev_addr, tuh_msc_complete_data_t const* cb_data) {
 		auto dev = reinterpret_cast<HostDevice*>(cb_data->user_arg);
 		dev->state = State::ready;
@@ -214,8 +351,60 @@ bool HostDevice::read_sectors(uint8_t lun, uint32_t lba, void* dst, size_t size)
 	return wait();
 }
 
+bool HostDevice::read_sectors_async(uint8_t lun, uint32_t lba, void* dst, size_t size, TransferCallback callback)
+{
+	if(state < State::ready) {
+		return false;
+	}
+
+#if CFG_TUH_MSC_UAS_QUEUE_DEPTH
+	if(isUas()) {
+		return submitReadWrite(lun, lba, dst, size, true, callback);
+	}
+#endif
+
+	if(!wait()) {
+		return false;
+	}
+
+	auto complete = [](uint8_t dev_addr, tuh_msc_complete_data_t const* cb_data) {
+		auto dev = reinterpret_cast<HostDevice*>(cb_data->user_arg);
+		dev->state = State::ready;
+		auto callback = dev->transferCallback;
+		dev->transferCallback = nullptr;
+		if(callback) {
+			callback(cb_data->csw->status == 0);
+		}
+		return true;
+	};
+
+	transferCallback = callback;
+	if(!tuh_msc_read10(inst.dev_addr, lun, dst, lba, size, complete, reinterpret_cast<uintptr_t>(this))) {
+		transferCallback = nullptr;
+		return false;
+	}
+
+	state = State::busy;
+	return true;
+}
+
 bool HostDevice::write_sectors(uint8_t lun, uint32_t lba, const void* src, size_t size)
 {
+#if CFG_TUH_MSC_UAS_QUEUE_DEPTH
+	if(isUas()) {
+		if(state < State::ready) {
+			return false;
+		}
+		// Writes are queued, errors are reported by wait()
+		auto callback = [this](bool success) {
+			if(!success) {
+				transferError = true;
+			}
+		};
+		return submitReadWrite(lun, lba, const_cast<void*>(src), size, false, callback);
+	}
+#endif
+
 	if(!wait()) {
 		return false;
 	}
@@ -21,6 +21,9 @@
 
 #include "../HostInterface.h"
 #include <Storage/Disk/BlockDevice.h>
+#if CFG_TUH_MSC_UAS_QUEUE_DEPTH
+#include "UasHost.h"
+#endif
 
 namespace USB::MSC
 {
@@ -90,6 +93,12 @@ public:
 	  */
 	using EnumCallback = Delegate<bool(LogicalUnit& unit, const Inquiry& inquiry)>;
 
+	/**
+	 * @brief Callback passed to asynchronous read method
+	 * @param success true if data was read successfully
+	 */
+	using TransferCallback = Delegate<void(bool success)>;
+
 	using HostInterface::HostInterface;
 
 	bool begin(const Instance& inst);
@@ -98,6 +107,10 @@ public:
 	/**
 	 * @brief Enumerate all logical units managed by this device
 	 * @param callback Invoked for each discovered Logical Unit
+	 *
+	 * If USB Attached SCSI support is enabled (via `uas-queue-depth` host setting)
+	 * then the device is first checked for a UAS alternate setting. If found, this is selected
+	 * and all subsequent commands use UAS. Otherwise the Bulk-Only Transport is used.
 	 */
 	bool enumerate(EnumCallback callback);
 
@@ -116,19 +129,25 @@ public:
 	 * @param lun The logical Unit Number
 	 * @retval size_t Block size in bytes, or 0 if invalid
 	 */
-	size_t getSectorSize(uint8_t lun) const
-	{
-		return tuh_msc_get_block_size(inst.dev_addr, lun);
-	}
+	size_t getSectorSize(uint8_t lun) const;
 
 	/**
 	 * @brief Get the number of blocks/sectors for a unit
 	 * @param lun The logical Unit Number
 	 * @retval size_t Number of blocks, 0 if invalid
 	 */
-	storage_size_t getSectorCount(uint8_t lun) const
+	storage_size_t getSectorCount(uint8_t lun) const;
+
+	/**
+	 * @brief Determine whether USB Attached SCSI transport is in use
+	 */
+	bool isUas() const
 	{
-		return tuh_msc_get_block_count(inst.dev_addr, lun);
+#if CFG_TUH_MSC_UAS_QUEUE_DEPTH
+		return uas && uas->isActive();
+#else
+		return false;
+#endif
 	}
 
 	/**
@@ -141,6 +160,20 @@ public:
 	 */
 	bool read_sectors(uint8_t lun, uint32_t lba, void* dst, size_t size);
 
+	/**
+	 * @brief Start reading data from a unit
+	 * @param lun The logical Unit Number
+	 * @param lba Starting Logical Block Address
+	 * @param dst Buffer to store data, must remain valid until callback is invoked
+	 * @param size Number of sectors to read
+	 * @param callback Invoked when operation has completed
+	 * @retval bool true if read was started
+	 *
+	 * With UAS, several reads may be outstanding. The device may complete them in any order.
+	 * With Bulk-Only Transport, this call waits for any previous operation to complete.
+	 */
+	bool read_sectors_async(uint8_t lun, uint32_t lba, void* dst, size_t size, TransferCallback callback);
+
 	/**
 	 * @brief Write data to a unit
 	 * @param lun The logical Unit Number
@@ -172,11 +205,26 @@ private:
 	};
 
 	bool sendInquiry(uint8_t lun);
-	bool handleInquiry(const tuh_msc_complete_data_t* cb_data);
+	void inquiryComplete(uint8_t lun, bool success);
 
 	std::unique_ptr<Inquiry> inquiry;
 	EnumCallback enumCallback;
+	TransferCallback transferCallback;
 	State state{};
+	bool transferError{};
+#if CFG_TUH_MSC_UAS_QUEUE_DEPTH
+	bool submitReadWrite(uint8_t lun, uint32_t lba, void* buffer, size_t size, bool read, UasHost::Callback callback);
+	bool sendReadCapacity(uint8_t lun);
+
+	struct Capacity {
+		uint32_t blockCount;
+		uint32_t blockSize;
+	};
+
+	std::unique_ptr<UasHost> uas;
+	Capacity capacity[MAX_LUN]{};
+	scsi_read_capacity10_resp_t capacityResponse;
+#endif
 };
 
 /**
@@ -0,0 +1,218 @@
+/****
+ * MSC/Stats.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if defined(ENABLE_USB_CLASSES) && CFG_TUD_MSC && USB_MSC_STATS
+
+#include "Stats.h"
+#include <Platform/Clock.h>
+
+namespace USB::MSC
+{
+namespace
+{
+const char* getCommandName(uint8_t opcode)
+{
+	switch(opcode) {
+	case SCSI_CMD_TEST_UNIT_READY:
+		return "TEST UNIT READY";
+	case SCSI_CMD_REQUEST_SENSE:
+		return "REQUEST SENSE";
+	case SCSI_CMD_INQUIRY:
+		return "INQUIRY";
+	case SCSI_CMD_MODE_SENSE_6:
+		return "MODE SENSE(6)";
+	case SCSI_CMD_START_STOP_UNIT:
+		return "START STOP UNIT";
+	case SCSI_CMD_PREVENT_ALLOW_MEDIUM_REMOVAL:
+		return "PREVENT ALLOW MEDIUM REMOVAL";
+	case SCSI_CMD_READ_CAPACITY_10:
+		return "READ CAPACITY(10)";
+	case SCSI_CMD_READ_FORMAT_CAPACITY:
+		return "READ FORMAT CAPACITIES";
+	case SCSI_CMD_READ_10:
+		return "READ(10)";
+	case SCSI_CMD_WRITE_10:
+		return "WRITE(10)";
+	default:
+		return "Other";
+	}
+}
+
+} // namespace
+
+void Histogram::add(uint32_t value)
+{
+	unsigned bucket = value ? 32 - __builtin_clz(value) : 0;
+	++buckets[std::min(bucket, bucketCount - 1)];
+	if(count == 0 || value < min) {
+		min = value;
+	}
+	max = std::max(max, value);
+	total += value;
+	++count;
+}
+
+size_t Histogram::printTo(Print& p) const
+{
+	size_t n{0};
+	n += p.print("count ");
+	n += p.print(count);
+	if(count == 0) {
+		return n;
+	}
+	n += p.print(", min ");
+	n += p.print(min);
+	n += p.print(", avg ");
+	n += p.print(getAverage());
+	n += p.print(", max ");
+	n += p.print(max);
+	for(unsigned i = 0; i < bucketCount; ++i) {
+		if(buckets[i] == 0) {
+			continue;
+		}
+		n += p.println();
+		n += p.print("    ");
+		if(i == bucketCount - 1) {
+			n += p.print(">= ");
+			n += p.print(1U << (i - 1));
+		} else {
+			n += p.print("< ");
+			n += p.print(1U << i);
+		}
+		n += p.print(": ");
+		n += p.print(buckets[i]);
+	}
+	return n;
+}
+
+unsigned UnitStats::getIndex(uint8_t opcode)
+{
+	unsigned i = 0;
+	for(; i < ARRAY_SIZE(opcodes); ++i) {
+		if(opcodes[i] == opcode) {
+			break;
+		}
+	}
+	return i;
+}
+
+void UnitStats::begin(uint8_t opcode, uint32_t lba)
+{
+	// Bulk-Only Transport retries a READ10 request whilst unit is busy
+	if(busy && opcode == this->opcode && lba == this->lba && length == 0) {
+		return;
+	}
+
+	// Previous command is assumed to have completed when the last data was obtained
+	if(busy) {
+		finish(lastTime, true);
+	}
+
+	startTime = lastTime = micros();
+	this->opcode = opcode;
+	this->lba = lba;
+	length = 0;
+	failed = false;
+	busy = true;
+}
+
+void UnitStats::end(bool success)
+{
+	if(busy) {
+		finish(micros(), success);
+	}
+}
+
+void UnitStats::finish(uint32_t endTime, bool success)
+{
+	busy = false;
+
+	auto& cmd = commands[getIndex(opcode)];
+	cmd.latency.add(endTime - startTime);
+	if(failed || !success) {
+		++cmd.errors;
+	}
+
+	if(opcode == SCSI_CMD_READ_10 || opcode == SCSI_CMD_WRITE_10) {
+		transferSize[opcode == SCSI_CMD_WRITE_10].add(length);
+	}
+}
+
+void UnitStats::transfer(bool write, uint32_t length, uint32_t serviceTime, bool success)
+{
+	this->serviceTime[write].add(serviceTime);
+	lastTime = micros();
+	if(success) {
+		this->length += length;
+	} else {
+		failed = true;
+	}
+}
+
+void UnitStats::clear()
+{
+	for(auto& cmd : commands) {
+		cmd = {};
+	}
+	for(unsigned i = 0; i < 2; ++i) {
+		transferSize[i].clear();
+		serviceTime[i].clear();
+	}
+	busy = false;
+}
+
+size_t UnitStats::printTo(Print& p) const
+{
+	size_t n{0};
+	for(unsigned i = 0; i < commandCount; ++i) {
+		auto& cmd = commands[i];
+		if(cmd.latency.getCount() == 0) {
+			continue;
+		}
+		n += p.print("  ");
+		n += p.print(getCommandName(i < ARRAY_SIZE(opcodes) ? opcodes[i] : 0xff));
+		n += p.print(": errors ");
+		n += p.print(cmd.errors);
+		n += p.print(", latency (us) ");
+		n += p.println(cmd.latency);
+	}
+
+	const char* const dirs[]{"Read", "Write"};
+	for(unsigned i = 0; i < 2; ++i) {
+		if(serviceTime[i].getCount() == 0) {
+			continue;
+		}
+		n += p.print("  ");
+		n += p.print(dirs[i]);
+		n += p.print(" size (bytes) ");
+		n += p.println(transferSize[i]);
+		n += p.print("  ");
+		n += p.print(dirs[i]);
+		n += p.print(" service time (us) ");
+		n += p.println(serviceTime[i]);
+	}
+
+	return n;
+}
+
+} // namespace USB::MSC
+
+#endif
@@ -0,0 +1,179 @@
+/****
+ * MSC/Stats.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include <tusb.h>
+#include <Print.h>
+
+namespace USB::MSC
+{
+/**
+ * @brief Logarithmic histogram
+ *
+ * Bucket 0 counts zero values, bucket n counts values from 2^(n-1) to (2^n)-1.
+ * The final bucket also counts all larger values.
+ */
+class Histogram
+{
+public:
+	static constexpr unsigned bucketCount{20};
+
+	void add(uint32_t value);
+
+	void clear()
+	{
+		*this = Histogram{};
+	}
+
+	uint32_t getCount() const
+	{
+		return count;
+	}
+
+	uint32_t getMin() const
+	{
+		return min;
+	}
+
+	uint32_t getMax() const
+	{
+		return max;
+	}
+
+	uint32_t getAverage() const
+	{
+		return count ? total / count : 0;
+	}
+
+	uint32_t operator[](unsigned bucket) const
+	{
+		return (bucket < bucketCount) ? buckets[bucket] : 0;
+	}
+
+	/**
+	 * @brief Print summary followed by non-empty buckets
+	 */
+	size_t printTo(Print& p) const;
+
+private:
+	uint64_t total{};
+	uint32_t buckets[bucketCount]{};
+	uint32_t count{};
+	uint32_t min{};
+	uint32_t max{};
+};
+
+/**
+ * @brief Activity counters for a device logical unit
+ *
+ * Commands are timed from receipt until completion. With Bulk-Only Transport
+ * the end of a READ10 command isn't signalled so it is taken as the time the last
+ * block of data was obtained from the unit.
+ *
+ * Storage service time is the time spent in each read or write call on the unit.
+ * All times are in microseconds.
+ */
+class UnitStats
+{
+public:
+	/**
+	 * @brief Tracked SCSI opcodes. Others are counted together.
+	 */
+	static constexpr uint8_t opcodes[]{
+		SCSI_CMD_TEST_UNIT_READY, SCSI_CMD_REQUEST_SENSE,		  SCSI_CMD_INQUIRY,
+		SCSI_CMD_MODE_SENSE_6,	SCSI_CMD_START_STOP_UNIT,	  SCSI_CMD_PREVENT_ALLOW_MEDIUM_REMOVAL,
+		SCSI_CMD_READ_CAPACITY_10, SCSI_CMD_READ_FORMAT_CAPACITY, SCSI_CMD_READ_10,
+		SCSI_CMD_WRITE_10,
+	};
+	static constexpr unsigned commandCount{ARRAY_SIZE(opcodes) + 1};
+
+	struct Command {
+		Histogram latency;
+		uint32_t errors;
+	};
+
+	/**
+	 * @brief Called when a command is received
+	 *
+	 * Any command still in progress is assumed complete.
+	 */
+	void begin(uint8_t opcode, uint32_t lba = 0);
+
+	/**
+	 * @brief Called when a command has completed
+	 */
+	void end(bool success);
+
+	/**
+	 * @brief Record a read or write operation on the unit
+	 * @param write
+	 * @param length Number of bytes transferred
+	 * @param serviceTime Time taken by unit
+	 * @param success
+	 */
+	void transfer(bool write, uint32_t length, uint32_t serviceTime, bool success);
+
+	void clear();
+
+	/**
+	 * @brief Get statistics for a specific command
+	 * @param opcode SCSI opcode. Untracked codes return the shared 'other' entry.
+	 */
+	const Command& getCommand(uint8_t opcode) const
+	{
+		return commands[getIndex(opcode)];
+	}
+
+	/**
+	 * @brief Distribution of READ10/WRITE10 command sizes in bytes
+	 */
+	const Histogram& getTransferSize(bool write) const
+	{
+		return transferSize[write];
+	}
+
+	/**
+	 * @brief Distribution of storage service time for read/write calls
+	 */
+	const Histogram& getServiceTime(bool write) const
+	{
+		return serviceTime[write];
+	}
+
+	size_t printTo(Print& p) const;
+
+private:
+	static unsigned getIndex(uint8_t opcode);
+	void finish(uint32_t endTime, bool success);
+
+	Command commands[commandCount]{};
+	Histogram transferSize[2];
+	Histogram serviceTime[2];
+	// Command in progress
+	uint32_t startTime{};
+	uint32_t lastTime{};
+	uint32_t lba{};
+	uint32_t length{};
+	uint8_t opcode{};
+	bool busy{};
+	bool failed{};
+};
+
+} // namespace USB::MSC
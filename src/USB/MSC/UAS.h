@@ -0,0 +1,204 @@
+/****
+ * MSC/UAS.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "UasDescriptor.h"
+
+/**
+ * @brief USB Attached SCSI (UAS) protocol definitions
+ *
+ * Information Units (IUs) are transferred over the command and status pipes.
+ * Multi-byte fields are big-endian.
+ *
+ * Without bulk streams (i.e. USB 2.0) the device signals which command it wishes to service next
+ * by sending a READ READY or WRITE READY IU on the status pipe. The host then performs the data
+ * transfer for that tag, after which the device sends a SENSE IU to complete the command.
+ */
+namespace USB::MSC::UAS
+{
+enum class IuId : uint8_t {
+	command = 0x01,
+	sense = 0x03,
+	response = 0x04,
+	taskManagement = 0x05,
+	readReady = 0x06,
+	writeReady = 0x07,
+};
+
+/**
+ * @brief Pipe identifiers as given in pipe usage descriptors
+ */
+enum class PipeId : uint8_t {
+	command = UAS_PIPE_ID_COMMAND,
+	status = UAS_PIPE_ID_STATUS,
+	dataIn = UAS_PIPE_ID_DATA_IN,
+	dataOut = UAS_PIPE_ID_DATA_OUT,
+};
+
+enum class TaskAttribute : uint8_t {
+	simple = 0,
+	headOfQueue = 1,
+	ordered = 2,
+	aca = 4,
+};
+
+enum class TaskFunction : uint8_t {
+	abortTask = 0x01,
+	abortTaskSet = 0x02,
+	clearTaskSet = 0x04,
+	logicalUnitReset = 0x08,
+	itNexusReset = 0x10,
+	clearAca = 0x40,
+	queryTask = 0x80,
+	queryTaskSet = 0x81,
+	queryAsyncEvent = 0x82,
+};
+
+enum class ResponseCode : uint8_t {
+	complete = 0x00,
+	invalidIU = 0x02,
+	notSupported = 0x04,
+	failed = 0x05,
+	succeeded = 0x08,
+	incorrectLun = 0x09,
+	overlappedTag = 0x0a,
+};
+
+/**
+ * @brief SCSI status codes returned in SENSE IU
+ */
+enum class Status : uint8_t {
+	good = 0x00,
+	checkCondition = 0x02,
+	busy = 0x08,
+	taskSetFull = 0x28,
+	taskAborted = 0x40,
+};
+
+/**
+ * @brief Common header for all information units
+ */
+struct TU_ATTR_PACKED Header {
+	IuId id;
+	uint8_t reserved;
+	uint16_t tag_be;
+
+	uint16_t getTag() const
+	{
+		return tu_ntohs(tag_be);
+	}
+
+	void setTag(uint16_t tag)
+	{
+		tag_be = tu_htons(tag);
+	}
+};
+
+struct TU_ATTR_PACKED CommandIU : public Header {
+	uint8_t attribute; ///< bits 0-2: TaskAttribute, bits 3-6: priority
+	uint8_t reserved5;
+	uint8_t addCdbLength; ///< Additional CDB length in dwords, bits 2-7
+	uint8_t reserved7;
+	uint8_t lun[8];
+	uint8_t cdb[16];
+
+	TaskAttribute getAttribute() const
+	{
+		return TaskAttribute(attribute & 0x07);
+	}
+
+	/**
+	 * @brief Get logical unit number (single-level addressing only)
+	 */
+	uint8_t getLun() const
+	{
+		return lun[1];
+	}
+
+	void setLun(uint8_t value)
+	{
+		memset(lun, 0, sizeof(lun));
+		lun[1] = value;
+	}
+};
+
+static_assert(sizeof(CommandIU) == 32, "Bad CommandIU");
+
+struct TU_ATTR_PACKED SenseIU : public Header {
+	uint16_t statusQualifier_be;
+	Status status;
+	uint8_t reserved7[7];
+	uint16_t length_be; ///< Length of sense data
+	scsi_sense_fixed_resp_t sense;
+
+	static constexpr size_t headerSize{16};
+
+	uint16_t getLength() const
+	{
+		return tu_ntohs(length_be);
+	}
+};
+
+static_assert(sizeof(SenseIU) == SenseIU::headerSize + 18, "Bad SenseIU");
+
+struct TU_ATTR_PACKED ResponseIU : public Header {
+	uint8_t info[3];
+	ResponseCode code;
+};
+
+static_assert(sizeof(ResponseIU) == 8, "Bad ResponseIU");
+
+struct TU_ATTR_PACKED TaskManagementIU : public Header {
+	TaskFunction function;
+	uint8_t reserved5;
+	uint16_t taskTag_be; ///< Tag of task to be managed
+	uint8_t lun[8];
+
+	uint16_t getTaskTag() const
+	{
+		return tu_ntohs(taskTag_be);
+	}
+
+	uint8_t getLun() const
+	{
+		return lun[1];
+	}
+};
+
+static_assert(sizeof(TaskManagementIU) == 16, "Bad TaskManagementIU");
+
+/**
+ * @brief READ READY and WRITE READY IUs consist of a header only
+ */
+using ReadyIU = Header;
+
+/**
+ * @brief Buffer large enough to hold any information unit
+ */
+union IU {
+	Header header;
+	CommandIU command;
+	SenseIU sense;
+	ResponseIU response;
+	TaskManagementIU taskManagement;
+	ReadyIU ready;
+};
+
+} // namespace USB::MSC::UAS
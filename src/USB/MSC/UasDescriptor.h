@@ -0,0 +1,58 @@
+/****
+ * MSC/UasDescriptor.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Descriptor macros for USB Attached SCSI (UAS) interfaces.
+ * This header is included by generated C code so must remain C-compatible.
+ *
+ ****/
+
+#pragma once
+
+#include <tusb.h>
+
+#define MSC_PROTOCOL_UAS 0x62
+
+// Pipe usage descriptor, class-specific interface descriptor type
+#define UAS_DESC_PIPE_USAGE 0x24
+
+#define UAS_PIPE_ID_COMMAND 1
+#define UAS_PIPE_ID_STATUS 2
+#define UAS_PIPE_ID_DATA_IN 3
+#define UAS_PIPE_ID_DATA_OUT 4
+
+#define TUD_MSC_UAS_DESC_LEN (2 * 9 + 2 * 7 + 4 * (7 + 4))
+
+#define _TUD_MSC_UAS_PIPE(_epaddr, _epsize, _pipe_id)                                                                  \
+	7, TUSB_DESC_ENDPOINT, _epaddr, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0, 4, UAS_DESC_PIPE_USAGE, _pipe_id, 0
+
+/*
+ * Interface number, string index, EP command OUT, EP status IN, EP data IN, EP data OUT, EP size
+ *
+ * Alternate 0 provides Bulk-Only Transport using the data endpoints, as required by the specification.
+ * Alternate 1 provides UAS with four pipes.
+ */
+#define TUD_MSC_UAS_DESCRIPTOR(_itfnum, _stridx, _ep_cmd, _ep_status, _ep_data_in, _ep_data_out, _epsize)              \
+	/* Alternate 0: Bulk-Only Transport */                                                                             \
+	9, TUSB_DESC_INTERFACE, _itfnum, 0, 2, TUSB_CLASS_MSC, MSC_SUBCLASS_SCSI, MSC_PROTOCOL_BOT, _stridx,               \
+	7, TUSB_DESC_ENDPOINT, _ep_data_out, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0,                                    \
+	7, TUSB_DESC_ENDPOINT, _ep_data_in, TUSB_XFER_BULK, U16_TO_U8S_LE(_epsize), 0,                                     \
+	/* Alternate 1: USB Attached SCSI */                                                                               \
+	9, TUSB_DESC_INTERFACE, _itfnum, 1, 4, TUSB_CLASS_MSC, MSC_SUBCLASS_SCSI, MSC_PROTOCOL_UAS, _stridx,               \
+	_TUD_MSC_UAS_PIPE(_ep_cmd, _epsize, UAS_PIPE_ID_COMMAND),                                                          \
+	_TUD_MSC_UAS_PIPE(_ep_status, _epsize, UAS_PIPE_ID_STATUS),                                                        \
+	_TUD_MSC_UAS_PIPE(_ep_data_in, _epsize, UAS_PIPE_ID_DATA_IN),                                                      \
+	_TUD_MSC_UAS_PIPE(_ep_data_out, _epsize, UAS_PIPE_ID_DATA_OUT)
@@ -0,0 +1,958 @@
+/****
+ * MSC/UasDevice.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ * USB Attached SCSI device implementation.
+ *
+ * This is provided as an application class driver which claims MSC interfaces offering a UAS alternate.
+ * Alternate 0 (Bulk-Only Transport) is delegated to the standard TinyUSB MSC driver.
+ * Both transports serve the same logical units as registered with `MSC::Device::setLogicalUnit()`.
+ *
+ ****/
+
+#include <USB.h>
+
+#if defined(ENABLE_USB_CLASSES) && CFG_TUD_MSC && CFG_TUD_MSC_UAS_QUEUE_DEPTH
+
+#include "UAS.h"
+#include <device/dcd.h>
+#include <device/usbd_pvt.h>
+#include <SimpleTimer.h>
+#include <debug_progmem.h>
+
+namespace USB::MSC
+{
+namespace
+{
+using namespace UAS;
+
+// SCSI commands not enumerated by TinyUSB
+enum : uint8_t {
+	SCSI_CMD_SYNCHRONIZE_CACHE_10 = 0x35,
+	SCSI_CMD_REPORT_LUNS = 0xa0,
+};
+
+// Additional sense codes
+enum : uint8_t {
+	ASC_NONE = 0x00,
+	ASC_UNRECOVERED_READ_ERROR = 0x11,
+	ASC_INVALID_COMMAND = 0x20,
+	ASC_LBA_OUT_OF_RANGE = 0x21,
+	ASC_LUN_NOT_SUPPORTED = 0x25,
+	ASC_WRITE_PROTECTED = 0x27,
+	ASC_WRITE_ERROR = 0x0c,
+	ASC_MEDIUM_NOT_PRESENT = 0x3a,
+};
+
+constexpr size_t queueDepth{CFG_TUD_MSC_UAS_QUEUE_DEPTH};
+constexpr size_t pipeCount{4};
+
+/*
+ * The scheduler prefers commands which continue sequentially from the last transfer,
+ * then the nearest LBA. This limits how often the oldest command may be passed over.
+ */
+constexpr uint8_t maxBypass{8};
+
+// Poll interval whilst a logical unit reports it is busy
+constexpr uint32_t busyRetryMs{1};
+
+uint16_t getBE16(const uint8_t* p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+uint32_t getBE32(const uint8_t* p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+void putBE32(uint8_t* p, uint32_t value)
+{
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value;
+}
+
+struct Task {
+	enum class Phase : uint8_t {
+		free,
+		queued,
+		ready, ///< Waiting to send READ READY / WRITE READY
+		data,
+		sense, ///< Waiting to send SENSE IU
+	};
+
+	CommandIU iu;
+	uint32_t sequence; ///< Arrival order
+	uint32_t lba;
+	uint32_t length; ///< Bytes to transfer
+	uint32_t offset; ///< Bytes transferred so far
+	uint16_t tag;
+	Phase phase;
+	uint8_t lun;
+	uint8_t bypassCount;
+	uint8_t senseKey;
+	uint8_t asc;
+	bool dataIn;  ///< Transfer direction
+	bool storage; ///< Data comes from / goes to logical unit (READ/WRITE)
+	bool aborted; ///< Ends without status once any transfer in progress has finished
+
+	bool isStorageCommand() const
+	{
+		return iu.cdb[0] == SCSI_CMD_READ_10 || iu.cdb[0] == SCSI_CMD_WRITE_10;
+	}
+
+	void setSense(uint8_t key, uint8_t code)
+	{
+		senseKey = key;
+		asc = code;
+		length = 0;
+	}
+};
+
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t commandBuffer[64];
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN IU statusBuffer;
+CFG_TUSB_MEM_SECTION CFG_TUSB_MEM_ALIGN uint8_t dataBuffer[CFG_TUD_MSC_EP_BUFSIZE];
+
+class UasInterface
+{
+public:
+	void reset()
+	{
+		botItf = nullptr;
+		botLength = 0;
+		alt = 0;
+		resetTasks();
+	}
+
+	uint16_t open(uint8_t rhport, const tusb_desc_interface_t* itf_desc, uint16_t max_len);
+	bool control(uint8_t rhport, uint8_t stage, const tusb_control_request_t* request);
+	bool transferComplete(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes);
+
+	bool isActive() const
+	{
+		return alt == 1;
+	}
+
+private:
+	enum class StatusIU : uint8_t {
+		none,
+		ready,
+		sense,
+		response,
+	};
+
+	uint8_t pipeAddress(PipeId id) const
+	{
+		return pipes[unsigned(id) - 1]->bEndpointAddress;
+	}
+
+	void resetTasks()
+	{
+		retryTimer.stop();
+		for(auto& task : tasks) {
+			task.phase = Task::Phase::free;
+		}
+		active = nullptr;
+		statusIU = StatusIU::none;
+		commandArmed = false;
+		responsePending = false;
+		lastLun = 0;
+		nextLba = 0;
+	}
+
+	bool selectAlternate(uint8_t newAlt);
+	void receiveCommand();
+	void commandReceived(uint32_t length);
+	void taskManagement(const TaskManagementIU& tm);
+	void queueResponse(uint16_t tag, ResponseCode code);
+	void abort(Task& task);
+	unsigned abortTasks(uint8_t lun, bool allLuns);
+	Task* findTask(uint16_t tag);
+	Task* selectNext();
+	void start(Task& task);
+	void service();
+	bool sendStatus(StatusIU type, uint16_t length);
+	void sendReady();
+	void sendSense();
+	void sendData();
+	void receiveData();
+	void retryData();
+	void complete();
+
+	const tusb_desc_interface_t* botItf{};
+	const tusb_desc_endpoint_t* botEndpoints[2]{};
+	const tusb_desc_endpoint_t* pipes[pipeCount]{};
+	Task tasks[queueDepth]{};
+	Task* active{};
+	SimpleTimer retryTimer;
+	uint32_t sequence{0};
+	uint32_t nextLba{0};
+	uint16_t botLength{0};
+	ResponseIU pendingResponse{};
+	uint8_t rhport{0};
+	uint8_t alt{0};
+	uint8_t lastLun{0};
+	StatusIU statusIU{};
+	bool commandArmed{false};
+	bool responsePending{false};
+};
+
+UasInterface uas;
+
+uint16_t UasInterface::open(uint8_t rhport, const tusb_desc_interface_t* itf_desc, uint16_t max_len)
+{
+	TU_VERIFY(itf_desc->bInterfaceClass == TUSB_CLASS_MSC && itf_desc->bAlternateSetting == 0, 0);
+
+	// Scan all alternates for this interface, looking for a UAS pipe set
+	const tusb_desc_endpoint_t* uasPipes[pipeCount]{};
+	bool hasUas{false};
+	uint8_t curAlt{0};
+	auto start = reinterpret_cast<const uint8_t*>(itf_desc);
+	auto end = start + max_len;
+	auto desc = start;
+	uint16_t length{0};
+	for(; desc < end; desc = tu_desc_next(desc)) {
+		auto type = tu_desc_type(desc);
+		if(type == TUSB_DESC_INTERFACE_ASSOCIATION) {
+			break;
+		}
+		if(type == TUSB_DESC_INTERFACE) {
+			auto itf = reinterpret_cast<const tusb_desc_interface_t*>(desc);
+			if(itf->bInterfaceNumber != itf_desc->bInterfaceNumber) {
+				break;
+			}
+			curAlt = itf->bAlternateSetting;
+			if(itf->bInterfaceProtocol == MSC_PROTOCOL_UAS) {
+				hasUas = (curAlt == 1);
+			}
+		} else if(type == TUSB_DESC_ENDPOINT && curAlt == 1 && hasUas) {
+			auto usage = tu_desc_next(desc);
+			if(usage < end && tu_desc_type(usage) == UAS_DESC_PIPE_USAGE) {
+				unsigned id = usage[2];
+				if(id >= 1 && id <= pipeCount) {
+					uasPipes[id - 1] = reinterpret_cast<const tusb_desc_endpoint_t*>(desc);
+				}
+			}
+		}
+		length = desc + tu_desc_len(desc) - start;
+	}
+
+	// Plain BOT interfaces are left to the standard driver
+	if(!hasUas) {
+		return 0;
+	}
+	for(auto ep : uasPipes) {
+		if(ep == nullptr) {
+			debug_e("[UAS] Incomplete pipe set");
+			return 0;
+		}
+	}
+
+	auto len = mscd_open(rhport, itf_desc, length);
+	TU_VERIFY(len != 0, 0);
+
+	this->rhport = rhport;
+	botItf = itf_desc;
+	botLength = len;
+	auto ep = tu_desc_next(itf_desc);
+	botEndpoints[0] = reinterpret_cast<const tusb_desc_endpoint_t*>(ep);
+	botEndpoints[1] = reinterpret_cast<const tusb_desc_endpoint_t*>(tu_desc_next(ep));
+	memcpy(pipes, uasPipes, sizeof(pipes));
+	alt = 0;
+	resetTasks();
+
+	debug_i("[UAS] Interface %u opened, queue depth %u", itf_desc->bInterfaceNumber, queueDepth);
+
+	return length;
+}
+
+bool UasInterface::control(uint8_t rhport, uint8_t stage, const tusb_control_request_t* request)
+{
+	if(request->bmRequestType_bit.recipient == TUSB_REQ_RCPT_INTERFACE &&
+	   request->bmRequestType_bit.type == TUSB_REQ_TYPE_STANDARD) {
+		if(stage != CONTROL_STAGE_SETUP) {
+			return true;
+		}
+		switch(request->bRequest) {
+		case TUSB_REQ_GET_INTERFACE:
+			return tud_control_xfer(rhport, request, &alt, 1);
+		case TUSB_REQ_SET_INTERFACE:
+			TU_VERIFY(selectAlternate(tu_u16_low(request->wValue)));
+			return tud_control_status(rhport, request);
+		default:
+			return false;
+		}
+	}
+
+	if(alt == 0) {
+		return mscd_control_xfer_cb(rhport, stage, request);
+	}
+
+	// UAS defines no class-specific requests
+	return false;
+}
+
+bool UasInterface::selectAlternate(uint8_t newAlt)
+{
+	if(newAlt > 1) {
+		return false;
+	}
+	if(newAlt == alt) {
+		return true;
+	}
+
+	// Endpoints are shared between alternates so must be closed and re-opened
+	if(dcd_edpt_close == nullptr) {
+		debug_w("[UAS] Port cannot close endpoints, UAS unavailable");
+		return false;
+	}
+
+	if(newAlt == 1) {
+		for(auto ep : botEndpoints) {
+			usbd_edpt_close(rhport, ep->bEndpointAddress);
+		}
+		for(auto ep : pipes) {
+			TU_ASSERT(usbd_edpt_open(rhport, ep));
+		}
+		alt = 1;
+		resetTasks();
+		receiveCommand();
+		debug_i("[UAS] Active");
+		return true;
+	}
+
+	for(auto ep : pipes) {
+		usbd_edpt_close(rhport, ep->bEndpointAddress);
+	}
+	alt = 0;
+	resetTasks();
+	mscd_reset(rhport);
+	TU_ASSERT(mscd_open(rhport, botItf, botLength) != 0);
+	debug_i("[UAS] Reverted to BOT");
+	return true;
+}
+
+bool UasInterface::transferComplete(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+	if(alt == 0) {
+		return mscd_xfer_cb(rhport, ep_addr, result, xferred_bytes);
+	}
+
+	if(result != XFER_RESULT_SUCCESS) {
+		debug_w("[UAS] EP 0x%02x xfer result %u", ep_addr, result);
+	}
+
+	if(ep_addr == pipeAddress(PipeId::command)) {
+		commandArmed = false;
+		if(result == XFER_RESULT_SUCCESS) {
+			commandReceived(xferred_bytes);
+		}
+	} else if(ep_addr == pipeAddress(PipeId::status)) {
+		auto type = statusIU;
+		statusIU = StatusIU::none;
+		switch(type) {
+		case StatusIU::ready:
+			if(active->aborted) {
+				complete();
+				break;
+			}
+			active->phase = Task::Phase::data;
+			if(active->dataIn) {
+				sendData();
+			} else {
+				receiveData();
+			}
+			break;
+		case StatusIU::sense:
+			complete();
+			break;
+		case StatusIU::response:
+			responsePending = false;
+			break;
+		case StatusIU::none:
+			break;
+		}
+	} else if(active != nullptr && active->phase == Task::Phase::data) {
+		auto& task = *active;
+		if(ep_addr == pipeAddress(PipeId::dataOut) && task.storage && task.senseKey == SCSI_SENSE_NONE &&
+		   !task.aborted) {
+			if(Device::write(task.lun, task.lba, task.offset, dataBuffer, xferred_bytes) < 0) {
+				task.senseKey = SCSI_SENSE_MEDIUM_ERROR;
+				task.asc = ASC_WRITE_ERROR;
+			}
+		}
+		task.offset += xferred_bytes;
+		if(task.aborted) {
+			complete();
+		} else if(result != XFER_RESULT_SUCCESS || xferred_bytes == 0 || task.offset >= task.length) {
+			// Short packet terminates transfer
+			task.phase = Task::Phase::sense;
+		} else if(task.dataIn) {
+			sendData();
+		} else {
+			receiveData();
+		}
+	}
+
+	receiveCommand();
+	service();
+	return true;
+}
+
+void UasInterface::receiveCommand()
+{
+	if(alt != 1 || commandArmed || responsePending) {
+		return;
+	}
+
+	// Hold off the host (NAK) until there's a free slot
+	bool haveSlot{false};
+	for(auto& task : tasks) {
+		if(task.phase == Task::Phase::free) {
+			haveSlot = true;
+			break;
+		}
+	}
+	if(!haveSlot) {
+		return;
+	}
+
+	commandArmed = usbd_edpt_xfer(rhport, pipeAddress(PipeId::command), commandBuffer, sizeof(commandBuffer));
+}
+
+Task* UasInterface::findTask(uint16_t tag)
+{
+	for(auto& task : tasks) {
+		if(task.phase != Task::Phase::free && task.tag == tag) {
+			return &task;
+		}
+	}
+	return nullptr;
+}
+
+void UasInterface::commandReceived(uint32_t length)
+{
+	auto& hdr = *reinterpret_cast<const Header*>(commandBuffer);
+	if(length < sizeof(Header)) {
+		return;
+	}
+
+	auto tag = hdr.getTag();
+
+	if(hdr.id == IuId::taskManagement && length >= sizeof(TaskManagementIU)) {
+		taskManagement(*reinterpret_cast<const TaskManagementIU*>(commandBuffer));
+		return;
+	}
+
+	if(hdr.id != IuId::command || length < sizeof(CommandIU)) {
+		queueResponse(tag, ResponseCode::invalidIU);
+		return;
+	}
+
+	if(findTask(tag) != nullptr) {
+		// Host has lost track of its commands so the whole task set is aborted
+		debug_w("[UAS] Overlapped tag %u", tag);
+		abortTasks(0, true);
+		queueResponse(tag, ResponseCode::overlappedTag);
+		return;
+	}
+
+	for(auto& task : tasks) {
+		if(task.phase != Task::Phase::free) {
+			continue;
+		}
+		memcpy(&task.iu, commandBuffer, sizeof(task.iu));
+		task.tag = tag;
+		task.lun = task.iu.getLun();
+		task.sequence = sequence++;
+		task.bypassCount = 0;
+		task.aborted = false;
+		task.lba = task.isStorageCommand() ? getBE32(&task.iu.cdb[2]) : 0;
+		task.phase = Task::Phase::queued;
+		return;
+	}
+}
+
+/*
+ * A queued task is discarded. The active task may have a transfer in progress,
+ * so it ends once that finishes.
+ */
+void UasInterface::abort(Task& task)
+{
+	if(&task == active) {
+		task.aborted = true;
+	} else {
+		task.phase = Task::Phase::free;
+	}
+}
+
+unsigned UasInterface::abortTasks(uint8_t lun, bool allLuns)
+{
+	unsigned count{0};
+	for(auto& task : tasks) {
+		if(task.phase != Task::Phase::free && !task.aborted && (allLuns || task.lun == lun)) {
+			abort(task);
+			++count;
+		}
+	}
+	return count;
+}
+
+void UasInterface::taskManagement(const TaskManagementIU& tm)
+{
+	auto code = ResponseCode::complete;
+	auto lun = tm.getLun();
+
+	switch(tm.function) {
+	case TaskFunction::abortTask: {
+		auto task = findTask(tm.getTaskTag());
+		if(task != nullptr) {
+			abort(*task);
+		}
+		break;
+	}
+	case TaskFunction::abortTaskSet:
+	case TaskFunction::clearTaskSet:
+	case TaskFunction::logicalUnitReset:
+		abortTasks(lun, false);
+		break;
+	case TaskFunction::itNexusReset:
+		abortTasks(0, true);
+		break;
+	case TaskFunction::queryTask:
+		code = findTask(tm.getTaskTag()) ? ResponseCode::succeeded : ResponseCode::complete;
+		break;
+	default:
+		code = ResponseCode::notSupported;
+	}
+
+	debug_d("[UAS] TMF 0x%02x, tag %u: 0x%02x", unsigned(tm.function), tm.getTaskTag(), unsigned(code));
+
+	queueResponse(tm.getTag(), code);
+}
+
+void UasInterface::queueResponse(uint16_t tag, ResponseCode code)
+{
+	pendingResponse = {};
+	pendingResponse.id = IuId::response;
+	pendingResponse.setTag(tag);
+	pendingResponse.code = code;
+	responsePending = true;
+}
+
+Task* UasInterface::selectNext()
+{
+	Task* oldest{};
+	Task* head{};
+	uint32_t barrier{UINT32_MAX};
+	for(auto& task : tasks) {
+		if(task.phase != Task::Phase::queued) {
+			continue;
+		}
+		auto attr = task.iu.getAttribute();
+		if(attr == TaskAttribute::headOfQueue && (!head || task.sequence < head->sequence)) {
+			head = &task;
+		}
+		if(attr == TaskAttribute::ordered && task.sequence < barrier) {
+			barrier = task.sequence;
+		}
+		if(!oldest || task.sequence < oldest->sequence) {
+			oldest = &task;
+		}
+	}
+
+	if(head) {
+		return head;
+	}
+	if(!oldest || oldest->sequence == barrier || oldest->bypassCount >= maxBypass) {
+		return oldest;
+	}
+
+	/*
+	 * Rank candidates which arrived before any ORDERED task:
+	 *  - Commands without storage access are cheap so go first
+	 *  - Then a transfer which continues from the previous one
+	 *  - Then the nearest LBA
+	 */
+	auto rank = [&](const Task& task) -> uint64_t {
+		if(!task.isStorageCommand()) {
+			return 0;
+		}
+		if(task.lun != lastLun) {
+			return 1ULL << 33;
+		}
+		uint32_t distance = (task.lba >= nextLba) ? task.lba - nextLba : nextLba - task.lba;
+		return (1ULL << 32) | distance;
+	};
+
+	Task* best{};
+	uint64_t bestRank{};
+	for(auto& task : tasks) {
+		if(task.phase != Task::Phase::queued || task.sequence >= barrier) {
+			continue;
+		}
+		auto r = rank(task);
+		if(!best || r < bestRank || (r == bestRank && task.sequence < best->sequence)) {
+			best = &task;
+			bestRank = r;
+		}
+	}
+
+	for(auto& task : tasks) {
+		if(task.phase == Task::Phase::queued && task.sequence < best->sequence) {
+			++task.bypassCount;
+		}
+	}
+
+	return best;
+}
+
+void UasInterface::start(Task& task)
+{
+	auto cdb = task.iu.cdb;
+	auto lun = task.lun;
+
+	task.offset = 0;
+	task.length = 0;
+	task.dataIn = true;
+	task.storage = false;
+	task.senseKey = SCSI_SENSE_NONE;
+	task.asc = ASC_NONE;
+
+	Device::beginCommand(lun, cdb[0], task.lba);
+
+	auto checkReady = [&]() -> bool {
+		if(Device::isReady(lun)) {
+			return true;
+		}
+		task.setSense(SCSI_SENSE_NOT_READY, ASC_MEDIUM_NOT_PRESENT);
+		return false;
+	};
+
+	auto respond = [&](uint32_t responseLength, uint32_t allocLength) {
+		task.length = std::min(responseLength, allocLength);
+	};
+
+	uint32_t blockCount{0};
+	uint16_t blockSize{0};
+	Device::getCapacity(lun, &blockCount, &blockSize);
+
+	if(lun >= Device::MAX_LUN && cdb[0] != SCSI_CMD_REPORT_LUNS && cdb[0] != SCSI_CMD_INQUIRY) {
+		task.setSense(SCSI_SENSE_ILLEGAL_REQUEST, ASC_LUN_NOT_SUPPORTED);
+		task.phase = Task::Phase::sense;
+		return;
+	}
+
+	switch(cdb[0]) {
+	case SCSI_CMD_READ_10:
+	case SCSI_CMD_WRITE_10: {
+		if(!checkReady()) {
+			break;
+		}
+		uint32_t count = getBE16(&cdb[7]);
+		bool isWrite = (cdb[0] == SCSI_CMD_WRITE_10);
+		if(task.lba > blockCount || count > blockCount - task.lba) {
+			task.setSense(SCSI_SENSE_ILLEGAL_REQUEST, ASC_LBA_OUT_OF_RANGE);
+			break;
+		}
+		if(isWrite && Device::isReadOnly(lun)) {
+			task.setSense(SCSI_SENSE_DATA_PROTECT, ASC_WRITE_PROTECTED);
+			break;
+		}
+		task.length = count * blockSize;
+		task.dataIn = !isWrite;
+		task.storage = true;
+		break;
+	}
+
+	case SCSI_CMD_TEST_UNIT_READY:
+		checkReady();
+		break;
+
+	case SCSI_CMD_INQUIRY: {
+		memset(dataBuffer, 0, 36);
+		dataBuffer[1] = 0x80; // Removable
+		dataBuffer[2] = 2;	// SPC-2
+		dataBuffer[3] = 2;	// Response data format
+		dataBuffer[4] = 36 - 5;
+		memset(&dataBuffer[8], ' ', 8 + 16 + 4);
+		if(lun < Device::MAX_LUN) {
+			Device::inquiry(lun, &dataBuffer[8], &dataBuffer[16], &dataBuffer[32]);
+		} else {
+			dataBuffer[0] = 0x7f; // Peripheral not present
+		}
+		respond(36, getBE16(&cdb[3]));
+		break;
+	}
+
+	case SCSI_CMD_READ_CAPACITY_10:
+		if(checkReady()) {
+			putBE32(&dataBuffer[0], blockCount - 1);
+			putBE32(&dataBuffer[4], blockSize);
+			respond(8, 8);
+		}
+		break;
+
+	case SCSI_CMD_READ_FORMAT_CAPACITY:
+		if(checkReady()) {
+			memset(dataBuffer, 0, 12);
+			dataBuffer[3] = 8; // Capacity list length
+			putBE32(&dataBuffer[4], blockCount);
+			putBE32(&dataBuffer[8], blockSize);
+			dataBuffer[8] = 2; // Formatted media
+			respond(12, getBE16(&cdb[7]));
+		}
+		break;
+
+	case SCSI_CMD_MODE_SENSE_6:
+		dataBuffer[0] = 3; // Mode data length
+		dataBuffer[1] = 0; // Medium type
+		dataBuffer[2] = Device::isReadOnly(lun) ? 0x80 : 0x00;
+		dataBuffer[3] = 0; // Block descriptor length
+		respond(4, cdb[4]);
+		break;
+
+	case SCSI_CMD_REQUEST_SENSE:
+		// Sense data is returned in SENSE IU, so there's never anything pending
+		memset(dataBuffer, 0, 18);
+		dataBuffer[0] = 0x70;
+		dataBuffer[7] = 18 - 8;
+		respond(18, cdb[4]);
+		break;
+
+	case SCSI_CMD_START_STOP_UNIT:
+	case SCSI_CMD_PREVENT_ALLOW_MEDIUM_REMOVAL:
+	case SCSI_CMD_SYNCHRONIZE_CACHE_10:
+		break;
+
+	case SCSI_CMD_REPORT_LUNS: {
+		unsigned count{0};
+		memset(dataBuffer, 0, 8 + 8 * Device::MAX_LUN);
+		for(unsigned i = 0; i < Device::MAX_LUN; ++i) {
+			if(Device::isReady(i)) {
+				dataBuffer[8 + 8 * count + 1] = i;
+				++count;
+			}
+		}
+		putBE32(&dataBuffer[0], 8 * count);
+		respond(8 + 8 * count, getBE32(&cdb[6]));
+		break;
+	}
+
+	default:
+		debug_d("[UAS] Unsupported SCSI command 0x%02x", cdb[0]);
+		task.setSense(SCSI_SENSE_ILLEGAL_REQUEST, ASC_INVALID_COMMAND);
+	}
+
+	task.phase = task.length ? Task::Phase::ready : Task::Phase::sense;
+}
+
+void UasInterface::service()
+{
+	if(statusIU != StatusIU::none) {
+		// Status pipe busy
+		return;
+	}
+
+	if(responsePending) {
+		statusBuffer.response = pendingResponse;
+		sendStatus(StatusIU::response, sizeof(ResponseIU));
+		return;
+	}
+
+	if(active != nullptr && active->aborted && active->phase != Task::Phase::data) {
+		// READY or SENSE not yet sent
+		complete();
+	}
+
+	if(active == nullptr) {
+		active = selectNext();
+		if(active == nullptr) {
+			return;
+		}
+		start(*active);
+	}
+
+	switch(active->phase) {
+	case Task::Phase::ready:
+		sendReady();
+		break;
+	case Task::Phase::sense:
+		sendSense();
+		break;
+	default:;
+	}
+}
+
+bool UasInterface::sendStatus(StatusIU type, uint16_t length)
+{
+	statusIU = type;
+	if(usbd_edpt_xfer(rhport, pipeAddress(PipeId::status), reinterpret_cast<uint8_t*>(&statusBuffer), length)) {
+		return true;
+	}
+	statusIU = StatusIU::none;
+	return false;
+}
+
+void UasInterface::sendReady()
+{
+	auto& iu = statusBuffer.ready;
+	iu = {};
+	iu.id = active->dataIn ? IuId::readReady : IuId::writeReady;
+	iu.setTag(active->tag);
+	sendStatus(StatusIU::ready, sizeof(iu));
+}
+
+void UasInterface::sendSense()
+{
+	auto& task = *active;
+	auto& iu = statusBuffer.sense;
+	memset(&iu, 0, sizeof(iu));
+	iu.id = IuId::sense;
+	iu.setTag(task.tag);
+	uint16_t length = SenseIU::headerSize;
+	if(task.senseKey == SCSI_SENSE_NONE) {
+		iu.status = Status::good;
+	} else {
+		iu.status = Status::checkCondition;
+		iu.length_be = tu_htons(sizeof(iu.sense));
+		iu.sense.response_code = 0x70;
+		iu.sense.valid = 1;
+		iu.sense.sense_key = task.senseKey;
+		iu.sense.add_sense_len = sizeof(iu.sense) - 8;
+		iu.sense.add_sense_code = task.asc;
+		length = sizeof(iu);
+	}
+	sendStatus(StatusIU::sense, length);
+}
+
+void UasInterface::sendData()
+{
+	auto& task = *active;
+	uint32_t n = std::min(task.length - task.offset, uint32_t(sizeof(dataBuffer)));
+	if(task.storage) {
+		int res = Device::read(task.lun, task.lba, task.offset, dataBuffer, n);
+		if(res == 0) {
+			// Logical unit is busy, try again later
+			retryTimer.initializeMs<busyRetryMs>([](void*) { uas.retryData(); }).startOnce();
+			return;
+		}
+		if(res < 0) {
+			task.senseKey = SCSI_SENSE_MEDIUM_ERROR;
+			task.asc = ASC_UNRECOVERED_READ_ERROR;
+			task.phase = Task::Phase::sense;
+			return;
+		}
+	}
+	usbd_edpt_xfer(rhport, pipeAddress(PipeId::dataIn), dataBuffer, n);
+}
+
+void UasInterface::retryData()
+{
+	if(active == nullptr || active->phase != Task::Phase::data) {
+		return;
+	}
+	if(active->aborted) {
+		complete();
+	} else {
+		sendData();
+	}
+	receiveCommand();
+	service();
+}
+
+void UasInterface::receiveData()
+{
+	auto& task = *active;
+	uint32_t n = std::min(task.length - task.offset, uint32_t(sizeof(dataBuffer)));
+	usbd_edpt_xfer(rhport, pipeAddress(PipeId::dataOut), dataBuffer, n);
+}
+
+void UasInterface::complete()
+{
+	auto& task = *active;
+	if(task.storage) {
+		if(!task.dataIn) {
+			Device::flush(task.lun);
+		}
+		lastLun = task.lun;
+		uint16_t blockSize{0};
+		uint32_t blockCount{0};
+		Device::getCapacity(task.lun, &blockCount, &blockSize);
+		nextLba = task.lba + (blockSize ? task.offset / blockSize : 0);
+	}
+	Device::endCommand(task.lun, task.senseKey == SCSI_SENSE_NONE && !task.aborted);
+	task.phase = Task::Phase::free;
+	active = nullptr;
+}
+
+void uasd_init()
+{
+	uas.reset();
+}
+
+void uasd_reset(uint8_t rhport)
+{
+	(void)rhport;
+	uas.reset();
+}
+
+uint16_t uasd_open(uint8_t rhport, const tusb_desc_interface_t* itf_desc, uint16_t max_len)
+{
+	return uas.open(rhport, itf_desc, max_len);
+}
+
+bool uasd_control_xfer_cb(uint8_t rhport, uint8_t stage, const tusb_control_request_t* request)
+{
+	return uas.control(rhport, stage, request);
+}
+
+bool uasd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+	return uas.transferComplete(rhport, ep_addr, result, xferred_bytes);
+}
+
+} // namespace
+
+bool Device::isUasActive()
+{
+	return uas.isActive();
+}
+
+/*
+ * Application class driver for UAS interfaces, registered in USB.cpp
+ */
+const usbd_class_driver_t* getUasDriver()
+{
+	static usbd_class_driver_t driver;
+	if(driver.open == nullptr) {
+#if CFG_TUSB_DEBUG >= 2
+		driver.name = "UAS";
+#endif
+		driver.init = uasd_init;
+		driver.reset = uasd_reset;
+		driver.open = uasd_open;
+		driver.control_xfer_cb = uasd_control_xfer_cb;
+		driver.xfer_cb = uasd_xfer_cb;
+	}
+	return &driver;
+}
+
+} // namespace USB::MSC
+
+#endif
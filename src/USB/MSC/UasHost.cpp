@@ -0,0 +1,539 @@
+/****
+ * MSC/UasHost.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if defined(ENABLE_USB_CLASSES) && CFG_TUH_MSC && CFG_TUH_MSC_UAS_QUEUE_DEPTH
+
+#include "UasHost.h"
+#include <debug_progmem.h>
+#include <algorithm>
+
+namespace USB::MSC
+{
+namespace
+{
+// Each data transfer is limited to 16 bits so split large commands into multiple transfers
+constexpr uint32_t maxDataChunk{0x8000};
+
+// Largest configuration descriptor we'll examine
+constexpr uint16_t maxConfigLength{1024};
+
+} // namespace
+
+bool UasHost::probe(Callback callback)
+{
+	if(state == State::probing) {
+		return false;
+	}
+
+	probeCallback = callback;
+	state = State::probing;
+	if(!requestConfiguration(sizeof(tusb_desc_configuration_t))) {
+		state = State::inactive;
+		probeCallback = nullptr;
+		return false;
+	}
+
+	return true;
+}
+
+bool UasHost::requestConfiguration(uint16_t length)
+{
+	if(length != configLength || !configDesc) {
+		configDesc.reset(new uint8_t[length]);
+		configLength = length;
+	}
+
+	const tusb_control_request_t request = {
+		.bmRequestType_bit =
+			{
+				.recipient = TUSB_REQ_RCPT_DEVICE,
+				.type = TUSB_REQ_TYPE_STANDARD,
+				.direction = TUSB_DIR_IN,
+			},
+		.bRequest = TUSB_REQ_GET_DESCRIPTOR,
+		.wValue = tu_htole16(TUSB_DESC_CONFIGURATION << 8),
+		.wIndex = 0,
+		.wLength = tu_htole16(length),
+	};
+
+	// Control pipe may be in use whilst other interfaces are being configured, so queue it
+	return itf.controlTransfer(request, configDesc.get(), [this](const tuh_xfer_t& xfer) {
+		if(state == State::probing) {
+			configurationReceived(xfer.result == XFER_RESULT_SUCCESS);
+		}
+	});
+}
+
+bool UasHost::setInterface(uint8_t alternate, HostInterface::ControlCallback callback)
+{
+	const tusb_control_request_t request = {
+		.bmRequestType_bit =
+			{
+				.recipient = TUSB_REQ_RCPT_INTERFACE,
+				.type = TUSB_REQ_TYPE_STANDARD,
+				.direction = TUSB_DIR_OUT,
+			},
+		.bRequest = TUSB_REQ_SET_INTERFACE,
+		.wValue = tu_htole16(alternate),
+		.wIndex = tu_htole16(itfNum),
+		.wLength = 0,
+	};
+
+	return itf.controlTransfer(request, nullptr, callback);
+}
+
+void UasHost::configurationReceived(bool success)
+{
+	if(!success) {
+		debug_e("[UAS] Failed to read configuration descriptor");
+		probeComplete(false);
+		return;
+	}
+
+	auto cfg = reinterpret_cast<const tusb_desc_configuration_t*>(configDesc.get());
+	uint16_t totalLength = tu_le16toh(cfg->wTotalLength);
+	if(configLength < totalLength) {
+		if(totalLength > maxConfigLength) {
+			debug_w("[UAS] Configuration descriptor too large (%u)", totalLength);
+			probeComplete(false);
+			return;
+		}
+		if(!requestConfiguration(totalLength)) {
+			probeComplete(false);
+		}
+		return;
+	}
+
+	if(!parseConfiguration()) {
+		debug_i("[UAS] Device %u doesn't support UAS", dev_addr);
+		probeComplete(false);
+		return;
+	}
+
+	configDesc.reset();
+	configLength = 0;
+
+	auto callback = [this](const tuh_xfer_t& xfer) {
+		if(state == State::probing) {
+			interfaceSelected(xfer.result == XFER_RESULT_SUCCESS);
+		}
+	};
+	if(!setInterface(altSetting, callback)) {
+		probeComplete(false);
+	}
+}
+
+/*
+ * The UAS alternate lists four endpoints, each followed by a pipe usage descriptor.
+ * Data endpoints are typically shared with the Bulk-Only alternate, which TinyUSB has already opened.
+ */
+bool UasHost::parseConfiguration()
+{
+	const uint8_t* ptr = configDesc.get();
+	auto end = ptr + configLength;
+	const tusb_desc_interface_t* itf{};
+	const tusb_desc_endpoint_t* ep{};
+	uint8_t botItf{0xff};
+	unsigned pipeMask{0};
+
+	for(; ptr < end && tu_desc_len(ptr) != 0 && pipeMask != 0x0f; ptr = tu_desc_next(ptr)) {
+		switch(tu_desc_type(ptr)) {
+		case TUSB_DESC_INTERFACE:
+			itf = reinterpret_cast<const tusb_desc_interface_t*>(ptr);
+			ep = nullptr;
+			if(itf->bInterfaceClass != TUSB_CLASS_MSC || itf->bInterfaceSubClass != MSC_SUBCLASS_SCSI) {
+				itf = nullptr;
+				break;
+			}
+			if(itf->bInterfaceProtocol == MSC_PROTOCOL_BOT) {
+				botItf = itf->bInterfaceNumber;
+				memset(botEndpoints, 0, sizeof(botEndpoints));
+			} else if(itf->bInterfaceProtocol == MSC_PROTOCOL_UAS) {
+				itfNum = itf->bInterfaceNumber;
+				altSetting = itf->bAlternateSetting;
+				pipeMask = 0;
+				if(itfNum != botItf) {
+					memset(botEndpoints, 0, sizeof(botEndpoints));
+				}
+			}
+			break;
+
+		case TUSB_DESC_ENDPOINT:
+			if(!itf) {
+				break;
+			}
+			ep = reinterpret_cast<const tusb_desc_endpoint_t*>(ptr);
+			if(itf->bInterfaceProtocol == MSC_PROTOCOL_BOT) {
+				botEndpoints[tu_edpt_dir(ep->bEndpointAddress)] = ep->bEndpointAddress;
+			}
+			break;
+
+		case UAS_DESC_PIPE_USAGE: {
+			if(!itf || !ep || itf->bInterfaceProtocol != MSC_PROTOCOL_UAS) {
+				break;
+			}
+			unsigned pipeId = ptr[2];
+			if(pipeId >= UAS_PIPE_ID_COMMAND && pipeId <= UAS_PIPE_ID_DATA_OUT) {
+				endpoints[pipeId - UAS_PIPE_ID_COMMAND] = *ep;
+				pipeMask |= 1U << (pipeId - UAS_PIPE_ID_COMMAND);
+			}
+			break;
+		}
+
+		default:
+			break;
+		}
+	}
+
+	return pipeMask == 0x0f;
+}
+
+void UasHost::interfaceSelected(bool success)
+{
+	if(!success) {
+		debug_e("[UAS] SET_INTERFACE failed");
+		probeComplete(false);
+		return;
+	}
+
+	for(auto& ep : endpoints) {
+		auto addr = ep.bEndpointAddress;
+		if(addr == botEndpoints[TUSB_DIR_OUT] || addr == botEndpoints[TUSB_DIR_IN]) {
+			continue;
+		}
+		if(!tuh_edpt_open(dev_addr, &ep)) {
+			debug_e("[UAS] Failed to open endpoint 0x%02x", addr);
+			// Revert to Bulk-Only Transport
+			setInterface(0, nullptr);
+			probeComplete(false);
+			return;
+		}
+	}
+
+	debug_i("[UAS] Device %u using UAS, interface %u alt %u", dev_addr, itfNum, altSetting);
+	probeComplete(true);
+}
+
+void UasHost::probeComplete(bool success)
+{
+	configDesc.reset();
+	configLength = 0;
+	state = success ? State::active : State::inactive;
+	auto callback = probeCallback;
+	probeCallback = nullptr;
+	if(callback) {
+		callback(success);
+	}
+}
+
+void UasHost::end()
+{
+	probeCallback = nullptr;
+	configDesc.reset();
+	state = State::idle;
+	commandBusy = false;
+	statusBusy = false;
+	dataTask[0] = dataTask[1] = nullptr;
+	for(auto& task : tasks) {
+		if(task.phase != Task::Phase::free) {
+			complete(task, false);
+		}
+	}
+}
+
+bool UasHost::submit(uint8_t lun, const void* cdb, uint8_t cdbLength, void* buffer, uint32_t length, bool dataIn,
+					 Callback callback)
+{
+	if(state != State::active || cdbLength > sizeof(Task::cdb)) {
+		return false;
+	}
+
+	Task* task{};
+	for(auto& t : tasks) {
+		if(t.phase == Task::Phase::free) {
+			task = &t;
+			break;
+		}
+	}
+	if(!task) {
+		return false;
+	}
+
+	task->phase = Task::Phase::queued;
+	task->dataIn = dataIn;
+	task->lun = lun;
+	task->cdbLength = cdbLength;
+	memcpy(task->cdb, cdb, cdbLength);
+	task->buffer = static_cast<uint8_t*>(buffer);
+	task->length = length;
+	task->offset = 0;
+	task->sequence = sequence++;
+	task->callback = callback;
+	++pending;
+
+	sendNextCommand();
+	receiveStatus();
+	return true;
+}
+
+UasHost::Task* UasHost::findTask(uint16_t tag)
+{
+	unsigned idx = tag - 1;
+	if(idx >= queueDepth || tasks[idx].phase == Task::Phase::free) {
+		return nullptr;
+	}
+	return &tasks[idx];
+}
+
+bool UasHost::transfer(Pipe pipe, void* buffer, uint32_t length)
+{
+	tuh_xfer_t xfer{};
+	xfer.daddr = dev_addr;
+	xfer.ep_addr = endpoints[unsigned(pipe)].bEndpointAddress;
+	xfer.buflen = length;
+	xfer.buffer = static_cast<uint8_t*>(buffer);
+	xfer.complete_cb = transferCallback;
+	xfer.user_data = reinterpret_cast<uintptr_t>(this);
+	return tuh_edpt_xfer(&xfer);
+}
+
+void UasHost::transferCallback(tuh_xfer_t* xfer)
+{
+	auto self = reinterpret_cast<UasHost*>(xfer->user_data);
+	for(unsigned i = 0; i < ARRAY_SIZE(self->endpoints); ++i) {
+		if(self->endpoints[i].bEndpointAddress == xfer->ep_addr) {
+			self->transferComplete(Pipe(i), *xfer);
+			return;
+		}
+	}
+}
+
+void UasHost::sendNextCommand()
+{
+	while(!commandBusy) {
+		// Send commands in the order they were submitted
+		Task* task{};
+		for(auto& t : tasks) {
+			if(t.phase == Task::Phase::queued && (!task || int32_t(t.sequence - task->sequence) < 0)) {
+				task = &t;
+			}
+		}
+		if(!task) {
+			return;
+		}
+
+		memset(&commandBuffer, 0, sizeof(commandBuffer));
+		commandBuffer.id = UAS::IuId::command;
+		commandBuffer.setTag(getTag(*task));
+		// Commands which don't read are ORDERED so the device can't let a later read overtake a write
+		auto attr = task->dataIn ? UAS::TaskAttribute::simple : UAS::TaskAttribute::ordered;
+		commandBuffer.attribute = uint8_t(attr);
+		commandBuffer.setLun(task->lun);
+		memcpy(commandBuffer.cdb, task->cdb, task->cdbLength);
+
+		task->phase = Task::Phase::sent;
+		if(transfer(Pipe::command, &commandBuffer, sizeof(commandBuffer))) {
+			commandBusy = true;
+			return;
+		}
+
+		debug_e("[UAS] Command send failed");
+		complete(*task, false);
+	}
+}
+
+void UasHost::receiveStatus()
+{
+	if(statusBusy || pending == 0) {
+		return;
+	}
+	if(transfer(Pipe::status, &statusBuffer, sizeof(statusBuffer))) {
+		statusBusy = true;
+	}
+}
+
+void UasHost::transferComplete(Pipe pipe, const tuh_xfer_t& xfer)
+{
+	bool success = (xfer.result == XFER_RESULT_SUCCESS);
+
+	switch(pipe) {
+	case Pipe::command: {
+		commandBusy = false;
+		if(!success) {
+			debug_e("[UAS] Command pipe error %u", xfer.result);
+			auto task = findTask(commandBuffer.getTag());
+			if(task) {
+				complete(*task, false);
+			}
+		}
+		sendNextCommand();
+		break;
+	}
+
+	case Pipe::status:
+		statusBusy = false;
+		if(success) {
+			statusReceived(xfer.actual_len);
+		} else {
+			debug_e("[UAS] Status pipe error %u", xfer.result);
+			// Without status we cannot determine which commands have completed
+			dataTask[0] = dataTask[1] = nullptr;
+			for(auto& task : tasks) {
+				if(task.phase == Task::Phase::sent || task.phase == Task::Phase::data) {
+					complete(task, false);
+				}
+			}
+		}
+		receiveStatus();
+		break;
+
+	case Pipe::dataIn:
+	case Pipe::dataOut: {
+		auto& taskPtr = dataTask[pipe == Pipe::dataOut];
+		auto task = taskPtr;
+		if(!task) {
+			break;
+		}
+		if(!success) {
+			// Device still sends SENSE IU for this command
+			debug_e("[UAS] Data pipe error %u", xfer.result);
+			taskPtr = nullptr;
+			break;
+		}
+		continueData(*task, xfer.actual_len);
+		break;
+	}
+	}
+}
+
+void UasHost::statusReceived(uint32_t length)
+{
+	if(length < sizeof(UAS::Header)) {
+		debug_e("[UAS] Short status IU (%u)", length);
+		return;
+	}
+
+	auto tag = statusBuffer.header.getTag();
+	switch(statusBuffer.header.id) {
+	case UAS::IuId::readReady:
+		dataReady(tag, true);
+		break;
+
+	case UAS::IuId::writeReady:
+		dataReady(tag, false);
+		break;
+
+	case UAS::IuId::sense: {
+		auto task = findTask(tag);
+		if(!task) {
+			debug_w("[UAS] SENSE for unknown tag %u", tag);
+			break;
+		}
+		auto& sense = statusBuffer.sense;
+		if(sense.status != UAS::Status::good) {
+			debug_w("[UAS] Tag %u status 0x%02x, sense %u/0x%02x/0x%02x", tag, unsigned(sense.status),
+					sense.sense.sense_key, sense.sense.add_sense_code, sense.sense.add_sense_qualifier);
+		}
+		for(auto& ptr : dataTask) {
+			if(ptr == task) {
+				ptr = nullptr;
+			}
+		}
+		complete(*task, sense.status == UAS::Status::good);
+		break;
+	}
+
+	case UAS::IuId::response: {
+		auto task = findTask(tag);
+		debug_w("[UAS] RESPONSE tag %u, code 0x%02x", tag, unsigned(statusBuffer.response.code));
+		if(task) {
+			for(auto& ptr : dataTask) {
+				if(ptr == task) {
+					ptr = nullptr;
+				}
+			}
+			complete(*task, false);
+		}
+		break;
+	}
+
+	default:
+		debug_e("[UAS] Unexpected IU 0x%02x", unsigned(statusBuffer.header.id));
+	}
+}
+
+void UasHost::dataReady(uint16_t tag, bool dataIn)
+{
+	auto task = findTask(tag);
+	if(!task || task->dataIn != dataIn || task->length == 0) {
+		debug_e("[UAS] Bad %s READY for tag %u", dataIn ? "READ" : "WRITE", tag);
+		return;
+	}
+
+	auto& taskPtr = dataTask[!dataIn];
+	if(taskPtr) {
+		// Only one data phase per direction without streams
+		debug_e("[UAS] Data pipe busy (tag %u)", tag);
+		return;
+	}
+
+	taskPtr = task;
+	task->phase = Task::Phase::data;
+	task->offset = 0;
+	auto chunk = std::min(task->length, maxDataChunk);
+	if(!transfer(dataIn ? Pipe::dataIn : Pipe::dataOut, task->buffer, chunk)) {
+		debug_e("[UAS] Data transfer failed");
+		taskPtr = nullptr;
+	}
+}
+
+void UasHost::continueData(Task& task, uint32_t xferred)
+{
+	auto requested = std::min(task.length - task.offset, maxDataChunk);
+	task.offset += xferred;
+	auto& taskPtr = dataTask[!task.dataIn];
+	// Short packet also terminates data phase
+	if(xferred < requested || task.offset >= task.length) {
+		taskPtr = nullptr;
+		return;
+	}
+
+	auto chunk = std::min(task.length - task.offset, maxDataChunk);
+	if(!transfer(task.dataIn ? Pipe::dataIn : Pipe::dataOut, task.buffer + task.offset, chunk)) {
+		debug_e("[UAS] Data transfer failed");
+		taskPtr = nullptr;
+	}
+}
+
+void UasHost::complete(Task& task, bool success)
+{
+	auto callback = task.callback;
+	task.callback = nullptr;
+	task.phase = Task::Phase::free;
+	--pending;
+	if(callback) {
+		callback(success);
+	}
+}
+
+} // namespace USB::MSC
+
+#endif
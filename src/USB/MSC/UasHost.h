@@ -0,0 +1,187 @@
+/****
+ * MSC/UasHost.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "UAS.h"
+#include "../HostInterface.h"
+#include <Delegate.h>
+#include <memory>
+
+namespace USB::MSC
+{
+/**
+ * @brief USB Attached SCSI transport used by HostDevice
+ *
+ * TinyUSB configures the interface for Bulk-Only Transport. If the device offers a UAS alternate
+ * setting then `probe()` selects it and opens the four pipes. Commands are then issued with tags
+ * so that several may be outstanding at once; the device decides the order in which they complete.
+ * Reads are SIMPLE tasks, other commands are ORDERED, so a read never sees data older than a preceding write.
+ *
+ * Bulk streams are not used, so only one data phase is active at a time per direction.
+ */
+class UasHost
+{
+public:
+	/**
+	 * @brief Callback invoked when probe or command completes
+	 * @param success false on error or if command completed with CHECK CONDITION
+	 */
+	using Callback = Delegate<void(bool success)>;
+
+	static constexpr size_t queueDepth{CFG_TUH_MSC_UAS_QUEUE_DEPTH};
+
+	/**
+	 * @brief Constructor
+	 * @param itf Interface whose control request queue is used for probing
+	 */
+	UasHost(HostInterface& itf) : itf(itf), dev_addr(itf.getAddress())
+	{
+	}
+
+	/**
+	 * @brief Check device for UAS support and select it if available
+	 * @param callback Invoked on completion, success indicates UAS is active
+	 * @retval bool false if probe could not be started
+	 */
+	bool probe(Callback callback);
+
+	/**
+	 * @brief Abort all outstanding commands
+	 */
+	void end();
+
+	bool isActive() const
+	{
+		return state == State::active;
+	}
+
+	bool isProbed() const
+	{
+		return state >= State::inactive;
+	}
+
+	/**
+	 * @brief Determine if a command slot is available
+	 */
+	bool isFull() const
+	{
+		return pending == queueDepth;
+	}
+
+	/**
+	 * @brief Get number of outstanding commands
+	 */
+	unsigned getPending() const
+	{
+		return pending;
+	}
+
+	/**
+	 * @brief Queue a SCSI command
+	 * @param lun Logical Unit Number
+	 * @param cdb Command descriptor block, up to 16 bytes
+	 * @param cdbLength Length of CDB
+	 * @param buffer Data buffer, must remain valid until callback
+	 * @param length Number of bytes to transfer
+	 * @param dataIn true for reads (device to host)
+	 * @param callback Invoked on completion
+	 * @retval bool false if queue is full or transport not active
+	 */
+	bool submit(uint8_t lun, const void* cdb, uint8_t cdbLength, void* buffer, uint32_t length, bool dataIn,
+				Callback callback);
+
+private:
+	enum class State {
+		idle,
+		probing,
+		inactive,
+		active,
+	};
+
+	enum class Pipe {
+		command,
+		status,
+		dataIn,
+		dataOut,
+	};
+
+	struct Task {
+		enum class Phase {
+			free,
+			queued, ///< Waiting to be sent on command pipe
+			sent,
+			data,
+		};
+
+		Phase phase{};
+		bool dataIn;
+		uint8_t lun;
+		uint8_t cdbLength;
+		uint8_t cdb[16];
+		uint8_t* buffer;
+		uint32_t length;
+		uint32_t offset;
+		uint32_t sequence;
+		Callback callback;
+	};
+
+	static void transferCallback(tuh_xfer_t* xfer);
+	void transferComplete(Pipe pipe, const tuh_xfer_t& xfer);
+	bool requestConfiguration(uint16_t length);
+	bool setInterface(uint8_t alternate, HostInterface::ControlCallback callback);
+	void configurationReceived(bool success);
+	bool parseConfiguration();
+	void interfaceSelected(bool success);
+	void probeComplete(bool success);
+	bool transfer(Pipe pipe, void* buffer, uint32_t length);
+	void sendNextCommand();
+	void receiveStatus();
+	void statusReceived(uint32_t length);
+	void dataReady(uint16_t tag, bool dataIn);
+	void continueData(Task& task, uint32_t xferred);
+	void complete(Task& task, bool success);
+	Task* findTask(uint16_t tag);
+
+	uint16_t getTag(const Task& task) const
+	{
+		return 1 + (&task - tasks);
+	}
+
+	HostInterface& itf;
+	uint8_t dev_addr;
+	State state{};
+	uint8_t itfNum{};
+	uint8_t altSetting{};
+	tusb_desc_endpoint_t endpoints[4]{};
+	uint8_t botEndpoints[2]{}; ///< Bulk-Only endpoints already opened by TinyUSB, indexed by direction
+	std::unique_ptr<uint8_t[]> configDesc;
+	uint16_t configLength{};
+	Callback probeCallback;
+	Task tasks[queueDepth];
+	unsigned pending{};
+	uint32_t sequence{};
+	bool commandBusy{};
+	bool statusBusy{};
+	Task* dataTask[2]{}; ///< Task currently using data-in, data-out pipes
+	UAS::CommandIU commandBuffer{};
+	UAS::IU statusBuffer{};
+};
+
+} // namespace USB::MSC
@@ -21,12 +21,44 @@
 
 #if defined(ENABLE_USB_CLASSES) && CFG_TUD_VENDOR
 
+#include <device/usbd_pvt.h>
+#include <debug_progmem.h>
+
 namespace USB::VENDOR
 {
-Device* getDevice(uint8_t inst)
+class InternalDevice : public Device
+{
+public:
+	using Device::bulkOpen;
+	using Device::bulkReset;
+	using Device::bulkTransferComplete;
+	using Device::setInstance;
+
+	uint8_t getInstance() const
+	{
+		return inst;
+	}
+};
+
+InternalDevice* getDeviceByIndex(uint8_t index)
 {
-	extern Device* devices[];
-	return (inst < CFG_TUD_CDC) ? devices[inst] : nullptr;
+	extern InternalDevice* devices[];
+	return (index < CFG_TUD_VENDOR) ? devices[index] : nullptr;
+}
+
+/*
+ * TinyUSB numbers its vendor instances in the order it opens them, skipping interfaces
+ * claimed in bulk mode, so search for the device by instance.
+ */
+InternalDevice* getDevice(uint8_t inst)
+{
+	for(unsigned i = 0; i < CFG_TUD_VENDOR; ++i) {
+		auto dev = getDeviceByIndex(i);
+		if(!dev->isBulkMode() && dev->getInstance() == inst) {
+			return dev;
+		}
+	}
+	return nullptr;
 }
 
 Device::Device(uint8_t idx, const char* name) : DeviceInterface(idx, name), UsbSerial()
@@ -58,6 +90,225 @@ size_t Device::write(const uint8_t* buffer, size_t size)
 	return written;
 }
 
+bool Device::Pipe::push(const Transfer& transfer)
+{
+	if(count >= bulkQueueDepth) {
+		return false;
+	}
+	queue[(head + count) % bulkQueueDepth] = transfer;
+	++count;
+	return true;
+}
+
+bool Device::bulkSend(const void* buffer, size_t length, bool zlp)
+{
+	if(!bulkMode || length > UINT16_MAX) {
+		return false;
+	}
+	if(!in.push({static_cast<uint8_t*>(const_cast<void*>(buffer)), uint32_t(length), zlp})) {
+		return false;
+	}
+	startTransfer(in);
+	return true;
+}
+
+bool Device::bulkReceive(void* buffer, size_t length)
+{
+	if(!bulkMode || length == 0 || length > UINT16_MAX) {
+		return false;
+	}
+	if(!out.push({static_cast<uint8_t*>(buffer), uint32_t(length), false})) {
+		return false;
+	}
+	startTransfer(out);
+	return true;
+}
+
+void Device::startTransfer(Pipe& pipe)
+{
+	if(pipe.ep == 0 || pipe.busy || pipe.count == 0) {
+		return;
+	}
+	auto& transfer = pipe.front();
+	if(pipe.zlpPending) {
+		pipe.busy = usbd_edpt_xfer(rhport, pipe.ep, nullptr, 0);
+	} else {
+		pipe.busy = usbd_edpt_xfer(rhport, pipe.ep, transfer.buffer, transfer.length);
+	}
+	if(!pipe.busy) {
+		debug_e("[VENDOR] EP 0x%02x xfer failed", pipe.ep);
+	}
+}
+
+void Device::cancelTransfers(Pipe& pipe)
+{
+	pipe.busy = false;
+	pipe.zlpPending = false;
+	// Callbacks may queue new transfers, which are kept
+	for(auto n = pipe.count; n != 0; --n) {
+		auto transfer = pipe.front();
+		pipe.pop();
+		if(pipe.callback) {
+			pipe.callback(*this, transfer.buffer, 0, false);
+		}
+	}
+}
+
+uint16_t Device::bulkOpen(uint8_t rhport, const tusb_desc_interface_t* itf_desc, uint16_t max_len)
+{
+	TU_VERIFY(itf_desc->bNumEndpoints == 2, 0);
+	auto desc = tu_desc_next(itf_desc);
+	auto end = reinterpret_cast<const uint8_t*>(itf_desc) + max_len;
+	while(desc < end && tu_desc_type(desc) != TUSB_DESC_ENDPOINT) {
+		desc = tu_desc_next(desc);
+	}
+	TU_VERIFY(desc < end, 0);
+	auto epDesc = reinterpret_cast<const tusb_desc_endpoint_t*>(desc);
+	TU_ASSERT(usbd_open_edpt_pair(rhport, desc, 2, TUSB_XFER_BULK, &out.ep, &in.ep), 0);
+
+	this->rhport = rhport;
+	in.packetSize = out.packetSize = tu_edpt_packet_size(epDesc);
+	desc = tu_desc_next(tu_desc_next(desc));
+
+	debug_i("[VENDOR] %s bulk mode, EP IN 0x%02x, OUT 0x%02x, packet size %u", name, in.ep, out.ep, in.packetSize);
+
+	// Start any transfers queued before mount
+	startTransfer(out);
+	startTransfer(in);
+
+	return desc - reinterpret_cast<const uint8_t*>(itf_desc);
+}
+
+void Device::bulkReset()
+{
+	// Transfers queued before mount are kept, otherwise they're aborted
+	bool mounted = (in.ep != 0);
+	in.ep = out.ep = 0;
+	in.packetSize = out.packetSize = 0;
+	if(mounted) {
+		cancelTransfers(in);
+		cancelTransfers(out);
+	}
+}
+
+bool Device::bulkTransferComplete(uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+	Pipe* pipe;
+	if(ep_addr == in.ep) {
+		pipe = &in;
+	} else if(ep_addr == out.ep) {
+		pipe = &out;
+	} else {
+		return false;
+	}
+
+	pipe->busy = false;
+	if(pipe->count == 0) {
+		return true;
+	}
+	auto transfer = pipe->front();
+	bool success = (result == XFER_RESULT_SUCCESS);
+	if(pipe->zlpPending) {
+		pipe->zlpPending = false;
+		xferred_bytes = transfer.length;
+	} else if(success && transfer.zlp && xferred_bytes != 0 && xferred_bytes % pipe->packetSize == 0) {
+		// Host cannot tell transfer has ended without a short packet
+		pipe->zlpPending = true;
+		startTransfer(*pipe);
+		return true;
+	}
+
+	if(!success) {
+		debug_w("[VENDOR] EP 0x%02x xfer result %u", ep_addr, result);
+	}
+
+	// Keep endpoint busy while callback runs
+	pipe->pop();
+	startTransfer(*pipe);
+	if(pipe->callback) {
+		pipe->callback(*this, transfer.buffer, xferred_bytes, success);
+	}
+	return true;
+}
+
+namespace
+{
+// Vendor interfaces seen since configuration was set, and how many of those were left to TinyUSB
+uint8_t interfaceCount;
+uint8_t fifoCount;
+
+void bulkd_init()
+{
+	interfaceCount = fifoCount = 0;
+}
+
+void bulkd_reset(uint8_t rhport)
+{
+	(void)rhport;
+	interfaceCount = fifoCount = 0;
+	for(unsigned i = 0; i < CFG_TUD_VENDOR; ++i) {
+		auto dev = getDeviceByIndex(i);
+		if(dev->isBulkMode()) {
+			dev->bulkReset();
+		}
+	}
+}
+
+uint16_t bulkd_open(uint8_t rhport, const tusb_desc_interface_t* itf_desc, uint16_t max_len)
+{
+	TU_VERIFY(itf_desc->bInterfaceClass == TUSB_CLASS_VENDOR_SPECIFIC, 0);
+
+	auto dev = getDeviceByIndex(interfaceCount++);
+	if(dev == nullptr) {
+		return 0;
+	}
+	if(!dev->isBulkMode()) {
+		// Leave to standard driver, which allocates instances in order
+		dev->setInstance(fifoCount++);
+		return 0;
+	}
+	return dev->bulkOpen(rhport, itf_desc, max_len);
+}
+
+bool bulkd_control_xfer_cb(uint8_t rhport, uint8_t stage, const tusb_control_request_t* request)
+{
+	// Vendor requests go to tud_vendor_control_xfer_cb(), there are no class requests
+	return false;
+}
+
+bool bulkd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes)
+{
+	for(unsigned i = 0; i < CFG_TUD_VENDOR; ++i) {
+		auto dev = getDeviceByIndex(i);
+		if(dev->isBulkMode() && dev->bulkTransferComplete(ep_addr, result, xferred_bytes)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+} // namespace
+
+/*
+ * Application class driver which claims vendor interfaces in bulk mode, registered in USB.cpp.
+ * Other vendor interfaces are handled by the standard TinyUSB driver.
+ */
+const usbd_class_driver_t* getBulkDriver()
+{
+	static usbd_class_driver_t driver;
+	if(driver.open == nullptr) {
+#if CFG_TUSB_DEBUG >= 2
+		driver.name = "VENDOR_BULK";
+#endif
+		driver.init = bulkd_init;
+		driver.reset = bulkd_reset;
+		driver.open = bulkd_open;
+		driver.control_xfer_cb = bulkd_control_xfer_cb;
+		driver.xfer_cb = bulkd_xfer_cb;
+	}
+	return &driver;
+}
+
 } // namespace USB::VENDOR
 
 using namespace USB::VENDOR;
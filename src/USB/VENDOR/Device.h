@@ -27,20 +27,37 @@ namespace USB::VENDOR
 /**
  * @brief The TinyUSB vendor API is very much like a serial port.
  * Each instance corresponds to a bi-directional interface.
+ *
+ * Alternatively, call `setBulkMode()` to transfer application buffers directly
+ * to and from the endpoints, bypassing the TinyUSB FIFOs.
  */
 class Device : public DeviceInterface, public USB::CDC::UsbSerial
 {
 public:
+	/**
+	 * @brief Maximum number of transfers queued in each direction
+	 */
+	static constexpr uint8_t bulkQueueDepth{4};
+
+	/**
+	 * @brief Callback invoked when a bulk transfer has completed
+	 * @param device
+	 * @param buffer As passed to `bulkSend()` or `bulkReceive()`
+	 * @param length Number of bytes transferred
+	 * @param success false if transfer failed or was cancelled by a bus reset
+	 */
+	using BulkComplete = Delegate<void(Device& device, void* buffer, size_t length, bool success)>;
+
 	Device(uint8_t idx, const char* name);
 
 	size_t setRxBufferSize(size_t size) override
 	{
-		return CFG_TUD_CDC_RX_BUFSIZE;
+		return CFG_TUD_VENDOR_RX_BUFSIZE;
 	}
 
 	virtual size_t setTxBufferSize(size_t size) override
 	{
-		return CFG_TUD_CDC_TX_BUFSIZE;
+		return CFG_TUD_VENDOR_TX_BUFSIZE;
 	}
 
 	int available() override
@@ -50,7 +67,7 @@ public:
 
 	bool isFinished() override
 	{
-		return !tud_vendor_n_mounted(inst);
+		return bulkMode ? (in.ep == 0) : !tud_vendor_n_mounted(inst);
 	}
 
 	int read() override
@@ -88,6 +105,119 @@ public:
 	using Stream::write;
 
 	size_t write(const uint8_t* buffer, size_t size) override;
+
+	/**
+	 * @brief Use endpoints directly instead of the serial API
+	 * @param sendComplete Invoked when each `bulkSend()` transfer has completed
+	 * @param receiveComplete Invoked when each `bulkReceive()` transfer has completed
+	 * @note Must be called before USB is started as the interface is claimed when the host sets configuration.
+	 *
+	 * Buffers are transferred directly by the USB controller so there is no copying,
+	 * and each may be many packets long. Queue several buffers in each direction so
+	 * the next transfer starts as soon as the previous one completes.
+	 * Buffers must remain valid until completion and may require alignment (see CFG_TUSB_MEM_ALIGN).
+	 */
+	void setBulkMode(BulkComplete sendComplete, BulkComplete receiveComplete)
+	{
+		bulkMode = true;
+		in.callback = sendComplete;
+		out.callback = receiveComplete;
+	}
+
+	bool isBulkMode() const
+	{
+		return bulkMode;
+	}
+
+	/**
+	 * @brief Queue data for sending on the IN endpoint
+	 * @param buffer Data to send
+	 * @param length Number of bytes to send
+	 * @param zlp Terminate transfer with zero-length packet if it ends on a packet boundary.
+	 * Set false when a transfer is part of a larger message.
+	 * @retval bool false if interface not mounted or queue is full
+	 */
+	bool bulkSend(const void* buffer, size_t length, bool zlp = true);
+
+	/**
+	 * @brief Queue buffer for receiving data from the OUT endpoint
+	 * @param buffer Where to store data
+	 * @param length Size of buffer, should be a multiple of the endpoint size
+	 * @retval bool false if interface not mounted or queue is full
+	 *
+	 * The transfer completes when the buffer is full or the host sends a short (or zero-length) packet.
+	 */
+	bool bulkReceive(void* buffer, size_t length);
+
+	/**
+	 * @brief Get number of transfers which can be queued
+	 */
+	uint8_t getBulkSendSpace() const
+	{
+		return bulkQueueDepth - in.count;
+	}
+
+	uint8_t getBulkReceiveSpace() const
+	{
+		return bulkQueueDepth - out.count;
+	}
+
+	/**
+	 * @brief Get endpoint packet size
+	 * @retval uint16_t 0 if not mounted in bulk mode
+	 */
+	uint16_t getBulkPacketSize() const
+	{
+		return in.packetSize;
+	}
+
+protected:
+	uint16_t bulkOpen(uint8_t rhport, const tusb_desc_interface_t* itf_desc, uint16_t max_len);
+	void bulkReset();
+	bool bulkTransferComplete(uint8_t ep_addr, xfer_result_t result, uint32_t xferred_bytes);
+
+	void setInstance(uint8_t instance)
+	{
+		inst = instance;
+	}
+
+private:
+	struct Transfer {
+		uint8_t* buffer;
+		uint32_t length;
+		bool zlp;
+	};
+
+	struct Pipe {
+		BulkComplete callback;
+		Transfer queue[bulkQueueDepth];
+		uint16_t packetSize{0};
+		uint8_t ep{0};
+		uint8_t head{0};
+		uint8_t count{0};
+		bool busy{false};
+		bool zlpPending{false};
+
+		Transfer& front()
+		{
+			return queue[head];
+		}
+
+		bool push(const Transfer& transfer);
+		void pop()
+		{
+			head = (head + 1) % bulkQueueDepth;
+			--count;
+		}
+	};
+
+	void startTransfer(Pipe& pipe);
+	void cancelTransfers(Pipe& pipe);
+
+	Pipe in;
+	Pipe out;
+	uint8_t rhport{0};
+	bool bulkMode{false};
 };
 
 } // namespace USB::VENDOR
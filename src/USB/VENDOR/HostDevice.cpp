@@ -21,8 +21,16 @@
 
 #if CFG_TUH_ENABLED && CFG_TUH_VENDOR
 
+#include <host/usbh_pvt.h>
+
 namespace USB::VENDOR
 {
+class InternalHostDevice : public HostDevice
+{
+public:
+	using HostDevice::queueTransferComplete;
+};
+
 MountCallback mountCallback;
 UnmountCallback unmountCallback;
 HostDevice* host_devices[CFG_TUH_VENDOR];
@@ -74,6 +82,240 @@ bool HostDevice::openEndpoint(const tusb_desc_endpoint_t& ep_desc)
 	return true;
 }
 
+int HostDevice::Queue::indexOf(const uint8_t* data) const
+{
+	auto offset = data - pool.get();
+	if(offset < 0 || offset >= count * bufferSize || offset % bufferSize != 0) {
+		return -1;
+	}
+	return offset / bufferSize;
+}
+
+int HostDevice::Queue::findFree() const
+{
+	for(unsigned i = 0; i < count; ++i) {
+		if(state[i] == State::free) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+HostDevice::Queue* HostDevice::findQueue(uint8_t ep_addr)
+{
+	for(auto& q : queues) {
+		if(q.ep == ep_addr) {
+			return &q;
+		}
+	}
+	return nullptr;
+}
+
+const HostDevice::Queue* HostDevice::findQueue(uint8_t ep_addr) const
+{
+	return const_cast<HostDevice*>(this)->findQueue(ep_addr);
+}
+
+HostDevice::Queue* HostDevice::createQueue(uint8_t ep_addr, uint8_t bufferCount, uint16_t bufferSize)
+{
+	if(!ownsEndpoint(ep_addr) || findQueue(ep_addr) || bufferCount == 0 || bufferCount > maxQueueBuffers ||
+	   bufferSize == 0) {
+		return nullptr;
+	}
+
+	Queue queue{};
+	queue.pool.reset(new uint8_t[bufferCount * bufferSize]);
+	if(!queue.pool) {
+		return nullptr;
+	}
+	queue.ep = ep_addr;
+	queue.count = bufferCount;
+	queue.bufferSize = bufferSize;
+	queues.push_back(std::move(queue));
+	return &queues.back();
+}
+
+bool HostDevice::startReceive(uint8_t ep_addr, uint8_t bufferCount, uint16_t bufferSize)
+{
+	if(tu_edpt_dir(ep_addr) != TUSB_DIR_IN) {
+		return false;
+	}
+	auto queue = createQueue(ep_addr, bufferCount, bufferSize);
+	if(queue == nullptr) {
+		return false;
+	}
+	submit(*queue);
+	return queue->busy;
+}
+
+bool HostDevice::startSend(uint8_t ep_addr, uint8_t bufferCount, uint16_t bufferSize)
+{
+	if(tu_edpt_dir(ep_addr) != TUSB_DIR_OUT) {
+		return false;
+	}
+	return createQueue(ep_addr, bufferCount, bufferSize) != nullptr;
+}
+
+uint8_t* HostDevice::getSendBuffer(uint8_t ep_addr)
+{
+	auto queue = findQueue(ep_addr);
+	if(queue == nullptr || tu_edpt_dir(ep_addr) != TUSB_DIR_OUT) {
+		return nullptr;
+	}
+	int index = queue->findFree();
+	if(index < 0) {
+		return nullptr;
+	}
+	queue->state[index] = Queue::State::held;
+	return queue->getBuffer(index);
+}
+
+bool HostDevice::send(uint8_t ep_addr, uint8_t* data, uint16_t length)
+{
+	auto queue = findQueue(ep_addr);
+	if(queue == nullptr || tu_edpt_dir(ep_addr) != TUSB_DIR_OUT) {
+		return false;
+	}
+	int index = queue->indexOf(data);
+	if(index < 0 || queue->state[index] != Queue::State::held || length > queue->bufferSize) {
+		return false;
+	}
+	queue->length[index] = length;
+	queue->state[index] = Queue::State::queued;
+	queue->order[(queue->head + queue->queued) % maxQueueBuffers] = index;
+	++queue->queued;
+	submit(*queue);
+	return true;
+}
+
+bool HostDevice::write(uint8_t ep_addr, const void* data, uint16_t length)
+{
+	auto queue = findQueue(ep_addr);
+	if(queue == nullptr || length > queue->bufferSize) {
+		return false;
+	}
+	auto buffer = getSendBuffer(ep_addr);
+	if(buffer == nullptr) {
+		return false;
+	}
+	memcpy(buffer, data, length);
+	return send(ep_addr, buffer, length);
+}
+
+void HostDevice::releaseBuffer(uint8_t ep_addr, uint8_t* data)
+{
+	auto queue = findQueue(ep_addr);
+	if(queue == nullptr) {
+		return;
+	}
+	int index = queue->indexOf(data);
+	if(index < 0 || queue->state[index] != Queue::State::held) {
+		return;
+	}
+	queue->state[index] = Queue::State::free;
+	submit(*queue);
+}
+
+bool HostDevice::resumeQueue(uint8_t ep_addr)
+{
+	auto queue = findQueue(ep_addr);
+	if(queue == nullptr) {
+		return false;
+	}
+	queue->stopped = false;
+	submit(*queue);
+	return true;
+}
+
+uint8_t HostDevice::getFreeBuffers(uint8_t ep_addr) const
+{
+	auto queue = findQueue(ep_addr);
+	if(queue == nullptr) {
+		return 0;
+	}
+	uint8_t n{0};
+	for(unsigned i = 0; i < queue->count; ++i) {
+		if(queue->state[i] == Queue::State::free) {
+			++n;
+		}
+	}
+	return n;
+}
+
+void HostDevice::submit(Queue& queue)
+{
+	if(queue.busy || queue.stopped) {
+		return;
+	}
+
+	int index;
+	uint16_t length;
+	bool isIn = (tu_edpt_dir(queue.ep) == TUSB_DIR_IN);
+	if(isIn) {
+		index = queue.findFree();
+		if(index < 0) {
+			// Application still holds all buffers
+			return;
+		}
+		length = queue.bufferSize;
+	} else {
+		if(queue.queued == 0) {
+			return;
+		}
+		index = queue.order[queue.head];
+		length = queue.length[index];
+	}
+
+	if(!usbh_edpt_claim(inst.dev_addr, queue.ep)) {
+		return;
+	}
+	if(!usbh_edpt_xfer(inst.dev_addr, queue.ep, queue.getBuffer(index), length)) {
+		debug_e("[USB-VEND] EP 0x%02x xfer failed", queue.ep);
+		usbh_edpt_release(inst.dev_addr, queue.ep);
+		return;
+	}
+
+	if(!isIn) {
+		queue.head = (queue.head + 1) % maxQueueBuffers;
+		--queue.queued;
+	}
+	queue.state[index] = Queue::State::busy;
+	queue.active = index;
+	queue.busy = true;
+}
+
+bool HostDevice::queueTransferComplete(const Transfer& txfr)
+{
+	auto queue = findQueue(txfr.ep_addr);
+	if(queue == nullptr || !queue->busy) {
+		return false;
+	}
+
+	queue->busy = false;
+	auto index = queue->active;
+	if(txfr.result != XFER_RESULT_SUCCESS) {
+		debug_w("[USB-VEND] EP 0x%02x xfer result %u, queue stopped", txfr.ep_addr, txfr.result);
+		queue->stopped = true;
+	}
+
+	if(tu_edpt_dir(txfr.ep_addr) == TUSB_DIR_OUT) {
+		queue->state[index] = Queue::State::free;
+		submit(*queue);
+		dataSent(txfr);
+		return true;
+	}
+
+	// Keep endpoint busy while application processes data
+	queue->state[index] = Queue::State::held;
+	submit(*queue);
+	auto data = queue->getBuffer(index);
+	if(dataReceived(txfr, data)) {
+		// Callback may have created another queue, so look it up again
+		releaseBuffer(txfr.ep_addr, data);
+	}
+	return true;
+}
+
 } // namespace USB::VENDOR
 
 using namespace USB::VENDOR;
@@ -134,7 +376,11 @@ bool cush_xfer_cb(uint8_t dev_addr, uint8_t ep_addr, xfer_result_t result, uint3
 			xferred_bytes);
 
 	auto dev = getDeviceByEndpoint(dev_addr, ep_addr);
-	return dev && dev->transferComplete({dev_addr, ep_addr, result, xferred_bytes});
+	if(dev == nullptr) {
+		return false;
+	}
+	HostDevice::Transfer txfr{dev_addr, ep_addr, result, xferred_bytes};
+	return static_cast<InternalHostDevice*>(dev)->queueTransferComplete(txfr) || dev->transferComplete(txfr);
 }
 
 void cush_close(uint8_t dev_addr)
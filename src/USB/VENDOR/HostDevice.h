@@ -22,15 +22,25 @@
 #include "../HostInterface.h"
 #include <debug_progmem.h>
 #include <bitset>
+#include <memory>
+#include <vector>
 
 namespace USB::VENDOR
 {
 /**
  * @brief Base class to use for custom devices
+ *
+ * Implementations may handle endpoint transfers themselves via `transferComplete()`,
+ * or use the transfer queues provided by `startReceive()` and `startSend()`.
  */
 class HostDevice : public HostInterface
 {
 public:
+	/**
+	 * @brief Maximum number of buffers in a transfer queue
+	 */
+	static constexpr uint8_t maxQueueBuffers{8};
+
 	/**
 	 * @brief Device configuration received during mount procedure
 	 */
@@ -55,6 +65,8 @@ public:
 	void end() override
 	{
 		ep_mask.reset();
+		queues.clear();
+		HostInterface::end();
 	}
 
 	/**
@@ -66,8 +78,12 @@ public:
 
 	/**
 	 * @brief Called when a non-control USB transfer has completed
+	 * @note Not called for endpoints with a transfer queue
 	 */
-	virtual bool transferComplete(const Transfer& txfr) = 0;
+	virtual bool transferComplete(const Transfer& txfr)
+	{
+		return false;
+	}
 
 	bool ownsEndpoint(uint8_t ep_addr);
 
@@ -80,7 +96,124 @@ protected:
 	 */
 	bool openEndpoint(const tusb_desc_endpoint_t& ep_desc);
 
+	/**
+	 * @brief Keep an IN endpoint receiving continuously into a set of buffers
+	 * @param ep_addr Endpoint, already opened
+	 * @param bufferCount Number of buffers (up to maxQueueBuffers), at least 2 to avoid gaps
+	 * @param bufferSize Size of each buffer, a multiple of the endpoint packet size
+	 * @retval bool false if endpoint not opened, parameters invalid or out of memory
+	 *
+	 * The host controller handles one transfer per endpoint at a time, so as each completes the
+	 * next free buffer is submitted before `dataReceived()` is called. The endpoint therefore stays
+	 * busy while data is processed, and larger buffers let each transfer span many packets.
+	 * Buffers are passed to `dataReceived()` in the order they were filled.
+	 */
+	bool startReceive(uint8_t ep_addr, uint8_t bufferCount, uint16_t bufferSize);
+
+	/**
+	 * @brief Called when a queued IN transfer has completed
+	 * @param txfr Transfer details
+	 * @param data Buffer containing received data
+	 * @retval bool Return true if finished with buffer, or false to keep it until `releaseBuffer()` is called
+	 * @note If the transfer failed the queue is stopped: call `resumeQueue()` when the condition has been cleared
+	 */
+	virtual bool dataReceived(const Transfer& txfr, uint8_t* data)
+	{
+		return true;
+	}
+
+	/**
+	 * @brief Create transfer queue for an OUT endpoint
+	 * @param ep_addr Endpoint, already opened
+	 * @param bufferCount Number of buffers (up to maxQueueBuffers)
+	 * @param bufferSize Size of each buffer
+	 *
+	 * Fill buffers obtained from `getSendBuffer()` and pass them to `send()`.
+	 * Queued transfers are submitted back-to-back in order.
+	 */
+	bool startSend(uint8_t ep_addr, uint8_t bufferCount, uint16_t bufferSize);
+
+	/**
+	 * @brief Get a free buffer from an OUT queue
+	 * @retval uint8_t* nullptr if none are free
+	 */
+	uint8_t* getSendBuffer(uint8_t ep_addr);
+
+	/**
+	 * @brief Queue a buffer for sending
+	 * @param ep_addr
+	 * @param data Buffer from `getSendBuffer()`, which is released when the transfer completes
+	 * @param length Number of bytes to send
+	 */
+	bool send(uint8_t ep_addr, uint8_t* data, uint16_t length);
+
+	/**
+	 * @brief Copy data into a free buffer and queue it for sending
+	 */
+	bool write(uint8_t ep_addr, const void* data, uint16_t length);
+
+	/**
+	 * @brief Called when a queued OUT transfer has completed
+	 * @note If the transfer failed the queue is stopped: call `resumeQueue()` when the condition has been cleared
+	 */
+	virtual void dataSent(const Transfer& txfr)
+	{
+	}
+
+	/**
+	 * @brief Return a buffer kept by `dataReceived()` to the queue
+	 */
+	void releaseBuffer(uint8_t ep_addr, uint8_t* data);
+
+	/**
+	 * @brief Restart a queue stopped by a failed transfer
+	 */
+	bool resumeQueue(uint8_t ep_addr);
+
+	/**
+	 * @brief Get number of buffers in a queue which are not in use
+	 */
+	uint8_t getFreeBuffers(uint8_t ep_addr) const;
+
+	bool queueTransferComplete(const Transfer& txfr);
+
 private:
+	struct Queue {
+		enum class State : uint8_t {
+			free,
+			busy,	///< Submitted to host controller
+			queued,  ///< OUT: waiting to be submitted
+			held,	///< IN: passed to application, OUT: being filled
+		};
+
+		std::unique_ptr<uint8_t[]> pool;
+		uint16_t bufferSize;
+		uint8_t ep;
+		uint8_t count;
+		State state[maxQueueBuffers];
+		uint16_t length[maxQueueBuffers]; ///< OUT: data length
+		uint8_t order[maxQueueBuffers];   ///< OUT: buffers in send order
+		uint8_t head;
+		uint8_t queued;
+		uint8_t active; ///< Buffer submitted to host controller
+		bool busy;
+		bool stopped;
+
+		uint8_t* getBuffer(uint8_t index)
+		{
+			return &pool[index * bufferSize];
+		}
+
+		int indexOf(const uint8_t* data) const;
+		int findFree() const;
+	};
+
+	Queue* findQueue(uint8_t ep_addr);
+	const Queue* findQueue(uint8_t ep_addr) const;
+	Queue* createQueue(uint8_t ep_addr, uint8_t bufferCount, uint16_t bufferSize);
+	void submit(Queue& queue);
+
+	std::vector<Queue> queues;
 	std::bitset<32> ep_mask{};
 };
 
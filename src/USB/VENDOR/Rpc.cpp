@@ -0,0 +1,276 @@
+/****
+ * VENDOR/Rpc.cpp
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#include <USB.h>
+
+#if defined(ENABLE_USB_CLASSES) && CFG_TUD_VENDOR
+
+#include "Rpc.h"
+#include <debug_progmem.h>
+#include <algorithm>
+
+namespace USB::VENDOR
+{
+namespace
+{
+// Buffers must hold whole packets, so use full-speed packet size as minimum granularity
+constexpr uint16_t minPacketSize{64};
+
+} // namespace
+
+uint16_t Rpc::Message::getCapacity() const
+{
+	return rpc ? rpc->bufferSize - sizeof(Header) : 0;
+}
+
+bool Rpc::Message::reply(Status status, uint16_t length)
+{
+	if(rpc == nullptr || state != State::request) {
+		return false;
+	}
+	header().status = status;
+	return rpc->send(*this, Kind::response, length);
+}
+
+bool Rpc::begin(uint8_t bufferCount, uint16_t bufferSize)
+{
+	if(pool || bufferCount == 0 || bufferSize <= sizeof(Header) || bufferSize % minPacketSize != 0) {
+		return false;
+	}
+
+	pool.reset(new uint8_t[bufferCount * bufferSize]);
+	messages.reset(new Message[bufferCount]);
+	if(!pool || !messages) {
+		pool.reset();
+		messages.reset();
+		return false;
+	}
+	this->bufferCount = bufferCount;
+	this->bufferSize = bufferSize;
+	for(unsigned i = 0; i < bufferCount; ++i) {
+		auto& msg = messages[i];
+		msg.rpc = this;
+		msg.buffer = &pool[i * bufferSize];
+	}
+
+	device.setBulkMode([this](Device&, void* buffer, size_t, bool success) { sent(buffer, success); },
+					   [this](Device&, void* buffer, size_t length, bool success) { received(buffer, length, success); });
+
+	// Transfers are kept until interface is mounted
+	queueReceives();
+	return true;
+}
+
+void Rpc::on(uint16_t method, Handler handler)
+{
+	for(auto& m : methods) {
+		if(m.id == method) {
+			m.handler = handler;
+			return;
+		}
+	}
+	methods.push_back({method, handler});
+}
+
+Rpc::Message* Rpc::findMessage(const void* buffer)
+{
+	auto offset = static_cast<const uint8_t*>(buffer) - pool.get();
+	if(offset < 0 || offset >= bufferCount * bufferSize) {
+		return nullptr;
+	}
+	return &messages[offset / bufferSize];
+}
+
+uint8_t Rpc::getFreeCount() const
+{
+	uint8_t count{0};
+	for(unsigned i = 0; i < bufferCount; ++i) {
+		if(messages[i].state == Message::State::free) {
+			++count;
+		}
+	}
+	return count;
+}
+
+Rpc::Message* Rpc::allocate()
+{
+	for(unsigned i = 0; i < bufferCount; ++i) {
+		auto& msg = messages[i];
+		if(msg.state == Message::State::free) {
+			msg.state = Message::State::event;
+			return &msg;
+		}
+	}
+	return nullptr;
+}
+
+bool Rpc::sendEvent(Message& message, uint16_t method, uint16_t length)
+{
+	if(message.rpc != this || message.state != Message::State::event) {
+		return false;
+	}
+	auto& hdr = message.header();
+	hdr.tag = 0;
+	hdr.method = method;
+	hdr.status = Status::success;
+	return send(message, Kind::event, length);
+}
+
+void Rpc::release(Message& message)
+{
+	message.state = Message::State::free;
+	message.next = nullptr;
+}
+
+void Rpc::queueReceives()
+{
+	// Keep a buffer back for events where possible
+	uint8_t depth = std::min(Device::bulkQueueDepth, uint8_t(std::max(bufferCount - 1, 1)));
+	for(unsigned i = 0; i < bufferCount && receiveCount < depth; ++i) {
+		auto& msg = messages[i];
+		if(msg.state != Message::State::free) {
+			continue;
+		}
+		if(!device.bulkReceive(msg.buffer, bufferSize)) {
+			break;
+		}
+		msg.state = Message::State::receiving;
+		++receiveCount;
+	}
+}
+
+bool Rpc::send(Message& message, Kind kind, uint16_t length)
+{
+	if(length > message.getCapacity()) {
+		return false;
+	}
+	auto& hdr = message.header();
+	hdr.kind = kind;
+	hdr.length = length;
+	message.state = Message::State::sending;
+	message.next = nullptr;
+	if(sendTail) {
+		sendTail->next = &message;
+	} else {
+		sendHead = &message;
+	}
+	sendTail = &message;
+	flushSendQueue();
+	return true;
+}
+
+void Rpc::flushSendQueue()
+{
+	while(sendHead && device.getBulkSendSpace() != 0) {
+		auto msg = sendHead;
+		sendHead = msg->next;
+		if(sendHead == nullptr) {
+			sendTail = nullptr;
+		}
+		// A message which fills the buffer is complete without a zero-length packet, as for receiving
+		size_t length = sizeof(Header) + msg->getLength();
+		if(!device.bulkSend(msg->buffer, length, length < bufferSize)) {
+			release(*msg);
+		}
+	}
+}
+
+void Rpc::sent(void* buffer, bool success)
+{
+	auto msg = findMessage(buffer);
+	if(msg == nullptr) {
+		return;
+	}
+	if(!success) {
+		debug_w("[RPC] Send failed, tag %u", msg->getHeader().tag);
+	}
+	release(*msg);
+	flushSendQueue();
+	queueReceives();
+}
+
+void Rpc::received(void* buffer, size_t length, bool success)
+{
+	auto msg = findMessage(buffer);
+	if(msg == nullptr) {
+		return;
+	}
+	--receiveCount;
+	release(*msg);
+
+	if(!success) {
+		// Bus reset: buffer is re-queued for next session
+		queueReceives();
+		return;
+	}
+
+	if(discarding) {
+		// Transfer ends with a short packet
+		if(length < bufferSize) {
+			discarding = false;
+		}
+		queueReceives();
+		return;
+	}
+
+	auto& hdr = msg->header();
+	if(length < sizeof(Header) || hdr.kind != Kind::request) {
+		debug_w("[RPC] Bad message, %u bytes", length);
+		++errorCount;
+		queueReceives();
+		return;
+	}
+
+	msg->state = Message::State::request;
+	if(sizeof(Header) + hdr.length > length) {
+		debug_w("[RPC] Message too large, tag %u, %u bytes", hdr.tag, hdr.length);
+		++errorCount;
+		if(length == bufferSize) {
+			discarding = true;
+		}
+		msg->reply(Status::badMessage);
+		queueReceives();
+		return;
+	}
+
+	++requestCount;
+	if(hdr.method == infoMethod) {
+		handleInfo(*msg);
+	} else {
+		auto it = std::find_if(methods.begin(), methods.end(), [&](auto& m) { return m.id == hdr.method; });
+		if(it == methods.end() || !it->handler) {
+			msg->reply(Status::unknownMethod);
+		} else {
+			it->handler(*this, *msg);
+		}
+	}
+
+	queueReceives();
+}
+
+void Rpc::handleInfo(Message& request)
+{
+	Info info{version, bufferCount, bufferSize};
+	memcpy(request.getPayload(), &info, sizeof(info));
+	request.reply(sizeof(info));
+}
+
+} // namespace USB::VENDOR
+
+#endif
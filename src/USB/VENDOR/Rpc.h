@@ -0,0 +1,242 @@
+/****
+ * VENDOR/Rpc.h
+ *
+ * Copyright 2023 mikee47 <mike@sillyhouse.net>
+ *
+ * This file is part of the Sming USB Library
+ *
+ * This library is free software: you can redistribute it and/or modify it under the terms of the
+ * GNU General Public License as published by the Free Software Foundation, version 3 or later.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with this library.
+ * If not, see <https://www.gnu.org/licenses/>.
+ *
+ ****/
+
+#pragma once
+
+#include "Device.h"
+#include <memory>
+#include <vector>
+
+namespace USB::VENDOR
+{
+/**
+ * @brief Request/response messaging over a vendor interface in bulk mode
+ *
+ * Each message is a single bulk transfer, starting with a fixed 8-byte header.
+ * The requester chooses a tag which is copied into the response, so many requests may be
+ * outstanding and responses may be returned in any order.
+ *
+ * Messages are received directly into buffers taken from a fixed pool, and handlers are given
+ * the buffer itself. The response is built in the same buffer, so there is no copying at all.
+ * A handler may reply before returning or keep the request and reply later; the buffer is held until then.
+ * When all buffers are in use no more are queued for receiving, so the host is held off by the USB controller.
+ *
+ * A host writing a message whose length is a multiple of the packet size must either send a
+ * zero-length packet or append a padding byte, unless the message fills the buffer completely.
+ * The same rule applies to messages sent by the device.
+ * Method 0 is reserved and returns an @ref Info structure.
+ * See `tools/rpc/usbrpc.py` for host-side bindings.
+ */
+class Rpc
+{
+public:
+	enum class Kind : uint8_t {
+		request = 1,
+		response = 2,
+		event = 3, ///< Sent by device, no response
+	};
+
+	enum class Status : uint8_t {
+		success = 0,
+		unknownMethod = 1,
+		badMessage = 2,
+		// Values from 0x80 are application-defined
+		user = 0x80,
+	};
+
+	struct __attribute__((packed)) Header {
+		uint16_t tag;	///< Set by requester, copied into response
+		uint16_t method; ///< Copied into response
+		uint16_t length; ///< Size of payload following header
+		Kind kind;
+		Status status; ///< Set in responses
+	};
+
+	static_assert(sizeof(Header) == 8, "Bad Header size");
+
+	/**
+	 * @brief Response to method 0
+	 */
+	struct __attribute__((packed)) Info {
+		uint8_t version;
+		uint8_t bufferCount;
+		uint16_t bufferSize; ///< Largest message including header
+	};
+
+	static constexpr uint8_t version{1};
+	static constexpr uint16_t infoMethod{0};
+
+	/**
+	 * @brief A message buffer taken from the pool
+	 */
+	class Message
+	{
+	public:
+		const Header& getHeader() const
+		{
+			return *reinterpret_cast<const Header*>(buffer);
+		}
+
+		uint16_t getMethod() const
+		{
+			return getHeader().method;
+		}
+
+		uint8_t* getPayload()
+		{
+			return buffer + sizeof(Header);
+		}
+
+		uint16_t getLength() const
+		{
+			return getHeader().length;
+		}
+
+		/**
+		 * @brief Get space available for payload
+		 */
+		uint16_t getCapacity() const;
+
+		/**
+		 * @brief Send response to this request
+		 * @param status
+		 * @param length Size of response payload, already written to `getPayload()`
+		 * @retval bool false if this message is not an outstanding request or length is too large
+		 * @note The request payload is overwritten by the response, so read it first
+		 *
+		 * The message must not be used again after this call.
+		 */
+		bool reply(Status status, uint16_t length = 0);
+
+		bool reply(uint16_t length = 0)
+		{
+			return reply(Status::success, length);
+		}
+
+	private:
+		friend class Rpc;
+
+		enum class State : uint8_t {
+			free,
+			receiving,
+			request, ///< Passed to handler
+			event,   ///< Allocated by application
+			sending,
+		};
+
+		Header& header()
+		{
+			return *reinterpret_cast<Header*>(buffer);
+		}
+
+		Rpc* rpc{nullptr};
+		uint8_t* buffer{nullptr};
+		Message* next{nullptr}; ///< Send queue
+		State state{State::free};
+	};
+
+	/**
+	 * @brief Method handler
+	 * @param rpc
+	 * @param request Valid until `request.reply()` is called
+	 */
+	using Handler = Delegate<void(Rpc& rpc, Message& request)>;
+
+	Rpc(Device& device) : device(device)
+	{
+	}
+
+	/**
+	 * @brief Allocate buffers and put interface into bulk mode
+	 * @param bufferCount Number of buffers in pool, which limits outstanding requests
+	 * @param bufferSize Size of each buffer, which limits message size.
+	 * Must be a multiple of the endpoint packet size: use 512 for high-speed devices.
+	 * @note Call before starting USB
+	 */
+	bool begin(uint8_t bufferCount = 8, uint16_t bufferSize = 512);
+
+	/**
+	 * @brief Register handler for a method
+	 */
+	void on(uint16_t method, Handler handler);
+
+	/**
+	 * @brief Get a free buffer for sending an event
+	 * @retval Message* nullptr if none available
+	 *
+	 * Write payload into `getPayload()` then call `sendEvent()`.
+	 */
+	Message* allocate();
+
+	/**
+	 * @brief Send event message to host
+	 * @param message Obtained from `allocate()`, released when sent
+	 * @param method Identifies event type to host
+	 * @param length Size of payload
+	 */
+	bool sendEvent(Message& message, uint16_t method, uint16_t length);
+
+	/**
+	 * @brief Get number of buffers not in use
+	 */
+	uint8_t getFreeCount() const;
+
+	uint32_t getRequestCount() const
+	{
+		return requestCount;
+	}
+
+	/**
+	 * @brief Get number of received messages discarded as invalid or too large
+	 */
+	uint32_t getErrorCount() const
+	{
+		return errorCount;
+	}
+
+private:
+	struct Method {
+		uint16_t id;
+		Handler handler;
+	};
+
+	Message* findMessage(const void* buffer);
+	void received(void* buffer, size_t length, bool success);
+	void sent(void* buffer, bool success);
+	bool send(Message& message, Kind kind, uint16_t length);
+	void flushSendQueue();
+	void queueReceives();
+	void release(Message& message);
+	void handleInfo(Message& request);
+
+	Device& device;
+	std::vector<Method> methods;
+	std::unique_ptr<uint8_t[]> pool;
+	std::unique_ptr<Message[]> messages;
+	Message* sendHead{nullptr};
+	Message* sendTail{nullptr};
+	uint32_t requestCount{0};
+	uint32_t errorCount{0};
+	uint16_t bufferSize{0};
+	uint8_t bufferCount{0};
+	uint8_t receiveCount{0}; ///< Buffers queued for receiving
+	bool discarding{false};  ///< Skipping remainder of oversized message
+};
+
+} // namespace USB::VENDOR
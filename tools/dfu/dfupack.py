@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+#
+# Sming USB DFU image packer
+#
+# Creates compressed images or patches for use with DFU::PartitionWriter
+# and optionally appends a verification trailer for DFU::Device
+#
+
+import argparse
+import binascii
+import hashlib
+import struct
+import sys
+
+MAGIC = 0x315a4653  # "SFZ1"
+DELTA_MAGIC = 0x31444653  # "SFD1"
+HEADER_FORMAT = '<IBBHII'
+TRAILER_MAGIC = 0x31565344  # "DSV1"
+TRAILER_FORMAT = '<IB3xI32s'
+DIGESTS = {'crc32': 1, 'sha256': 2}
+
+
+class BitWriter:
+    """Accumulates bit fields, most significant bit first"""
+
+    def __init__(self):
+        self.data = bytearray()
+        self.value = 0
+        self.count = 0
+
+    def write(self, value: int, bits: int):
+        self.value = (self.value << bits) | value
+        self.count += bits
+        while self.count >= 8:
+            self.count -= 8
+            self.data.append((self.value >> self.count) & 0xff)
+        self.value &= (1 << self.count) - 1
+
+    def flush(self) -> bytes:
+        if self.count:
+            self.data.append((self.value << (8 - self.count)) & 0xff)
+            self.count = 0
+        return bytes(self.data)
+
+
+def heatshrink_compress(data: bytes, window_bits: int, lookahead_bits: int) -> bytes:
+    """Compress data using heatshrink-compatible LZSS encoding"""
+    window_size = 1 << window_bits
+    max_count = 1 << lookahead_bits
+    # A back-reference must be shorter than the equivalent literals
+    min_count = (1 + window_bits + lookahead_bits) // 9 + 1
+    max_chain = 64
+
+    out = BitWriter()
+    chains = {}
+    pos = 0
+    length = len(data)
+
+    def add_hash(i):
+        key = data[i:i + min_count]
+        if len(key) == min_count:
+            chains.setdefault(key, []).append(i)
+
+    while pos < length:
+        best_len, best_pos = 0, 0
+        key = data[pos:pos + min_count]
+        candidates = chains.get(key, [])
+        limit = min(max_count, length - pos)
+        for cand in reversed(candidates[-max_chain:]):
+            if pos - cand > window_size:
+                break
+            n = min_count
+            while n < limit and data[cand + n] == data[pos + n]:
+                n += 1
+            if n > best_len:
+                best_len, best_pos = n, cand
+                if n == limit:
+                    break
+
+        if best_len >= min_count:
+            out.write(0, 1)
+            out.write(pos - best_pos - 1, window_bits)
+            out.write(best_len - 1, lookahead_bits)
+            for i in range(pos, pos + best_len):
+                add_hash(i)
+            pos += best_len
+        else:
+            out.write(1, 1)
+            out.write(data[pos], 8)
+            add_hash(pos)
+            pos += 1
+
+    return out.flush()
+
+
+def match_length(a: bytes, a_pos: int, b: bytes, b_pos: int, limit: int) -> int:
+    """Number of bytes which match exactly"""
+    n = 0
+    while n + 256 <= limit and a[a_pos + n:a_pos + n + 256] == b[b_pos + n:b_pos + n + 256]:
+        n += 256
+    while n < limit and a[a_pos + n] == b[b_pos + n]:
+        n += 1
+    return n
+
+
+def find_matches(source: bytes, target: bytes, min_match: int) -> list:
+    """Find exact matches between target and source, preferring to continue with the current alignment"""
+    KEY, STRIDE, MAX_CANDIDATES = 8, 4, 8
+    index = {}
+    for i in range(0, len(source) - KEY + 1, STRIDE):
+        cands = index.setdefault(source[i:i + KEY], [])
+        if len(cands) < MAX_CANDIDATES:
+            cands.append(i)
+
+    matches = []
+    pos = 0
+    delta = 0
+    while pos + KEY <= len(target):
+        best_len, best_src = 0, 0
+        src = pos + delta
+        if 0 <= src < len(source):
+            best_len = match_length(source, src, target, pos, min(len(source) - src, len(target) - pos))
+            best_src = src
+        if best_len < min_match:
+            for cand in index.get(target[pos:pos + KEY], []):
+                n = match_length(source, cand, target, pos, min(len(source) - cand, len(target) - pos))
+                if n > best_len:
+                    best_len, best_src = n, cand
+        if best_len >= min_match:
+            matches.append((pos, best_src, best_len))
+            delta = best_src - pos
+            pos += best_len
+        else:
+            pos += 1
+    return matches
+
+
+def varint(value: int) -> bytes:
+    """LEB128 encoding"""
+    out = bytearray()
+    while True:
+        c = value & 0x7f
+        value >>= 7
+        if value:
+            out.append(c | 0x80)
+        else:
+            out.append(c)
+            return bytes(out)
+
+
+def zigzag(value: int) -> int:
+    return (value << 1) if value >= 0 else ((-value) << 1) - 1
+
+
+def make_patch(source: bytes, target: bytes, min_match: int = 12) -> bytes:
+    """Create bsdiff-style patch record stream"""
+    matches = find_matches(source, target, min_match)
+
+    out = bytearray()
+    first_target = matches[0][0] if matches else len(target)
+    first_source = matches[0][1] if matches else 0
+    out += varint(0) + varint(first_target) + target[:first_target] + varint(zigzag(first_source))
+
+    for i, (tgt, src, length) in enumerate(matches):
+        next_tgt, next_src = (matches[i + 1][0], matches[i + 1][1]) if i + 1 < len(matches) else (len(target), 0)
+
+        # Extend match into gap whilst mostly similar, so small changes get encoded as differences
+        gap = min(next_tgt - tgt - length, len(source) - src - length)
+        score, best_score, extend = 0, 0, 0
+        for k in range(gap):
+            if source[src + length + k] == target[tgt + length + k]:
+                score += 1
+            if 2 * score - (k + 1) > best_score:
+                best_score, extend = 2 * score - (k + 1), k + 1
+        diff_len = length + extend
+
+        diff = bytes((target[tgt + k] - source[src + k]) & 0xff for k in range(diff_len))
+        extra = target[tgt + diff_len:next_tgt]
+        adjust = (next_src - (src + diff_len)) if i + 1 < len(matches) else 0
+        out += varint(diff_len) + diff + varint(len(extra)) + extra + varint(zigzag(adjust))
+
+    return bytes(out)
+
+
+def make_trailer(data: bytes, digest: str) -> bytes:
+    """Trailer is checked by the device as the download is received"""
+    if digest == 'crc32':
+        value = struct.pack('<I', binascii.crc32(data))
+    else:
+        value = hashlib.sha256(data).digest()
+    return struct.pack(TRAILER_FORMAT, TRAILER_MAGIC, DIGESTS[digest], len(data), value)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Sming USB DFU image packer')
+    parser.add_argument('input', help='Firmware image file')
+    parser.add_argument('output', help='Compressed image or patch file for download')
+    parser.add_argument('-w', '--window', type=int, default=10, help='Window size as power of 2 (4-12)')
+    parser.add_argument('-l', '--lookahead', type=int, default=5, help='Lookahead size as power of 2')
+    parser.add_argument('-s', '--source', help='Create patch against this image (as currently on device)')
+    parser.add_argument('-r', '--raw', action='store_true', help='Do not compress image')
+    parser.add_argument('-d', '--digest', choices=DIGESTS.keys(), help='Append verification trailer')
+    args = parser.parse_args()
+
+    if not 4 <= args.window <= 12 or not 3 <= args.lookahead < args.window:
+        sys.exit('** ERROR! Invalid window or lookahead size')
+
+    with open(args.input, 'rb') as f:
+        data = f.read()
+
+    if args.raw:
+        output = data
+    else:
+        if args.source:
+            with open(args.source, 'rb') as f:
+                source = f.read()
+            magic = DELTA_MAGIC
+            stream = make_patch(source, data)
+        else:
+            magic = MAGIC
+            stream = data
+        header = struct.pack(HEADER_FORMAT, magic, args.window, args.lookahead, 0, len(data), binascii.crc32(data))
+        output = header + heatshrink_compress(stream, args.window, args.lookahead)
+
+    if args.digest:
+        output += make_trailer(output, args.digest)
+
+    with open(args.output, 'wb') as f:
+        f.write(output)
+
+    total = len(output)
+    print(f"{args.input}: {len(data)} -> {total} bytes ({100 * total // max(len(data), 1)}%)")
+
+
+if __name__ == '__main__':
+    main()
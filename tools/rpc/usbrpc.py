@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+#
+# Sming USB RPC client
+#
+# Host-side bindings for USB::VENDOR::Rpc, for testing and benchmarking.
+# Requires pyusb (pip install pyusb) and, on Windows, a WinUSB-bound interface.
+#
+
+import argparse
+import statistics
+import struct
+import sys
+import time
+
+HEADER_FORMAT = '<HHHBB'
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+INFO_FORMAT = '<BBH'
+INFO_METHOD = 0
+KIND_REQUEST = 1
+KIND_RESPONSE = 2
+KIND_EVENT = 3
+STATUS_NAMES = {0: 'success', 1: 'unknownMethod', 2: 'badMessage'}
+
+
+class RpcError(Exception):
+    def __init__(self, method: int, status: int):
+        self.method = method
+        self.status = status
+        name = STATUS_NAMES.get(status, f'user {status:#x}')
+        super().__init__(f'Method {method} failed: {name}')
+
+
+class UsbTransport:
+    """Bulk endpoints of a vendor interface, using pyusb"""
+
+    def __init__(self, vid: int, pid: int, interface: int = None):
+        import usb.core
+        import usb.util
+        dev = usb.core.find(idVendor=vid, idProduct=pid)
+        if dev is None:
+            raise IOError(f'Device {vid:04x}:{pid:04x} not found')
+        cfg = dev.get_active_configuration()
+        itf = None
+        for i in cfg:
+            if i.bInterfaceClass == 0xff and (interface is None or i.bInterfaceNumber == interface):
+                itf = i
+                break
+        if itf is None:
+            raise IOError('Vendor interface not found')
+        usb.util.claim_interface(dev, itf)
+
+        def find_ep(direction):
+            return usb.util.find_descriptor(
+                itf, custom_match=lambda e: usb.util.endpoint_direction(e.bEndpointAddress) == direction)
+
+        self.dev = dev
+        self.ep_out = find_ep(usb.util.ENDPOINT_OUT)
+        self.ep_in = find_ep(usb.util.ENDPOINT_IN)
+        self.packet_size = self.ep_out.wMaxPacketSize
+
+    def write(self, data: bytes, timeout: int):
+        self.ep_out.write(data, timeout)
+
+    def read(self, size: int, timeout: int) -> bytes:
+        return bytes(self.ep_in.read(size, timeout))
+
+
+class RpcClient:
+    """Issues requests with several outstanding, matching responses by tag"""
+
+    def __init__(self, transport, timeout: int = 1000):
+        self.transport = transport
+        self.timeout = timeout
+        self.next_tag = 1
+        self.pending = {}  # tag -> method
+        self.results = {}  # tag -> (method, status, payload)
+        self.events = []  # (method, payload)
+        self.buffer_size = 512
+        self.window = 1
+        self.version, self.buffer_count, self.buffer_size = struct.unpack(INFO_FORMAT, self.call(INFO_METHOD))
+        # Leave a buffer for device events
+        self.window = max(self.buffer_count - 1, 1)
+        self.max_payload = self.buffer_size - HEADER_SIZE
+
+    def submit(self, method: int, payload: bytes = b'') -> int:
+        """Send request without waiting for response, returning its tag"""
+        while len(self.pending) >= self.window:
+            self.poll()
+        tag = self.next_tag
+        self.next_tag = (tag % 0xffff) + 1
+        msg = struct.pack(HEADER_FORMAT, tag, method, len(payload), KIND_REQUEST, 0) + payload
+        if len(msg) > self.buffer_size:
+            raise ValueError(f'Message too large ({len(msg)} > {self.buffer_size})')
+        # Device sees end of transfer by short packet
+        if len(msg) % self.transport.packet_size == 0 and len(msg) < self.buffer_size:
+            msg += b'\0'
+        self.transport.write(msg, self.timeout)
+        self.pending[tag] = method
+        return tag
+
+    def poll(self):
+        """Read one message from device"""
+        data = self.transport.read(self.buffer_size, self.timeout)
+        if len(data) < HEADER_SIZE:
+            raise IOError(f'Short message ({len(data)} bytes)')
+        tag, method, length, kind, status = struct.unpack_from(HEADER_FORMAT, data)
+        payload = data[HEADER_SIZE:HEADER_SIZE + length]
+        if kind == KIND_EVENT:
+            self.events.append((method, payload))
+        elif kind == KIND_RESPONSE and tag in self.pending:
+            del self.pending[tag]
+            self.results[tag] = (method, status, payload)
+
+    def result(self, tag: int) -> bytes:
+        """Wait for response to a request"""
+        while tag not in self.results:
+            if tag not in self.pending:
+                raise KeyError(f'Unknown tag {tag}')
+            self.poll()
+        method, status, payload = self.results.pop(tag)
+        if status != 0:
+            raise RpcError(method, status)
+        return payload
+
+    def call(self, method: int, payload: bytes = b'') -> bytes:
+        return self.result(self.submit(method, payload))
+
+
+def benchmark(client: RpcClient, method: int, size: int, count: int, depth: int):
+    payload = bytes(size)
+    latencies = []
+    sent = {}
+    start = time.perf_counter()
+    for _ in range(count):
+        while len(sent) >= depth:
+            tag = next(iter(sent))
+            client.result(tag)
+            latencies.append(time.perf_counter() - sent.pop(tag))
+        sent[client.submit(method, payload)] = time.perf_counter()
+    for tag, t in sent.items():
+        client.result(tag)
+        latencies.append(time.perf_counter() - t)
+    elapsed = time.perf_counter() - start
+
+    latencies.sort()
+
+    def pct(p):
+        return latencies[min(len(latencies) - 1, int(p * len(latencies)))] * 1e6
+
+    print(f'{count} requests of {size} bytes, depth {depth}: {count / elapsed:.0f} req/s')
+    print(f'Latency (us): mean {statistics.mean(latencies) * 1e6:.0f}, p50 {pct(0.5):.0f}, '
+          f'p99 {pct(0.99):.0f}, p99.9 {pct(0.999):.0f}, max {latencies[-1] * 1e6:.0f}')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Sming USB RPC client')
+    parser.add_argument('device', help='VID:PID in hex')
+    parser.add_argument('-i', '--interface', type=int, help='Interface number (default: first vendor interface)')
+    parser.add_argument('-t', '--timeout', type=int, default=1000, help='Timeout in milliseconds')
+    sub = parser.add_subparsers(dest='command', required=True)
+    sub.add_parser('info', help='Show device RPC parameters')
+    p = sub.add_parser('call', help='Call method and print response')
+    p.add_argument('method', type=int)
+    p.add_argument('payload', nargs='?', default='', help='Payload in hex')
+    p = sub.add_parser('bench', help='Measure request throughput and latency')
+    p.add_argument('-m', '--method', type=int, default=INFO_METHOD, help='Method to call (default: info)')
+    p.add_argument('-s', '--size', type=int, default=0, help='Payload size')
+    p.add_argument('-n', '--count', type=int, default=10000)
+    p.add_argument('-d', '--depth', type=int, default=0, help='Requests outstanding (default: buffers less one)')
+    args = parser.parse_args()
+
+    try:
+        vid, pid = (int(x, 16) for x in args.device.split(':'))
+    except ValueError:
+        sys.exit('** ERROR! Device must be given as VID:PID')
+
+    client = RpcClient(UsbTransport(vid, pid, args.interface), args.timeout)
+    if args.command == 'info':
+        print(f'Version {client.version}, {client.buffer_count} buffers of {client.buffer_size} bytes')
+    elif args.command == 'call':
+        print(client.call(args.method, bytes.fromhex(args.payload)).hex(' '))
+    elif args.command == 'bench':
+        benchmark(client, args.method, args.size, args.count, args.depth or client.window)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,242 @@
+#
+# Generate custom HID report descriptors and matching packed structures
+#
+
+from common import *
+
+USAGE_PAGES = {
+    'generic-desktop': 0x01,
+    'simulation': 0x02,
+    'vr': 0x03,
+    'sport': 0x04,
+    'game': 0x05,
+    'generic-device': 0x06,
+    'keyboard': 0x07,
+    'led': 0x08,
+    'button': 0x09,
+    'ordinal': 0x0a,
+    'telephony': 0x0b,
+    'consumer': 0x0c,
+    'digitizer': 0x0d,
+    'sensor': 0x20,
+    'vendor': 0xff00,
+}
+
+# Main item flags set by name, others default to data, variable, absolute, etc.
+FLAGS = {
+    'constant': 'HID_CONSTANT',
+    'array': 'HID_ARRAY',
+    'relative': 'HID_RELATIVE',
+    'wrap': 'HID_WRAP',
+    'nonlinear': 'HID_NONLINEAR',
+    'no-preferred': 'HID_NO_PREFERRED',
+    'null-state': 'HID_NULL_STATE',
+    'volatile': 'HID_VOLATILE',
+}
+
+MAIN_ITEMS = {
+    'input': 'HID_INPUT',
+    'output': 'HID_OUTPUT',
+    'feature': 'HID_FEATURE',
+}
+
+
+def make_id(s):
+    return s.replace('-', '_').replace(' ', '_').upper()
+
+
+def parse_int(value, name):
+    if isinstance(value, int):
+        return value
+    try:
+        return int(value, 0)
+    except (TypeError, ValueError):
+        raise InputError(f"Bad value '{value}' for {name}")
+
+
+def parse_usage_page(value, name):
+    if isinstance(value, str) and value in USAGE_PAGES:
+        return USAGE_PAGES[value]
+    return parse_int(value, name)
+
+
+def signed_size(value):
+    """Smallest item size code for a signed value (3 means 4 bytes)"""
+    if -0x80 <= value <= 0x7f:
+        return 1
+    if -0x8000 <= value <= 0x7fff:
+        return 2
+    return 3
+
+
+def unsigned_size(value):
+    return 1 if value <= 0xff else 2 if value <= 0xffff else 3
+
+
+def item(macro, value, size):
+    """Emit item using TinyUSB macro, value is masked so C initialiser is always in range"""
+    nbytes = 4 if size == 3 else size
+    value &= (1 << (nbytes * 8)) - 1
+    return f"{macro}_N(0x{value:0{nbytes * 2}x}, {size})" if size > 1 else f"{macro}(0x{value:02x})"
+
+
+class Field:
+    def __init__(self, report_name, main, index, fdef):
+        self.name = fdef.get('name')
+        where = f"hid-reports.{report_name}.{main}[{index}]"
+        self.flags = fdef.get('flags', [])
+        self.constant = 'constant' in self.flags
+        if not self.name and not self.constant:
+            raise InputError(f"{where}: name required unless field is constant")
+        self.bits = fdef.get('bits', 8)
+        self.count = fdef.get('count', 1)
+        if not 1 <= self.bits <= 32:
+            raise InputError(f"{where}: bits must be 1 to 32")
+        self.usage_page = fdef.get('usage-page')
+        if self.usage_page is not None:
+            self.usage_page = parse_usage_page(self.usage_page, where)
+        usage = fdef.get('usage', [])
+        self.usage = [parse_int(u, where) for u in (usage if isinstance(usage, list) else [usage])]
+        self.usage_min = parse_int(fdef['usage-min'], where) if 'usage-min' in fdef else None
+        self.usage_max = parse_int(fdef['usage-max'], where) if 'usage-max' in fdef else None
+        if (self.usage_min is None) != (self.usage_max is None):
+            raise InputError(f"{where}: usage-min and usage-max must be given together")
+        self.min = parse_int(fdef.get('min', 0), where)
+        default_max = (1 << min(self.bits, 31)) - 1
+        self.max = parse_int(fdef.get('max', default_max), where)
+        self.signed = self.min < 0
+        if self.signed:
+            lo, hi = -(1 << (self.bits - 1)), (1 << (self.bits - 1)) - 1
+        else:
+            lo, hi = 0, (1 << self.bits) - 1
+        if not (lo <= self.min <= self.max <= hi):
+            raise InputError(f"{where}: range {self.min} to {self.max} does not fit in {self.bits} bits")
+
+    @property
+    def total_bits(self):
+        return self.bits * self.count
+
+    def flags_expr(self):
+        items = ['HID_CONSTANT' if self.constant else 'HID_DATA']
+        items.append('HID_ARRAY' if 'array' in self.flags else 'HID_VARIABLE')
+        items.append('HID_RELATIVE' if 'relative' in self.flags else 'HID_ABSOLUTE')
+        items += [FLAGS[f] for f in self.flags if f not in ['constant', 'array', 'relative']]
+        return " | ".join(items)
+
+    def struct_members(self, offset):
+        """Return list of member declarations, given bit offset of field within report"""
+        ctype = 'int' if self.signed else 'uint'
+        if offset % 8 == 0 and self.bits in [8, 16, 32]:
+            name = self.name or f"reserved_{offset // 8}"
+            decl = f"{ctype}{self.bits}_t {name}"
+            return [f"{decl}[{self.count}];" if self.count > 1 else f"{decl};"]
+        if self.constant:
+            members = []
+            bits = self.total_bits
+            while bits:
+                n = min(bits, 32)
+                members.append(f"uint32_t : {n};")
+                bits -= n
+            return members
+        if self.bits == 1 and self.count <= 32:
+            # Bitmap, e.g. buttons
+            return [f"uint32_t {self.name} : {self.count};"]
+        if self.count == 1:
+            return [f"{ctype}32_t {self.name} : {self.bits};"]
+        return [f"{ctype}32_t {self.name}_{i} : {self.bits};" for i in range(self.count)]
+
+
+class Report:
+    def __init__(self, name, rdef):
+        self.name = name
+        self.id = make_id(name)
+        self.usage_page = parse_usage_page(rdef.get('usage-page', 'vendor'), f"hid-reports.{name}.usage-page")
+        self.usage = parse_int(rdef.get('usage', 1), f"hid-reports.{name}.usage")
+        self.fields = {}
+        for main in MAIN_ITEMS:
+            fields = [Field(name, main, i, f) for i, f in enumerate(rdef.get(main, []))]
+            bits = sum(f.total_bits for f in fields)
+            if bits % 8:
+                # Reports must occupy whole number of bytes
+                fields.append(Field(name, main, len(fields), {'flags': ['constant'], 'bits': 1, 'count': 8 - bits % 8}))
+            if fields:
+                self.fields[main] = fields
+        if not self.fields:
+            raise InputError(f"hid-reports.{name}: no fields defined")
+
+    def size(self, main):
+        """Size of report in bytes, excluding report ID"""
+        return sum(f.total_bits for f in self.fields.get(main, [])) // 8
+
+    def struct_name(self, main):
+        return f"hid_{self.id.lower()}_{main}_report_t"
+
+    def descriptor_macro(self):
+        """Macro for report descriptor, with report ID passed as variable argument like TinyUSB"""
+        items = []
+        state = {'HID_USAGE_PAGE': self.usage_page}
+        comment = ''
+
+        def add(text):
+            nonlocal comment
+            items.append(f"{comment}{text}")
+            comment = ''
+
+        def set_global(macro, value, size):
+            # Global items persist so only emit changes
+            if state.get(macro) != value:
+                add(item(macro, value, size))
+                state[macro] = value
+
+        for main, fields in self.fields.items():
+            for f in fields:
+                if f.name:
+                    comment = f"/* {f.name} */ "
+                if not f.constant:
+                    page = f.usage_page if f.usage_page is not None else self.usage_page
+                    set_global('HID_USAGE_PAGE', page, unsigned_size(page))
+                    for u in f.usage:
+                        add(item('HID_USAGE', u, unsigned_size(u)))
+                    if f.usage_min is not None:
+                        add(item('HID_USAGE_MIN', f.usage_min, unsigned_size(f.usage_min)))
+                        add(item('HID_USAGE_MAX', f.usage_max, unsigned_size(f.usage_max)))
+                    set_global('HID_LOGICAL_MIN', f.min, signed_size(f.min))
+                    set_global('HID_LOGICAL_MAX', f.max, signed_size(f.max))
+                set_global('HID_REPORT_SIZE', f.bits, 1)
+                set_global('HID_REPORT_COUNT', f.count, unsigned_size(f.count))
+                add(f"{MAIN_ITEMS[main]}({f.flags_expr()})")
+
+        sep = ', \\\n    '
+        lines = [
+            item('HID_USAGE_PAGE', self.usage_page, unsigned_size(self.usage_page)),
+            item('HID_USAGE', self.usage, unsigned_size(self.usage)),
+            'HID_COLLECTION(HID_COLLECTION_APPLICATION), \\\n'
+            '    /* Report ID if any */ \\\n'
+            '    __VA_ARGS__ \\\n'
+            '    ' + sep.join(items),
+            'HID_COLLECTION_END',
+        ]
+        return f"#define TUD_HID_REPORT_DESC_{self.id}(...) \\\n  " + ', \\\n  '.join(lines) + "\n"
+
+    def struct_defs(self):
+        defs = []
+        for main, fields in self.fields.items():
+            members = []
+            offset = 0
+            for f in fields:
+                members += f.struct_members(offset)
+                offset += f.total_bits
+            name = self.struct_name(main)
+            size = self.size(main)
+            txt = f"// {self.name} {main} report\n"
+            txt += "typedef struct TU_ATTR_PACKED {\n"
+            txt += "".join(f"  {m}\n" for m in members)
+            txt += f"}} {name};\n"
+            txt += f'TU_VERIFY_STATIC(sizeof({name}) == {size}, "{self.name} {main} report size mismatch");\n'
+            defs.append(txt)
+        return "\n".join(defs)
+
+
+def parse_reports(config):
+    """Parse 'hid-reports' section of configuration, returning dictionary of Report objects"""
+    return {name: Report(name, rdef) for name, rdef in config.get('hid-reports', {}).items()}
@@ -46,5 +46,11 @@ ${host_classes}
 // Host defines
 ${host_globals}
 
+// Per-transfer endpoint callbacks, used by USB Attached SCSI and USB/HostAsync.h.
+// Transfers without a callback still complete via the class driver.
+#if CFG_TUH_ENABLED
+#define CFG_TUH_API_EDPT_XFER 1
+#endif
+
 // max device support (excluding hub device)
 #define CFG_TUH_DEVICE_MAX (CFG_TUH_HUB ? CFG_TUH_HUB_PORT_COUNT : 1)
@@ -0,0 +1,17 @@
+
+//--------------------------------------------------------------------+
+// BOS Descriptor, WebUSB and Microsoft OS 2.0 descriptors
+//--------------------------------------------------------------------+
+
+${bos_defs}
+
+// Used by library to answer vendor requests
+const uint8_t* tud_get_webusb_url(void)
+{
+  return ${webusb_url};
+}
+
+const uint8_t* tud_get_ms_os_20_descriptor(void)
+{
+  return ${ms_os_20};
+}
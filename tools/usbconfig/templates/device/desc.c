@@ -7,6 +7,7 @@
 
 #include <tusb.h>
 #include "usb_descriptors.h"
+${desc_includes}
 
 /* A combination of interfaces must have a unique product id, since PC will save device driver after the first plug.
  * Same VID/PID with different interface e.g MSC (first), then CDC (later) will possibly cause system error on PC.
@@ -18,7 +19,7 @@
 #define USB_PID           (0x4000 | _PID_MAP(CDC, 0) | _PID_MAP(MSC, 1) | _PID_MAP(HID, 2) | \
                            _PID_MAP(MIDI, 3) | _PID_MAP(VENDOR, 4) )
 
-#define USB_BCD   0x0200
+#define USB_BCD   ${usb_bcd}
 
 //--------------------------------------------------------------------+
 // Device Descriptors
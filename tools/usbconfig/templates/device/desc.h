@@ -19,6 +19,9 @@ ${hid_report_ids}
   REPORT_ID_COUNT
 };
 
+// Custom HID report structures
+${hid_report_types}
+
 enum DfuAlternateId {
 ${dfu_alternate_ids}
   DFU_ALTERNATE_COUNT
@@ -2,6 +2,7 @@
 // HID Report Descriptors
 //--------------------------------------------------------------------+
 
+$report_defs
 $report
 
 const uint8_t* hid_reports[] = {$report_list};
@@ -4,16 +4,31 @@
 #
 
 import common
+import hidreport
 import argparse
 import os
 import json
 import string
 import ast
+import uuid
 from common import *
 from dataclasses import dataclass
 
 TUSB_DESC_STRING = 3
 
+# Reports with descriptors provided by TinyUSB or USB/HID/ReportDescriptors.h
+HID_STANDARD_REPORTS = [
+    'keyboard', 'mouse', 'consumer', 'system-control', 'gamepad', 'fido-u2f', 'generic-inout', 'touchscreen',
+    'absolute-pointer'
+]
+
+# WebUSB URL scheme codes
+WEBUSB_SCHEMES = {'http://': 0, 'https://': 1}
+
+# Touch contacts are 6 bytes, plus 3 bytes for scan time and contact count
+HID_TOUCH_CONTACT_SIZE = 6
+HID_TOUCH_MAX_CONTACTS_PER_REPORT = 10
+
 
 @dataclass
 class ClassItem:
@@ -83,6 +98,8 @@ def parse_devices(config, cfg_vars, classdefs, output_dir):
 
     defs = json_load(resolve_path('schema/base.json'))['$defs']
     templates = json_load(resolve_path('schema/device.json'))
+    hid_custom = hidreport.parse_reports(config)
+    hid_touch_contacts = 0
 
     cfg_vars['device_enabled'] = 1
 
@@ -97,6 +114,28 @@ def parse_devices(config, cfg_vars, classdefs, output_dir):
         strings[id] = StringItem(id, value)
         return id
 
+    # Some interface templates require additional descriptor definitions
+    headers = set()
+    for dev in config['devices'].values():
+        for cfg in dev['configs'].values():
+            for itf in cfg['interfaces'].values():
+                header = templates[itf['template']].get('header')
+                if header:
+                    headers.add(header)
+
+    # Vendor interfaces are bound to WinUSB using Microsoft OS 2.0 descriptors, which require a BOS descriptor
+    def uses_winusb(itf):
+        return templates[itf['template']]['class'] == 'vendor' and itf.get('winusb', True)
+
+    webusb = next((dev['webusb'] for dev in config['devices'].values() if 'webusb' in dev), None)
+    have_winusb = any(
+        uses_winusb(itf) for dev in config['devices'].values() for cfg in dev['configs'].values()
+        for itf in cfg['interfaces'].values())
+    have_bos = webusb is not None or have_winusb
+    if have_bos:
+        headers.add('USB/BosDescriptor.h')
+    winusb_functions = []
+
     globals = {}
     desc_c = ""
     # Device descriptors
@@ -120,6 +159,9 @@ def parse_devices(config, cfg_vars, classdefs, output_dir):
         vars['product_idx'] = add_string(tag, 'product', dev)
         vars['serial_idx'] = add_string(tag, 'serial', dev)
         vars['config_count'] = len(dev['configs'])
+        vars['desc_includes'] = "\n".join(f'#include <{h}>' for h in sorted(headers))
+        # BOS descriptor requires USB 2.1
+        vars['usb_bcd'] = '0x0210' if have_bos else '0x0200'
         desc_c += readTemplate('device/desc.c', vars)
 
     # Configuration descriptors
@@ -151,6 +193,7 @@ def parse_devices(config, cfg_vars, classdefs, output_dir):
             # Emit HID report descriptors and build list of DFU alternate IDs
             hid_inst = 0
             hid_report = ""
+            hid_custom_used = set()
             hid_report_list = []
             hid_report_ids = set()
             dfu_alternate_ids = []
@@ -168,8 +211,26 @@ def parse_devices(config, cfg_vars, classdefs, output_dir):
                         id = make_id(r)
                         hid_report_ids.add(f"REPORT_ID_{id},")
                         args = [f"HID_REPORT_ID(REPORT_ID_{id})"]
-                        if id in ['GENERIC_INOUT', 'FIDO_U2F']:
-                            args.insert(0, bufsize)
+                        if r in hid_custom:
+                            report = hid_custom[r]
+                            for main in report.fields:
+                                if report.size(main) > bufsize - 1:
+                                    raise InputError(f"{itf_tag}: {r} {main} report exceeds ep-bufsize")
+                            hid_custom_used.add(r)
+                        elif r not in HID_STANDARD_REPORTS:
+                            raise InputError(f"{itf_tag}: Unknown report '{r}'")
+                        elif id in ['GENERIC_INOUT', 'FIDO_U2F']:
+                            # Report ID occupies first byte of endpoint buffer
+                            args.insert(0, bufsize - 1)
+                        elif id == 'TOUCHSCREEN':
+                            # As many contacts as fit in endpoint buffer, with report ID
+                            contacts = min((bufsize - 4) // HID_TOUCH_CONTACT_SIZE, HID_TOUCH_MAX_CONTACTS_PER_REPORT)
+                            if contacts < 1:
+                                raise InputError(f"{itf_tag}: ep-bufsize too small for touchscreen")
+                            if hid_touch_contacts and contacts != hid_touch_contacts:
+                                raise InputError(f"{itf_tag}: All touchscreen interfaces must have the same ep-bufsize")
+                            hid_touch_contacts = contacts
+                            args.insert(0, contacts)
                         hid_report += indent(f"TUD_HID_REPORT_DESC_{id} ({', '.join(str(a) for a in args)}),")
                     hid_report += '};\n\n'
                     hid_report_list.append(report_name)
@@ -177,6 +238,7 @@ def parse_devices(config, cfg_vars, classdefs, output_dir):
 
             if hid_inst:
                 vars = {
+                    'report_defs': "\n".join(hid_custom[r].descriptor_macro() for r in sorted(hid_custom_used)),
                     'report': hid_report,
                     'report_list': ", ".join(hid_report_list)
                 }
@@ -272,6 +334,9 @@ def parse_devices(config, cfg_vars, classdefs, output_dir):
                     desc_fields.append((name, value))
 
                 descriptors.append((f'TUD_{make_id(template_tag)}_DESCRIPTOR', desc_fields))
+                if uses_winusb(itf):
+                    guid = itf['guid'] or str(uuid.uuid5(uuid.NAMESPACE_DNS, f"{dev['vendor_id']}.{dev['product']}.{itf_tag}"))
+                    winusb_functions.append((cfg_num - 1, itf_num, f"ITF_NUM_{itf_id}", guid.strip('{}').upper()))
                 itf_num += template.get('itf_count', 1)
 
             itfnum_defs.append(("TOTAL", itf_num))
@@ -294,13 +359,18 @@ def parse_devices(config, cfg_vars, classdefs, output_dir):
                                       f'  {item.data_str()}' for item in strings.values()),
         }
         desc_c += readTemplate('device/string.c', vars)
+        desc_c += readTemplate('device/bos.c', bos_vars(webusb, winusb_functions, itf_num))
 
         cfg_vars['device_classes'] = "\n".join(
             f"#define CFG_TUD_{make_id(name)} {value}" for name, value in itf_counts.items())
         cfg_vars['device_globals'] = "\n".join(
             f"#define CFG_TUD_{make_id(name)} ({value})" for name, value in globals.items())
 
+        hid_report_types = [report.struct_defs() for report in hid_custom.values()]
+        if hid_touch_contacts:
+            hid_report_types.insert(0, f"#define HID_TOUCH_CONTACTS_PER_REPORT {hid_touch_contacts}\n")
         vars = {
+            'hid_report_types': "\n".join(hid_report_types) or '// none',
             'string_ids': indent([f'{id},' for id in strings]),
             'hid_report_ids': indent(hid_report_ids),
             'dfu_alternate_ids': indent(dfu_alternate_ids),
@@ -314,6 +384,82 @@ def parse_devices(config, cfg_vars, classdefs, output_dir):
         write_file(output_dir, 'usb_descriptors.h', desc_h)
 
 
+def bos_vars(webusb, winusb_functions, itf_count):
+    """Generate BOS descriptor with WebUSB and Microsoft OS 2.0 platform capabilities"""
+    vars = {'bos_defs': '// none', 'webusb_url': 'NULL', 'ms_os_20': 'NULL'}
+    if webusb is None and not winusb_functions:
+        return vars
+
+    caps = []
+    bos_len = ['TUD_BOS_DESC_LEN']
+    defs = []
+    if webusb is not None:
+        url = webusb.get('url')
+        if url:
+            scheme = 1
+            for prefix, code in WEBUSB_SCHEMES.items():
+                if url.startswith(prefix):
+                    url, scheme = url[len(prefix):], code
+            if len(url) > 126:
+                raise InputError("webusb.url too long")
+            defs.append(f'#define WEBUSB_URL "{url}"\n\n'
+                        'static const tusb_desc_webusb_url_t desc_webusb_url = {\n'
+                        '  .bLength = 3 + sizeof(WEBUSB_URL) - 1,\n'
+                        '  .bDescriptorType = WEBUSB_DESC_URL,\n'
+                        f'  .bScheme = {scheme}, // {"https" if scheme else "http"}\n'
+                        '  .url = WEBUSB_URL,\n'
+                        '};\n')
+            vars['webusb_url'] = '(const uint8_t*)&desc_webusb_url'
+        caps.append(f"TUD_BOS_WEBUSB_DESCRIPTOR(BOS_VENDOR_REQUEST_WEBUSB, {1 if url else 0}),")
+        bos_len.append('TUD_BOS_WEBUSB_DESC_LEN')
+
+    if winusb_functions:
+        # Function subsets are only used for composite devices
+        composite = itf_count > 1
+        function_len = 'MS_OS_20_COMPATIBLE_ID_LEN + MS_OS_20_DEVICE_INTERFACE_GUIDS_LEN'
+        items = []
+        configs = sorted(set(f[0] for f in winusb_functions))
+        for cfg_index in configs:
+            functions = [f for f in winusb_functions if f[0] == cfg_index]
+            if composite:
+                subset_len = f'MS_OS_20_CONFIG_SUBSET_LEN + {len(functions)} * (MS_OS_20_FUNCTION_SUBSET_LEN + {function_len})'
+                items.append(f'MS_OS_20_CONFIG_SUBSET({cfg_index}, {subset_len}),')
+            for _, _, itf_id, guid in functions:
+                if composite:
+                    items.append(f'MS_OS_20_FUNCTION_SUBSET({itf_id}, MS_OS_20_FUNCTION_SUBSET_LEN + {function_len}),')
+                items.append('MS_OS_20_COMPATIBLE_ID_WINUSB,')
+                chars = ", ".join(f"'{c}', 0" for c in f"{{{guid}}}")
+                items.append(f'// {{{guid}}}')
+                items.append(f'MS_OS_20_DEVICE_INTERFACE_GUIDS({chars}),')
+        count = len(winusb_functions)
+        total = ['MS_OS_20_SET_HEADER_LEN']
+        if composite:
+            total.append(f'{len(configs)} * MS_OS_20_CONFIG_SUBSET_LEN')
+            total.append(f'{count} * MS_OS_20_FUNCTION_SUBSET_LEN')
+        total.append(f'{count} * ({function_len})')
+        defs.append(f'#define MS_OS_20_DESC_LEN ({" + ".join(total)})\n\n'
+                    'static const uint8_t desc_ms_os_20[] = {\n' +
+                    indent(['MS_OS_20_SET_HEADER(MS_OS_20_DESC_LEN),'] + items) + '\n'
+                    '};\n\n'
+                    'TU_VERIFY_STATIC(sizeof(desc_ms_os_20) == MS_OS_20_DESC_LEN, "MS OS 2.0 descriptor size mismatch");\n')
+        vars['ms_os_20'] = 'desc_ms_os_20'
+        caps.append('TUD_BOS_MS_OS_20_DESCRIPTOR(MS_OS_20_DESC_LEN, BOS_VENDOR_REQUEST_MICROSOFT),')
+        bos_len.append('TUD_BOS_MICROSOFT_OS_DESC_LEN')
+
+    defs.append(f'#define BOS_TOTAL_LEN ({" + ".join(bos_len)})\n\n'
+                'static const uint8_t desc_bos[] = {\n' +
+                indent([f'TUD_BOS_DESCRIPTOR(BOS_TOTAL_LEN, {len(caps)}),'] + caps) + '\n'
+                '};\n\n'
+                '// Invoked when received GET BOS DESCRIPTOR request\n'
+                '// Application return pointer to descriptor\n'
+                'const uint8_t* tud_descriptor_bos_cb(void)\n'
+                '{\n'
+                '  return desc_bos;\n'
+                '}')
+    vars['bos_defs'] = "\n".join(defs)
+    return vars
+
+
 def parse_host(config, cfg_vars, classdefs, output_dir):
     if not 'host' in config:
         cfg_vars['host_enabled'] = 0